@@ -0,0 +1,55 @@
+#include "gpfArena.h"
+
+#include <string.h>
+
+
+GpfArena::GpfArena(size_t chunkSize)
+  : m_chunkSize(chunkSize ? chunkSize : DefaultChunkSize), m_cur(NULL), m_left(0),
+    m_used(0), m_reserved(0) {
+}
+
+
+char *GpfArena::allocate(size_t n) {
+  if (n > m_left) {
+    size_t size = n > m_chunkSize ? n : m_chunkSize;
+    m_chunks.push_back(std::unique_ptr<char[]>(new char[size]));
+    m_reserved += size;
+    // an oversized string leaves the current chunk to be filled on
+    if (size > m_chunkSize && m_cur)
+      return m_chunks.back().get();
+    m_cur = m_chunks.back().get();
+    m_left = size;
+  }
+  char *p = m_cur;
+  m_cur += n;
+  m_left -= n;
+  return p;
+}
+
+
+std::string_view GpfArena::copy(std::string_view s) {
+  if (s.empty())
+    return std::string_view();
+  char *p = allocate(s.size());
+  memcpy(p, s.data(), s.size());
+  m_used += s.size();
+  return std::string_view(p, s.size());
+}
+
+
+const char *GpfArena::copyTerminated(std::string_view s) {
+  char *p = allocate(s.size() + 1);
+  memcpy(p, s.data(), s.size());
+  p[s.size()] = '\0';
+  m_used += s.size() + 1;
+  return p;
+}
+
+
+void GpfArena::clear() {
+  m_chunks.clear();
+  m_cur = NULL;
+  m_left = 0;
+  m_used = 0;
+  m_reserved = 0;
+}
@@ -0,0 +1,51 @@
+#ifndef gpfArena_h
+#define gpfArena_h
+
+// Monotonic arena for the strings (point IDs) of an in-memory point
+// table.
+//
+// Strings are copied end to end into large chunks and handed back as
+// views that stay valid until the arena is cleared or destroyed.  Nothing
+// is freed on its own, so millions of short IDs cost one allocation per
+// chunk instead of one per ID, and they sit next to each other in memory
+// in the order they were added.
+
+#include <stddef.h>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+class GpfArena {
+ public:
+  static constexpr size_t DefaultChunkSize = 1 << 20;
+
+  explicit GpfArena(size_t chunkSize = DefaultChunkSize);
+  GpfArena(const GpfArena &) = delete;
+  GpfArena &operator=(const GpfArena &) = delete;
+
+  // Copies s into the arena.  A string longer than the chunk size gets a
+  // chunk of its own.
+  std::string_view copy(std::string_view s);
+
+  // Copies s with a NUL after it, for keeping just the pointer
+  const char *copyTerminated(std::string_view s);
+
+  // Drops every string at once
+  void clear();
+
+  // Bytes of strings held, and bytes allocated for them
+  size_t used() const { return m_used; }
+  size_t reserved() const { return m_reserved; }
+
+ private:
+  char *allocate(size_t n);
+
+  std::vector<std::unique_ptr<char[]> > m_chunks;
+  size_t m_chunkSize;
+  char  *m_cur;
+  size_t m_left;
+  size_t m_used;
+  size_t m_reserved;
+};
+
+#endif
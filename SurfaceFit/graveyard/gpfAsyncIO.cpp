@@ -0,0 +1,453 @@
+#include "gpfAsyncIO.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__) && !defined(GPF_NO_IO_URING) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+// IORING_FEAT_RW_CUR_POS came with IORING_OP_FADVISE, in Linux 5.6
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && \
+    defined(IORING_FEAT_RW_CUR_POS)
+#define GPF_HAVE_IO_URING 1
+#endif
+#endif
+
+static bool pipelined = false;
+
+
+void gpfSetPipelined(bool on) {
+  pipelined = on;
+}
+
+
+bool gpfPipelined() {
+  return pipelined;
+}
+
+
+enum GpfAsyncOp { GpfRead, GpfWrite, GpfWillNeed };
+
+// One request, as queued
+struct GpfAsyncRequest {
+  int         fd;
+  GpfAsyncOp  op;
+  char       *buf;
+  size_t      n;
+  uint64_t    offset;
+  uint64_t    tag;
+  size_t      done;       // bytes already transferred
+#ifdef GPF_HAVE_IO_URING
+  struct iovec iov;
+#endif
+};
+
+
+static GpfAsyncRequest makeRequest(int fd, GpfAsyncOp op, char *buf, size_t n,
+                                   uint64_t offset, uint64_t tag) {
+  GpfAsyncRequest request;
+  memset(&request, 0, sizeof(request));
+  request.fd = fd;
+  request.op = op;
+  request.buf = buf;
+  request.n = n;
+  request.offset = offset;
+  request.tag = tag;
+  return request;
+}
+
+
+// The whole of a request, on the calling thread.  A read ends early at the
+// end of the file.
+static GpfAsyncResult transfer(const GpfAsyncRequest &request) {
+  if (request.op == GpfWillNeed) {
+    bool ok = posix_fadvise(request.fd, (off_t) request.offset, (off_t) request.n,
+                            POSIX_FADV_WILLNEED) == 0;
+    return GpfAsyncResult{request.tag, ok, ok ? request.n : 0};
+  }
+
+  bool write = (request.op == GpfWrite);
+  size_t done = 0;
+  bool ok = true;
+  while (done < request.n) {
+    off_t at = (off_t) (request.offset + done);
+    ssize_t n = write ? pwrite(request.fd, request.buf + done, request.n - done, at)
+                      : pread(request.fd, request.buf + done, request.n - done, at);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      ok = (n == 0 && !write);
+      break;
+    }
+    done += (size_t) n;
+  }
+  return GpfAsyncResult{request.tag, ok, done};
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Engines
+/////////////////////////////////////////////////////////////////////////////
+
+class GpfAsyncIO::Engine {
+ public:
+  virtual ~Engine() {}
+  virtual const char *name() const = 0;
+  virtual void submit(const GpfAsyncRequest &request) = 0;
+  virtual GpfAsyncResult wait() = 0;
+};
+
+
+// A worker thread doing the requests in order
+class ThreadEngine : public GpfAsyncIO::Engine {
+ public:
+  ThreadEngine() : m_stopping(false) {
+    m_worker = std::thread([this]() { work(); });
+  }
+
+  ~ThreadEngine() override {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stopping = true;
+    }
+    m_queued.notify_one();
+    m_worker.join();
+  }
+
+  const char *name() const override { return "thread"; }
+
+  void submit(const GpfAsyncRequest &request) override {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_queue.push_back(request);
+    }
+    m_queued.notify_one();
+  }
+
+  GpfAsyncResult wait() override {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_completed.wait(lock, [this]() { return !m_done.empty(); });
+    GpfAsyncResult result = m_done.front();
+    m_done.pop_front();
+    return result;
+  }
+
+ private:
+  void work() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+      m_queued.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+      if (m_queue.empty())
+        return;
+      GpfAsyncRequest request = m_queue.front();
+      m_queue.pop_front();
+      lock.unlock();
+      GpfAsyncResult result = transfer(request);
+      lock.lock();
+      m_done.push_back(result);
+      m_completed.notify_one();
+    }
+  }
+
+  std::thread                 m_worker;
+  std::mutex                  m_mutex;
+  std::condition_variable     m_queued;
+  std::condition_variable     m_completed;
+  std::deque<GpfAsyncRequest> m_queue;
+  std::deque<GpfAsyncResult>  m_done;
+  bool                        m_stopping;
+};
+
+#ifdef GPF_HAVE_IO_URING
+
+// io_uring, driven through the raw system calls.  Each request has a slot
+// holding its iovec while the kernel works on it, and a short write is
+// queued again for the rest.  A submit with every slot taken first waits
+// for a completion, which the next wait() returns.  A kernel too old for
+// IORING_OP_FADVISE gets the hint from posix_fadvise() instead.
+class UringEngine : public GpfAsyncIO::Engine {
+ public:
+  UringEngine()
+    : m_ring(-1), m_sq(MAP_FAILED), m_cq(MAP_FAILED), m_sqes(MAP_FAILED), m_sqSize(0),
+      m_cqSize(0), m_sqesSize(0), m_unsubmitted(0) {
+  }
+
+  ~UringEngine() override {
+    if (m_sqes != MAP_FAILED)
+      munmap(m_sqes, m_sqesSize);
+    if (m_cq != MAP_FAILED && m_cq != m_sq)
+      munmap(m_cq, m_cqSize);
+    if (m_sq != MAP_FAILED)
+      munmap(m_sq, m_sqSize);
+    if (m_ring >= 0)
+      ::close(m_ring);
+  }
+
+  // Returns false if the kernel does not give us a ring
+  bool init(unsigned depth) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    m_ring = (int) syscall(__NR_io_uring_setup, depth, &params);
+    if (m_ring < 0)
+      return false;
+
+    m_sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = false;
+#ifdef IORING_FEAT_SINGLE_MMAP
+    single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+#endif
+    if (single)
+      m_sqSize = m_cqSize = std::max(m_sqSize, m_cqSize);
+    m_sq = mmap(NULL, m_sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring,
+                IORING_OFF_SQ_RING);
+    if (m_sq == MAP_FAILED)
+      return false;
+    m_cq = single ? m_sq : mmap(NULL, m_cqSize, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_CQ_RING);
+    if (m_cq == MAP_FAILED)
+      return false;
+    m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    m_sqes = mmap(NULL, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring,
+                  IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED)
+      return false;
+
+    char *sq = (char *) m_sq;
+    char *cq = (char *) m_cq;
+    m_sqTail = (unsigned *) (sq + params.sq_off.tail);
+    m_sqMask = (unsigned *) (sq + params.sq_off.ring_mask);
+    m_sqArray = (unsigned *) (sq + params.sq_off.array);
+    m_cqHead = (unsigned *) (cq + params.cq_off.head);
+    m_cqTail = (unsigned *) (cq + params.cq_off.tail);
+    m_cqMask = (unsigned *) (cq + params.cq_off.ring_mask);
+    m_cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+    // The kernel rounds depth up, and the ring takes that many
+    m_slots.resize(params.sq_entries);
+    for (unsigned i = params.sq_entries; i > 0; i--)
+      m_free.push_back(i - 1);
+    return true;
+  }
+
+  const char *name() const override { return "io_uring"; }
+
+  void submit(const GpfAsyncRequest &request) override {
+    while (m_free.empty())
+      m_done.push_back(complete());
+    unsigned slot = m_free.back();
+    m_free.pop_back();
+    m_slots[slot] = request;
+    queue(slot);
+  }
+
+  GpfAsyncResult wait() override {
+    if (!m_done.empty()) {
+      GpfAsyncResult result = m_done.front();
+      m_done.pop_front();
+      return result;
+    }
+    return complete();
+  }
+
+ private:
+  // Waits until a request is done, queueing interrupted and short ones again
+  GpfAsyncResult complete() {
+    while (true) {
+      unsigned head = *m_cqHead;
+      if (head != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe cqe = m_cqes[head & *m_cqMask];
+        __atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+
+        unsigned slot = (unsigned) cqe.user_data;
+        GpfAsyncRequest &request = m_slots[slot];
+        if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+          queue(slot);
+          continue;
+        }
+        if (cqe.res > 0 && request.op != GpfWillNeed) {
+          request.done += (size_t) cqe.res;
+          if (request.op == GpfWrite && request.done < request.n) {
+            queue(slot);
+            continue;
+          }
+        }
+
+        m_free.push_back(slot);
+        if (request.op == GpfWillNeed) {
+          if (cqe.res == -EINVAL)
+            return transfer(request);
+          return GpfAsyncResult{request.tag, cqe.res == 0, cqe.res == 0 ? request.n : 0};
+        }
+        bool ok = cqe.res >= 0 && (request.op == GpfRead || request.done == request.n);
+        return GpfAsyncResult{request.tag, ok, request.done};
+      }
+      enter(IORING_ENTER_GETEVENTS);
+    }
+  }
+
+  void queue(unsigned slot) {
+    GpfAsyncRequest &request = m_slots[slot];
+    request.iov.iov_base = request.buf + request.done;
+    request.iov.iov_len = request.n - request.done;
+
+    unsigned tail = *m_sqTail;
+    unsigned index = tail & *m_sqMask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *) m_sqes + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = request.fd;
+    sqe->off = request.offset + request.done;
+    sqe->user_data = slot;
+    if (request.op == GpfWillNeed) {
+      sqe->opcode = IORING_OP_FADVISE;
+      sqe->len = (uint32_t) request.n;
+      sqe->fadvise_advice = POSIX_FADV_WILLNEED;
+    }
+    else {
+      sqe->opcode = (request.op == GpfWrite) ? IORING_OP_WRITEV : IORING_OP_READV;
+      sqe->addr = (uint64_t) (uintptr_t) &request.iov;
+      sqe->len = 1;
+    }
+    m_sqArray[index] = index;
+    __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+    m_unsubmitted++;
+    enter(0);
+  }
+
+  // Submits what is queued, and with IORING_ENTER_GETEVENTS waits for a
+  // completion.  What the kernel could not take yet goes with the next call.
+  void enter(unsigned flags) {
+    unsigned wanted = (flags & IORING_ENTER_GETEVENTS) ? 1 : 0;
+    if (m_unsubmitted == 0 && wanted == 0)
+      return;
+    int n = (int) syscall(__NR_io_uring_enter, m_ring, m_unsubmitted, wanted, flags, NULL, 0);
+    if (n >= 0)
+      m_unsubmitted -= (unsigned) n;
+    else if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+      throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+  }
+
+  int                  m_ring;
+  void                *m_sq;
+  void                *m_cq;
+  void                *m_sqes;
+  size_t               m_sqSize, m_cqSize, m_sqesSize;
+  unsigned            *m_sqTail, *m_sqMask, *m_sqArray;
+  unsigned            *m_cqHead, *m_cqTail, *m_cqMask;
+  struct io_uring_cqe *m_cqes;
+  unsigned             m_unsubmitted;
+  std::vector<GpfAsyncRequest> m_slots;
+  std::vector<unsigned>        m_free;
+  std::deque<GpfAsyncResult>   m_done;
+};
+
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+// GpfAsyncIO
+/////////////////////////////////////////////////////////////////////////////
+
+GpfAsyncIO::GpfAsyncIO() : m_pending(0) {
+}
+
+
+GpfAsyncIO::~GpfAsyncIO() {
+  waitAll();
+}
+
+
+void GpfAsyncIO::start(unsigned depth) {
+  waitAll();
+  m_engine.reset();
+#ifdef GPF_HAVE_IO_URING
+  std::unique_ptr<UringEngine> uring(new UringEngine);
+  if (uring->init(depth)) {
+    m_engine = std::move(uring);
+    return;
+  }
+#else
+  (void) depth;
+#endif
+  m_engine.reset(new ThreadEngine);
+}
+
+
+const char *GpfAsyncIO::backend() const {
+  return m_engine ? m_engine->name() : "none";
+}
+
+
+void GpfAsyncIO::read(int fd, char *buf, size_t n, uint64_t offset, uint64_t tag) {
+  m_engine->submit(makeRequest(fd, GpfRead, buf, n, offset, tag));
+  m_pending++;
+}
+
+
+void GpfAsyncIO::write(int fd, const char *buf, size_t n, uint64_t offset, uint64_t tag) {
+  m_engine->submit(makeRequest(fd, GpfWrite, (char *) buf, n, offset, tag));
+  m_pending++;
+}
+
+
+void GpfAsyncIO::willNeed(int fd, size_t n, uint64_t offset, uint64_t tag) {
+  m_engine->submit(makeRequest(fd, GpfWillNeed, NULL, n, offset, tag));
+  m_pending++;
+}
+
+
+GpfAsyncResult GpfAsyncIO::wait() {
+  if (m_pending == 0)
+    return GpfAsyncResult{0, true, 0};
+  m_pending--;
+  return m_engine->wait();
+}
+
+
+bool GpfAsyncIO::waitAll() {
+  bool ok = true;
+  while (m_pending > 0)
+    ok = wait().ok && ok;
+  return ok;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// GpfReadAhead
+/////////////////////////////////////////////////////////////////////////////
+
+GpfReadAhead::GpfReadAhead(int fd, size_t size) : m_fd(fd), m_size(size), m_next(0) {
+  m_io.start(2);
+}
+
+
+GpfReadAhead::~GpfReadAhead() {
+  m_io.waitAll();
+}
+
+
+size_t GpfReadAhead::advance(size_t offset) {
+  // the window being consumed and the one after it, at most two hints in
+  // flight
+  size_t wanted = std::min(m_size, (offset / Window + 2) * Window);
+  while (m_next < wanted) {
+    if (m_io.pending() == 2)
+      m_io.wait();
+    size_t n = std::min(Window, m_size - m_next);
+    m_io.willNeed(m_fd, n, m_next, 0);
+    m_next += n;
+  }
+  return m_next < m_size ? m_next - Window : SIZE_MAX;
+}
@@ -0,0 +1,119 @@
+#ifndef gpfAsyncIO_h
+#define gpfAsyncIO_h
+
+// Background reads and writes for the pipelined mode (-pipeline) of the
+// tools.
+//
+// Without it a tool reads, converts and writes strictly in turn on one
+// thread: the parser stalls on page faults while the disk reads the
+// mapped gpf, and the formatting stalls in write(2) while the disk writes
+// the output.  With it the stages overlap:
+//
+//   - read ahead: GpfMappedFile keeps the kernel reading the next two
+//     windows of the file (GpfReadAhead::Window bytes each) into the page
+//     cache while the parser works through the current one, so the pages
+//     it faults on are already there
+//   - write behind: GpfWriter hands each full buffer to the disk and
+//     formats into a second buffer meanwhile, only waiting when the disk
+//     is a whole buffer behind
+//
+// so a run takes about as long as its slowest stage rather than the sum
+// of them.  The bytes written are the same either way.
+//
+// GpfAsyncIO does the I/O through io_uring where the kernel has it (Linux
+// 5.6 and later; the ring is set up with the system calls themselves, so
+// liburing is not needed), and on a worker thread making the pread,
+// pwrite and posix_fadvise calls elsewhere, or where io_uring is refused,
+// e.g. by a seccomp policy.  Build with -DGPF_NO_IO_URING to always use
+// the thread.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+
+// Turns the pipelined mode on for every GpfWriter and GpfMappedFile
+// opened after it.  Set once by a tool, from its command line.
+void gpfSetPipelined(bool on);
+bool gpfPipelined();
+
+struct GpfAsyncResult {
+  uint64_t tag;       // as given to read(), write() or willNeed()
+  bool     ok;
+  size_t   bytes;     // transferred, fewer than asked for a read at the end of file
+};
+
+//-----------------------------------------------------------------------
+// Queue of reads, writes and read ahead hints at file offsets, done in
+// the background
+//-----------------------------------------------------------------------
+class GpfAsyncIO {
+ public:
+  GpfAsyncIO();
+
+  // Waits for whatever is still in flight
+  ~GpfAsyncIO();
+
+  GpfAsyncIO(const GpfAsyncIO &) = delete;
+  GpfAsyncIO &operator=(const GpfAsyncIO &) = delete;
+
+  // Sets up the queue for up to depth requests in flight at once, on
+  // io_uring if the kernel allows it, else on a worker thread
+  void start(unsigned depth);
+
+  // "io_uring" or "thread"
+  const char *backend() const;
+
+  // Queue a read (write) of n bytes at offset of fd.  The buffer must stay
+  // as it is until wait() has returned the request.  With more than the
+  // depth given to start() in flight, queueing one waits for another to
+  // finish first.  A write is only returned once all of it is written or
+  // it failed.
+  void read(int fd, char *buf, size_t n, uint64_t offset, uint64_t tag);
+  void write(int fd, const char *buf, size_t n, uint64_t offset, uint64_t tag);
+
+  // Queue a POSIX_FADV_WILLNEED of n bytes at offset of fd, which starts
+  // the kernel reading them into the page cache without copying them
+  // anywhere
+  void willNeed(int fd, size_t n, uint64_t offset, uint64_t tag);
+
+  size_t pending() const { return m_pending; }
+
+  // Waits for one of the requests in flight (the first to complete, not
+  // necessarily the first queued) and returns it
+  GpfAsyncResult wait();
+
+  // Waits for all of them, returning false if any failed
+  bool waitAll();
+
+  class Engine;
+
+ private:
+  std::unique_ptr<Engine> m_engine;
+  size_t                  m_pending;
+};
+
+//-----------------------------------------------------------------------
+// Read ahead of a mapped file consumed front to back, a window at a time
+//-----------------------------------------------------------------------
+class GpfReadAhead {
+ public:
+  static constexpr size_t Window = 8 << 20;
+
+  GpfReadAhead(int fd, size_t size);
+  ~GpfReadAhead();
+  GpfReadAhead(const GpfReadAhead &) = delete;
+  GpfReadAhead &operator=(const GpfReadAhead &) = delete;
+
+  // Makes sure the windows after offset, the first byte the reader has not
+  // consumed, are being read.  Returns the offset to call it again at,
+  // past the end of the file once all of it has been asked for.
+  size_t advance(size_t offset);
+
+ private:
+  GpfAsyncIO m_io;
+  int        m_fd;
+  size_t     m_size;
+  size_t     m_next;        // first byte not asked for yet
+};
+
+#endif
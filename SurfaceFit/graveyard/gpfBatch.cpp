@@ -0,0 +1,74 @@
+#include "gpfBatch.h"
+
+#include <stdio.h>
+
+#include <future>
+
+#include "gpfReader.h"
+#include "gpfThreadPool.h"
+
+
+bool gpfReadManifest(const char *path, std::vector<GpfBatchJob> &jobs,
+                     std::string &error) {
+  GpfLineReader manifest;
+  if (!manifest.open(path)) {
+    error = "unable to open batch manifest: " + std::string(path);
+    return false;
+  }
+
+  jobs.clear();
+  std::string_view line;
+  int lineno = 0;
+  while (manifest.next(line)) {
+    lineno++;
+    GpfBatchJob job;
+    job.line = lineno;
+    std::string_view field;
+    while (!(field = gpfNextToken(line)).empty()) {
+      if (job.args.empty() && field[0] == '#')
+        break;
+      job.args.push_back(std::string(field));
+    }
+    if (!job.args.empty())
+      jobs.push_back(job);
+  }
+
+  if (manifest.failed()) {
+    error = "error reading batch manifest: " + std::string(path);
+    return false;
+  }
+  return true;
+}
+
+
+size_t gpfRunBatch(const char *manifest, const std::vector<GpfBatchJob> &jobs,
+                   unsigned nworkers, const GpfBatchRun &run) {
+  if (jobs.empty())
+    return 0;
+  nworkers = GpfThreadPool::threadCount(nworkers);
+  if (nworkers > jobs.size())
+    nworkers = (unsigned) jobs.size();
+
+  GpfThreadPool pool(nworkers);
+  std::vector<std::string> outputs(jobs.size());
+  std::vector<std::future<std::string> > results;
+  results.reserve(jobs.size());
+  for (size_t i = 0; i < jobs.size(); i++) {
+    const GpfBatchJob *job = &jobs[i];
+    std::string *output = &outputs[i];
+    results.push_back(pool.submit([job,output,&run]() { return run(*job, *output); }));
+  }
+
+  size_t failed = 0;
+  for (size_t i = 0; i < jobs.size(); i++) {
+    std::string message = results[i].get();
+    if (!outputs[i].empty())
+      printf("%s\n", outputs[i].c_str());
+    if (!message.empty()) {
+      printf("%s:%d: %s\n", manifest, jobs[i].line, message.c_str());
+      failed++;
+    }
+    fflush(stdout);
+  }
+  return failed;
+}
@@ -0,0 +1,38 @@
+#ifndef gpfBatch_h
+#define gpfBatch_h
+
+// Batch manifests for the GPF tools.  A manifest names one run per line,
+// each line holding the arguments that run would be given on the command
+// line (e.g. "M2020_NE_Syrtis.gpf" for the exporter, or
+// "orig.gpf tfm.csv tfm.gpf" for the merge).  Blank lines and lines
+// starting with # are skipped.  The runs are done concurrently on a
+// worker pool inside one process.
+
+#include <stddef.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct GpfBatchJob {
+  int                      line;   // manifest line number, from 1
+  std::vector<std::string> args;
+};
+
+// Reads the manifest at path ("-" for standard input) into jobs.  Returns
+// false and sets error if it can not be read.
+bool gpfReadManifest(const char *path, std::vector<GpfBatchJob> &jobs,
+                     std::string &error);
+
+// Runs run(job, output) for every job on nworkers threads, at most as
+// many as there are jobs.  run returns an empty string on success,
+// otherwise the message for that job, which is printed prefixed with
+// "manifest:line: ".  Anything run leaves in output (e.g. the -stats
+// line) is printed as is.  Each job's lines are printed once every
+// earlier job has finished, so they come out in manifest order.  Returns
+// the number of jobs that failed.
+typedef std::function<std::string(const GpfBatchJob &, std::string &)> GpfBatchRun;
+
+size_t gpfRunBatch(const char *manifest, const std::vector<GpfBatchJob> &jobs,
+                   unsigned nworkers, const GpfBatchRun &run);
+
+#endif
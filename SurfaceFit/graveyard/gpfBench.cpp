@@ -0,0 +1,1063 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "gpfConvert.h"
+#include "gpfPointTable.h"
+#include "gpfReader.h"
+#include "gpfWriter.h"
+
+// number of records parsed and converted together, as in the tools
+#define BLOCKSIZE 65536
+
+extern char **environ;
+
+static void usage(const char *prog)
+{
+     printf ("\nrun %s as follows:\n",prog);
+     printf ("   %s [-points N] [-seed S] [-control F] [-inactive F] [-repeat R]\n",prog);
+     printf ("      [-threads N] [-pipeline] [-bindir dir] [-workdir dir] [-keep]\n");
+     printf ("   %s -generate outGPF [-points N] [-seed S] [-control F] [-inactive F]\n",prog);
+     printf ("   %s -check testdataDir [-points N] [-repeat R] [-baseline file [-record]]\n",prog);
+     printf ("      [-tolerance F] [-bindir dir] [-workdir dir] [-keep]\n");
+     printf ("\nwhere:\n");
+     printf ("  -points N = number of points in the synthetic gpf (default 1000000)\n");
+     printf ("  -seed S = random seed, the same seed always gives the same gpf (default 1)\n");
+     printf ("  -control F = fraction of points that are ground control (default 0.08)\n");
+     printf ("  -inactive F = fraction of tie points that are off (default 0.05)\n");
+     printf ("  -repeat R = run every measurement R times and report the fastest (default 3)\n");
+     printf ("  -threads N = passed on to gpfTies2LatLonHeightCSV_360sys (default 1)\n");
+     printf ("  -pipeline = passed on to both tools, to time them end to end pipelined\n");
+     printf ("  -bindir dir = where the two tools are (default: the directory of %s)\n",prog);
+     printf ("  -workdir dir = where the synthetic files are written (default .)\n");
+     printf ("  -keep = leave the synthetic files in workdir\n\n");
+     printf ("  -generate outGPF = only write the synthetic gpf to outGPF\n\n");
+     printf ("  -check testdataDir = regression check of the two tools on the SurfaceFit\n");
+     printf ("           testdata instead (see below), exiting with status 1 if any of it\n");
+     printf ("           fails.  -points N is then the size of the scaled up copy timed\n");
+     printf ("  -baseline file = points/s of each timed run of -check, compared with the\n");
+     printf ("           file, or written to it if there is none yet or with -record\n");
+     printf ("  -tolerance F = -check fails a run more than F slower than its baseline\n");
+     printf ("           (default 0.25, i.e. below 75%% of the baseline points/s)\n\n");
+     printf ("  This program generates a synthetic Socet Set ground point file, times\n");
+     printf ("  gpfTies2LatLonHeightCSV_360sys and mergeTransformedGPFties on it end to end,\n");
+     printf ("  then times the parse, convert, format and write phases of each in process,\n");
+     printf ("  and reports the throughput of each in points/s and MB/s of input.\n\n");
+     printf ("  With -check it runs the tools on copies of M2020_NE_Syrtis.gpf and the\n");
+     printf ("  pc_align output of its tie points from testdataDir, and checks that\n");
+     printf ("    - the tie point IDs are those of M2020_NE_Syrtis.tiePointIds.txt, and\n");
+     printf ("      the CSV and the merged gpf have the numbers of M2020_NE_Syrtis.csv\n");
+     printf ("      and tfm_M2020_NE_Syrtis.gpf (written by the python tools, so to the\n");
+     printf ("      14 decimals the C++ tools print)\n");
+     printf ("    - every fast path (-threads, -pipeline, -direct, -join, ...) gives the\n");
+     printf ("      same bytes as a plain run\n");
+     printf ("    - on a copy scaled up to -points N, the CSV is the plain one repeated,\n");
+     printf ("      the fast paths still give the same bytes, and no timed run is\n");
+     printf ("      slower than its -baseline allows\n");
+     exit(1);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// synthetic gpf
+/////////////////////////////////////////////////////////////////////////////
+
+// splitmix64, so a seed gives the same file on every platform
+struct BenchRandom {
+  uint64_t state;
+
+  explicit BenchRandom(uint64_t seed) : state(seed) {}
+
+  uint64_t next() {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+  // uniform in [lo, hi)
+  double uniform(double lo, double hi) {
+    return lo + (hi - lo) * ((next() >> 11) * (1.0 / 9007199254740992.0));
+  }
+};
+
+struct BenchOptions {
+  long long   points;
+  uint64_t    seed;
+  double      control;
+  double      inactive;
+  int         repeat;
+  int         threads;
+  bool        pipelined;
+  std::string bindir;
+  std::string workdir;
+  bool        keep;
+  std::string checkDir;
+  std::string baseline;
+  double      tolerance;
+  bool        record;
+
+  BenchOptions() : points(1000000), seed(1), control(0.08), inactive(0.05),
+                   repeat(3), threads(1), pipelined(false), workdir("."),
+                   keep(false), tolerance(0.25), record(false) {}
+};
+
+//-----------------------------------------------------------------------
+// Writes a gpf laid out like the Socet Set exports in testdata: point IDs
+// of varying length, a mix of active and inactive tie points and XYZ, XY
+// and Z control, and coordinates spread over the whole body
+//-----------------------------------------------------------------------
+static bool generateGpf(const char *path, const BenchOptions &opt)
+{
+  GpfWriter gpf;
+  if (!gpf.open(path))
+    return false;
+
+  gpf.write("GROUND POINT FILE\n");
+  gpf.putInt((int) opt.points);
+  gpf.write("\npoint_id,stat,known,lat_Y_North,long_X_East,ht,sig(3),res(3)\n");
+
+  static const char *prefixes[] = { "", "P", "tie_", "ESP_012345_1965_" };
+  BenchRandom rng(opt.seed);
+  for (long long i = 0; i < opt.points; i++) {
+    int stat = 1;
+    int known = 0;
+    double r = rng.uniform(0.0, 1.0);
+    if (r < opt.control) {
+      // mostly XYZ control, some XY or Z only, a few of them off
+      double k = rng.uniform(0.0, 1.0);
+      known = k < 0.8 ? 1 : (k < 0.9 ? 2 : 3);
+      stat = rng.uniform(0.0, 1.0) < 0.1 ? 0 : 1;
+    }
+    else if (rng.uniform(0.0, 1.0) < opt.inactive)
+      stat = 0;
+
+    gpf.write(prefixes[rng.next() & 3]);
+    gpf.putInt((int) (i % 2000000000));
+    gpf.put(' ');
+    gpf.putInt(stat);
+    gpf.put(' ');
+    gpf.putInt(known);
+    gpf.put('\n');
+
+    gpf.putFixed(rng.uniform(-1.5, 1.5), 14);
+    gpf.write("         ");
+    gpf.putFixed(rng.uniform(-M_PI, M_PI), 14);
+    gpf.write("         ");
+    gpf.putFixed(rng.uniform(-8200.0, 21000.0), 14);
+    gpf.write("    \n");
+
+    for (int s = 0; s < 3; s++) {
+      gpf.putFixed(known ? rng.uniform(0.0, 10.0) : 0.0, 6);
+      gpf.put(s < 2 ? ' ' : '\n');
+    }
+    for (int s = 0; s < 3; s++) {
+      gpf.putFixed(rng.uniform(-200.0, 200.0), 6);
+      gpf.put(s < 2 ? ' ' : '\n');
+    }
+    gpf.put('\n');
+  }
+  return gpf.close();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// timing
+/////////////////////////////////////////////////////////////////////////////
+
+static double now()
+{
+  return std::chrono::duration<double>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double fileSize(const std::string &path)
+{
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 ? (double) st.st_size : 0.0;
+}
+
+static bool sameContents(const std::string &a, const std::string &b)
+{
+  GpfMappedFile fa, fb;
+  if (!fa.open(a.c_str()) || !fb.open(b.c_str()))
+    return false;
+  return fa.size() == fb.size() && memcmp(fa.data(), fb.data(), fa.size()) == 0;
+}
+
+// Runs a tool with its output discarded, returns its wall time in seconds
+// or -1 if it could not be run or failed
+static double runTool(const std::vector<std::string> &args)
+{
+  std::vector<char *> argv;
+  for (const std::string &a : args)
+    argv.push_back(const_cast<char *>(a.c_str()));
+  argv.push_back(NULL);
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+
+  double start = now();
+  pid_t pid;
+  int status = -1;
+  bool ok = posix_spawn(&pid, argv[0], &actions, NULL, argv.data(), environ) == 0 &&
+            waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+            WEXITSTATUS(status) == 0;
+  double elapsed = now() - start;
+  posix_spawn_file_actions_destroy(&actions);
+  return ok ? elapsed : -1.0;
+}
+
+enum { PARSE, CONVERT, FORMAT, WRITE, NPHASES };
+static const char *phaseNames[NPHASES] = { "parse", "convert", "format", "write" };
+
+struct PhaseTimes {
+  double t[NPHASES];
+  PhaseTimes() { for (int p = 0; p < NPHASES; p++) t[p] = 0.0; }
+};
+
+// Adds the time since mark to phase p and moves mark on
+static void lap(PhaseTimes &times, int p, double &mark)
+{
+  double t = now();
+  times.t[p] += t - mark;
+  mark = t;
+}
+
+//-----------------------------------------------------------------------
+// In process export, the same work as gpfTies2LatLonHeightCSV_360sys
+// with each phase timed a block at a time
+//-----------------------------------------------------------------------
+static bool benchExport(const std::string &gpfFile, const std::string &csvFile,
+                        const std::string &ptsFile, PhaseTimes &times)
+{
+  double mark = now();
+  GpfReader gpf;
+  GpfWriter csv, pts, csvBlock(8 << 20), ptsBlock(1 << 20);
+  if (!gpf.open(gpfFile.c_str()) || !csv.open(csvFile.c_str()) || !pts.open(ptsFile.c_str()))
+    return false;
+  csvBlock.openMemory();
+  ptsBlock.openMemory();
+
+  std::vector<GpfPointRecord> block(BLOCKSIZE);
+  std::vector<const GpfPointRecord *> ties;
+  std::vector<double> radLat, radLon, ddLat(BLOCKSIZE), ddLon360(BLOCKSIZE);
+  lap(times, PARSE, mark);
+
+  size_t nrec;
+  while ((nrec = gpf.nextBlock(block.data(), BLOCKSIZE)) > 0) {
+    ties.clear();
+    radLat.clear();
+    radLon.clear();
+    for (size_t i = 0; i < nrec; i++) {
+      if (block[i].statValue() == 1 && block[i].knownValue() == 0) {
+        ties.push_back(&block[i]);
+        radLat.push_back(gpfToDouble(block[i].lat));
+        radLon.push_back(gpfToDouble(block[i].lon));
+      }
+    }
+    lap(times, PARSE, mark);
+
+    size_t nties = ties.size();
+    gpfRadiansToDegrees360(nties, radLat.data(), radLon.data(), ddLat.data(), ddLon360.data());
+    lap(times, CONVERT, mark);
+
+    csvBlock.clearBuffer();
+    ptsBlock.clearBuffer();
+    for (size_t t = 0; t < nties; t++) {
+      csvBlock.putFixed(ddLat[t], 14);
+      csvBlock.put(',');
+      csvBlock.putFixed(ddLon360[t], 14);
+      csvBlock.put(',');
+      csvBlock.write(ties[t]->height);
+      csvBlock.put('\n');
+      ptsBlock.write(ties[t]->pointID);
+      ptsBlock.put('\n');
+    }
+    lap(times, FORMAT, mark);
+
+    csv.write(csvBlock.buffer());
+    pts.write(ptsBlock.buffer());
+    lap(times, WRITE, mark);
+  }
+
+  bool ok = gpf.error().empty() && csv.close() && pts.close();
+  lap(times, WRITE, mark);
+  return ok;
+}
+
+//-----------------------------------------------------------------------
+// In process merge, the same work as mergeTransformedGPFties origGPF
+// tfmCSV tfmGPF with each phase timed a block at a time
+//-----------------------------------------------------------------------
+static bool benchMerge(const std::string &gpfFile, const std::string &tfmCSVFile,
+                       const std::string &tfmGPFFile, PhaseTimes &times)
+{
+  double mark = now();
+  GpfReader gpf;
+  GpfLineReader tfmcsv;
+  GpfWriter tfmgpf, gpfBlock(16 << 20);
+  if (!gpf.open(gpfFile.c_str()) || !tfmcsv.open(tfmCSVFile.c_str()) ||
+      !tfmgpf.open(tfmGPFFile.c_str()))
+    return false;
+  gpfBlock.openMemory();
+  tfmgpf.write(gpf.header());
+
+  std::vector<GpfPointRecord> block(BLOCKSIZE);
+  std::vector<double> ddLat, ddLon360, radLat(BLOCKSIZE), radLon180(BLOCKSIZE);
+  std::vector<std::string_view> heights;
+  std::string heightText;
+  lap(times, PARSE, mark);
+
+  size_t nrec;
+  while ((nrec = gpf.nextBlock(block.data(), BLOCKSIZE)) > 0) {
+    ddLat.clear();
+    ddLon360.clear();
+    heights.clear();
+    heightText.clear();
+    std::vector<size_t> heightEnd;
+    for (size_t i = 0; i < nrec; i++) {
+      if (block[i].statValue() != 1 || block[i].knownValue() != 0)
+        continue;
+      std::string_view line;
+      if (!tfmcsv.next(line))
+        return false;
+      ddLat.push_back(gpfToDouble(gpfNextField(line)));
+      ddLon360.push_back(gpfToDouble(gpfNextField(line)));
+      heightText.append(gpfNextField(line));
+      heightEnd.push_back(heightText.size());
+    }
+    lap(times, PARSE, mark);
+
+    gpfDegrees360ToRadians(ddLat.size(), ddLat.data(), ddLon360.data(),
+                           radLat.data(), radLon180.data());
+    lap(times, CONVERT, mark);
+
+    gpfBlock.clearBuffer();
+    size_t t = 0;
+    for (size_t i = 0; i < nrec; i++) {
+      const GpfPointRecord &rec = block[i];
+      int stat = rec.statValue();
+      int known = rec.knownValue();
+      if (known > 0) {
+        gpfBlock.write(rec.pointID);
+        gpfBlock.put(' ');
+        gpfBlock.putInt(stat);
+        gpfBlock.write(" 0\n");
+        gpfBlock.write(rec.body);
+      }
+      if (stat == 0 && known == 0)
+        gpfBlock.write(rec.raw);
+      if (stat == 1 && known == 0) {
+        size_t begin = t ? heightEnd[t-1] : 0;
+        gpfBlock.write(rec.pointID);
+        gpfBlock.put(' ');
+        gpfBlock.putInt(stat);
+        gpfBlock.write(" 3\n");
+        gpfBlock.putFixed(radLat[t], 14);
+        gpfBlock.write("    ");
+        gpfBlock.putFixed(radLon180[t], 14);
+        gpfBlock.write("    ");
+        gpfBlock.write(std::string_view(heightText).substr(begin, heightEnd[t]-begin));
+        gpfBlock.write("\n1.0 1.0 1.0\n0.0 0.0 0.0\n\n");
+        t++;
+      }
+    }
+    lap(times, FORMAT, mark);
+
+    tfmgpf.write(gpfBlock.buffer());
+    lap(times, WRITE, mark);
+  }
+
+  bool ok = gpf.error().empty() && !tfmcsv.failed() && tfmgpf.close();
+  lap(times, WRITE, mark);
+  return ok;
+}
+
+// benchMerge with the arguments in the order benchTool passes them
+static bool benchMergeTool(const std::string &gpfFile, const std::string &tfmGPFFile,
+                           const std::string &tfmCSVFile, PhaseTimes &times)
+{
+  return benchMerge(gpfFile, tfmCSVFile, tfmGPFFile, times);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// report
+/////////////////////////////////////////////////////////////////////////////
+
+static void report(const char *what, double seconds, double points, double bytes)
+{
+  if (seconds < 0) {
+    printf ("  %-12s failed\n", what);
+    return;
+  }
+  if (seconds <= 0)
+    seconds = 1e-9;
+  printf ("  %-12s %10.4f s  %10.3f Mpoints/s  %9.1f MB/s\n",
+          what, seconds, points / seconds / 1e6, bytes / seconds / 1e6);
+}
+
+// Keeps the fastest of the runs, tool and phase by phase
+static void keepBest(double &best, double t)
+{
+  if (t >= 0 && (best < 0 || t < best))
+    best = t;
+}
+
+// Times one tool end to end and in process, and prints the results.
+// inProcess(in, out1, out2) is the in process version of the tool, and
+// out1 should come out the same as the tool's toolOut.
+static bool benchTool(const char *name, const BenchOptions &opt,
+                      const std::vector<std::string> &toolArgs,
+                      bool (*inProcess)(const std::string &, const std::string &,
+                                        const std::string &, PhaseTimes &),
+                      const std::string &in, const std::string &out1,
+                      const std::string &out2, const std::string &toolOut,
+                      double points, double bytes)
+{
+  double endToEnd = -1.0;
+  PhaseTimes best;
+  for (int p = 0; p < NPHASES; p++)
+    best.t[p] = -1.0;
+
+  bool ok = true;
+  for (int r = 0; r < opt.repeat; r++) {
+    keepBest(endToEnd, runTool(toolArgs));
+    PhaseTimes times;
+    if (!inProcess(in, out1, out2, times))
+      ok = false;
+    for (int p = 0; p < NPHASES; p++)
+      keepBest(best.t[p], times.t[p]);
+  }
+
+  printf ("\n%s  %.0f points, %.1f MB in\n", name, points, bytes / 1e6);
+  report("end to end", endToEnd, points, bytes);
+  double total = 0.0;
+  for (int p = 0; p < NPHASES; p++) {
+    report(phaseNames[p], best.t[p], points, bytes);
+    total += best.t[p];
+  }
+  report("phase total", ok ? total : -1.0, points, bytes);
+
+  if (endToEnd < 0)
+    printf ("  %s failed, or was not found in the -bindir\n", toolArgs[0].c_str());
+  else if (ok && !sameContents(out1, toolOut))
+    printf ("  warning: the in process output differs from %s\n", toolArgs[0].c_str());
+  return ok && endToEnd >= 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// regression check
+/////////////////////////////////////////////////////////////////////////////
+
+// The testdata inputs, and the outputs of the python tools they are
+// checked against
+static const char *checkGpf = "M2020_NE_Syrtis.gpf";
+static const char *checkCSV = "M2020_NE_Syrtis.csv";
+static const char *checkIds = "M2020_NE_Syrtis.tiePointIds.txt";
+static const char *checkTfmCSV = "NE_Syrtis_100m_aate_ascii_pcAligned_gpfTies-trans_reference.csv";
+static const char *checkTfmGPF = "tfm_M2020_NE_Syrtis.gpf";
+
+// The tools print 14 decimals where python prints the shortest repr, so
+// numbers from the testdata match to about this, relative to the larger
+// of 1 and the number
+static const double CheckTolerance = 1e-13;
+
+// Empty if a and b hold the same bytes, else where they first differ
+static std::string compareBytes(const std::string &a, const std::string &b)
+{
+  GpfMappedFile fa, fb;
+  if (!fa.open(a.c_str()))
+    return "can not read " + a;
+  if (!fb.open(b.c_str()))
+    return "can not read " + b;
+  size_t n = std::min(fa.size(), fb.size());
+  size_t i = 0;
+  while (i < n && fa.data()[i] == fb.data()[i])
+    i++;
+  if (i == n && fa.size() == fb.size())
+    return std::string();
+  return a + " and " + b + " differ at byte " + std::to_string(i);
+}
+
+static bool parseNumber(std::string_view token, double &value)
+{
+  const char *end = token.data() + token.size();
+  std::from_chars_result r = std::from_chars(token.data(), end, value);
+  return r.ec == std::errc() && r.ptr == end;
+}
+
+// Empty if a and b have the same fields line by line, the numbers among
+// them equal to CheckTolerance, else the first line where they differ
+static std::string compareNumbers(const std::string &a, const std::string &b)
+{
+  GpfMappedFile fa, fb;
+  if (!fa.open(a.c_str()))
+    return "can not read " + a;
+  if (!fb.open(b.c_str()))
+    return "can not read " + b;
+  const char *ca = fa.data(), *ea = ca + fa.size();
+  const char *cb = fb.data(), *eb = cb + fb.size();
+  for (long line = 1; ca < ea || cb < eb; line++) {
+    std::string_view la = gpfNextLine(ca, ea);
+    std::string_view lb = gpfNextLine(cb, eb);
+    for (;;) {
+      std::string_view ta = gpfNextField(la);
+      std::string_view tb = gpfNextField(lb);
+      if (ta.empty() && tb.empty())
+        break;
+      double x, y;
+      if (ta == tb)
+        continue;
+      if (!parseNumber(ta, x) || !parseNumber(tb, y) ||
+          fabs(x - y) > CheckTolerance * std::max(1.0, fabs(y)))
+        return a + " and " + b + " differ on line " + std::to_string(line) + ": " +
+               std::string(ta) + " and " + std::string(tb);
+    }
+  }
+  return std::string();
+}
+
+// Copies src to dst, leaving out the lines starting with '#' if noComments
+static bool copyFile(const std::string &src, const std::string &dst, bool noComments)
+{
+  GpfLineReader in;
+  GpfWriter out;
+  if (!in.open(src.c_str()) || !out.open(dst.c_str()))
+    return false;
+  std::string_view line;
+  while (in.next(line)) {
+    if (!(noComments && !line.empty() && line[0] == '#'))
+      out.write(line);
+  }
+  return !in.failed() && out.close();
+}
+
+//-----------------------------------------------------------------------
+// Writes copies of gpfFile one after the other as one gpf, the point IDs
+// of copy k suffixed with _k so they stay unique
+//-----------------------------------------------------------------------
+static bool scaleGpf(const std::string &gpfFile, int copies, const std::string &scaledGPF)
+{
+  GpfReader gpf;
+  GpfWriter out;
+  if (!gpf.open(gpfFile.c_str()) || !out.open(scaledGPF.c_str()))
+    return false;
+
+  std::vector<GpfPointRecord> records;
+  GpfPointRecord rec;
+  while (gpf.next(rec))
+    records.push_back(rec);
+  if (!gpf.error().empty() || records.empty())
+    return false;
+
+  std::string_view header = gpf.header();
+  const char *cur = header.data();
+  const char *end = cur + header.size();
+  out.write(gpfNextLine(cur, end));
+  gpfNextLine(cur, end);
+  out.putInt((int) records.size() * copies);
+  out.put('\n');
+  out.write(gpfNextLine(cur, end));
+  for (int k = 0; k < copies; k++) {
+    for (const GpfPointRecord &r : records) {
+      size_t idEnd = (r.pointID.data() - r.raw.data()) + r.pointID.size();
+      out.write(r.raw.substr(0, idEnd));
+      out.put('_');
+      out.putInt(k);
+      out.write(r.raw.substr(idEnd));
+    }
+  }
+  return out.close();
+}
+
+// Writes copies of file one after the other, e.g. a tfmCSV of the gpf
+// scaleGpf() copied, which is then one of the scaled gpf
+static bool repeatFile(const std::string &file, int copies, const std::string &repeated)
+{
+  GpfMappedFile in;
+  GpfWriter out;
+  if (!in.open(file.c_str()) || !out.open(repeated.c_str()))
+    return false;
+  for (int k = 0; k < copies; k++)
+    out.write(std::string_view(in.data(), in.size()));
+  return out.close();
+}
+
+// The points/s of each timed run, from or for a -baseline file
+struct CheckTiming {
+  std::string name;
+  double      pointsPerSecond;
+};
+
+// Reads a -baseline file, "points N" then "name pointsPerSecond" lines.
+// Returns false if there is none.
+static bool readBaseline(const std::string &path, long long &points,
+                         std::vector<CheckTiming> &timings)
+{
+  GpfLineReader in;
+  if (!in.open(path.c_str()))
+    return false;
+  std::string_view line;
+  while (in.next(line)) {
+    std::string_view name = gpfNextToken(line);
+    std::string_view value = gpfNextToken(line);
+    if (name.empty() || name[0] == '#')
+      continue;
+    if (name == "points")
+      points = atoll(std::string(value).c_str());
+    else
+      timings.push_back(CheckTiming{std::string(name), gpfToDouble(value)});
+  }
+  return !in.failed();
+}
+
+static bool writeBaseline(const std::string &path, long long points,
+                          const std::vector<CheckTiming> &timings)
+{
+  GpfWriter out;
+  if (!out.open(path.c_str()))
+    return false;
+  out.write("# gpfBench -check baseline, points/s of each timed run\npoints ");
+  out.write(std::to_string(points));
+  out.put('\n');
+  for (const CheckTiming &t : timings) {
+    out.write(t.name);
+    out.put(' ');
+    out.putFixed(t.pointsPerSecond, 0);
+    out.put('\n');
+  }
+  return out.close();
+}
+
+// Prints the outcome of one check, counting it if it failed
+static void expect(const std::string &what, const std::string &error, int &failures)
+{
+  if (error.empty())
+    printf ("  ok    %s\n", what.c_str());
+  else {
+    printf ("  FAIL  %s: %s\n", what.c_str(), error.c_str());
+    failures++;
+  }
+}
+
+// Runs a tool for a check, its failure to run being the check's
+static std::string runChecked(const std::vector<std::string> &args)
+{
+  if (runTool(args) < 0)
+    return args[0] + " failed, or was not found in the -bindir";
+  return std::string();
+}
+
+// The tool with the options in between its name and the trailing args
+static std::vector<std::string> toolArgs(const std::string &tool,
+                                         const std::vector<std::string> &options,
+                                         const std::vector<std::string> &args)
+{
+  std::vector<std::string> all(1, tool);
+  all.insert(all.end(), options.begin(), options.end());
+  all.insert(all.end(), args.begin(), args.end());
+  return all;
+}
+
+static std::string joinOptions(const std::vector<std::string> &options)
+{
+  std::string s;
+  // file names without their directory, to keep the lines short
+  for (const std::string &o : options)
+    s += (s.empty() ? "" : " ") + o.substr(o.rfind('/') + 1);
+  return s;
+}
+
+// The fast paths of each tool that must not change a byte of its output
+static const std::vector<std::vector<std::string> > exportVariants = {
+  { "-threads", "0" }, { "-threads", "3" }, { "-pipeline" },
+  { "-threads", "0", "-pipeline" }, { "-direct" }, { "-fadvise" },
+  { "-index", "-errors" } };
+
+static std::vector<std::vector<std::string> > mergeVariants(const std::string &ids)
+{
+  return { { "-pipeline" }, { "-direct" }, { "-fadvise" }, { "-join", ids },
+           { "-join", ids, "-pipeline" } };
+}
+
+//-----------------------------------------------------------------------
+// Runs the exporter on gpfFile (core.gpf) plain and with each fast path,
+// checking the fast paths give the same CSV and ID list.  The plain
+// outputs are left in core.plain.csv and core.plain.tiePointIds.txt.
+//-----------------------------------------------------------------------
+static void checkExport(const BenchOptions &opt, const std::string &core, const char *what,
+                        std::vector<std::string> &files, int &failures)
+{
+  std::string tool = opt.bindir + "/gpfTies2LatLonHeightCSV_360sys";
+  std::string plainCSV = core + ".plain.csv";
+  std::string plainIds = core + ".plain.tiePointIds.txt";
+  std::string csv = core + ".csv";
+  std::string ids = core + ".tiePointIds.txt";
+  files.insert(files.end(), { plainCSV, plainIds, csv, ids, core + ".gpfidx",
+                              core + ".errors.csv" });
+
+  std::string error = runChecked(toolArgs(tool, {}, { core + ".gpf" }));
+  if (error.empty() && (rename(csv.c_str(), plainCSV.c_str()) != 0 ||
+                        rename(ids.c_str(), plainIds.c_str()) != 0))
+    error = "no output from " + tool;
+  expect(std::string("export ") + what, error, failures);
+  if (!error.empty())
+    return;
+
+  for (const std::vector<std::string> &options : exportVariants) {
+    error = runChecked(toolArgs(tool, options, { core + ".gpf" }));
+    if (error.empty())
+      error = compareBytes(csv, plainCSV);
+    if (error.empty())
+      error = compareBytes(ids, plainIds);
+    expect(std::string("export ") + what + " " + joinOptions(options), error, failures);
+  }
+}
+
+// The same for the merge of tfmCSV into core.gpf, the plain output left in
+// core.plain_tfm.gpf
+static void checkMerge(const BenchOptions &opt, const std::string &core,
+                       const std::string &tfmCSV, const char *what,
+                       std::vector<std::string> &files, int &failures)
+{
+  std::string tool = opt.bindir + "/mergeTransformedGPFties";
+  std::string plain = core + ".plain_tfm.gpf";
+  std::string tfm = core + "_tfm.gpf";
+  files.insert(files.end(), { plain, tfm });
+
+  std::string error = runChecked(toolArgs(tool, {}, { core + ".gpf", tfmCSV, plain }));
+  expect(std::string("merge ") + what, error, failures);
+  if (!error.empty())
+    return;
+
+  for (const std::vector<std::string> &options : mergeVariants(core + ".plain.tiePointIds.txt")) {
+    error = runChecked(toolArgs(tool, options, { core + ".gpf", tfmCSV, tfm }));
+    if (error.empty())
+      error = compareBytes(tfm, plain);
+    expect(std::string("merge ") + what + " " + joinOptions(options), error, failures);
+  }
+}
+
+// The point table (gpfPointTable.h) on core.gpf: save() gives back the
+// gpf, and saveCsv() of the active ties the plain export, after a reload
+// of the saved copy
+static void checkTable(const std::string &core, const char *what,
+                       std::vector<std::string> &files, int &failures)
+{
+  std::string saved = core + ".table.gpf";
+  std::string csv = core + ".table.csv";
+  std::string ids = core + ".table.tiePointIds.txt";
+  files.insert(files.end(), { saved, csv, ids });
+
+  GpfPointTable table;
+  std::string error;
+  if (!table.load((core + ".gpf").c_str()) || !table.save(saved.c_str()))
+    error = table.error();
+  if (error.empty())
+    error = compareBytes(saved, core + ".gpf");
+  expect(std::string("point table load, save ") + what, error, failures);
+
+  error.clear();
+  if (!table.load(saved.c_str()))
+    error = table.error();
+  else {
+    table.convert(GpfPointTable::Degrees360);
+    if (!table.saveCsv(csv.c_str(), ids.c_str(), table.activeTies()))
+      error = table.error();
+  }
+  if (error.empty())
+    error = compareBytes(csv, core + ".plain.csv");
+  if (error.empty())
+    error = compareBytes(ids, core + ".plain.tiePointIds.txt");
+  expect(std::string("point table saveCsv ") + what, error, failures);
+}
+
+// Times a tool, best of -repeat runs, in points/s
+static double timeTool(const BenchOptions &opt, const std::vector<std::string> &args,
+                       double points)
+{
+  double best = -1.0;
+  for (int r = 0; r < opt.repeat; r++)
+    keepBest(best, runTool(args));
+  return best < 0 ? -1.0 : points / std::max(best, 1e-9);
+}
+
+//-----------------------------------------------------------------------
+// -check: the tools on the testdata, their fast paths, and their speed on
+// a scaled up copy against the -baseline.  Returns false if any of it
+// failed.
+//-----------------------------------------------------------------------
+static bool runCheck(const BenchOptions &opt)
+{
+  int failures = 0;
+  std::vector<std::string> files;
+  std::string dir = opt.checkDir + "/";
+
+  // the tools write next to their input, so they run on copies
+  std::string core = opt.workdir + "/gpfCheck_M2020_NE_Syrtis";
+  std::string tfmCSV = core + "_pcAligned.csv";
+  files.insert(files.end(), { core + ".gpf", tfmCSV });
+  if (!copyFile(dir + checkGpf, core + ".gpf", false) ||
+      !copyFile(dir + checkTfmCSV, tfmCSV, true)) {
+    printf ("unable to copy the testdata from %s to %s\n", opt.checkDir.c_str(),
+            opt.workdir.c_str());
+    exit (1);
+  }
+
+  printf ("\ntestdata\n");
+  checkExport(opt, core, checkGpf, files, failures);
+  expect(std::string("ids match ") + checkIds,
+         compareBytes(core + ".plain.tiePointIds.txt", dir + checkIds), failures);
+  expect(std::string("csv matches ") + checkCSV,
+         compareNumbers(core + ".plain.csv", dir + checkCSV), failures);
+  checkTable(core, checkGpf, files, failures);
+  checkMerge(opt, core, tfmCSV, checkGpf, files, failures);
+  expect(std::string("merge matches ") + checkTfmGPF,
+         compareNumbers(core + ".plain_tfm.gpf", dir + checkTfmGPF), failures);
+
+  //------------------------------------------------
+  // the same on copies scaled up to about -points,
+  // then timed
+  //------------------------------------------------
+
+  GpfReader gpf;
+  if (!gpf.open((core + ".gpf").c_str()) || gpf.numPoints() < 1) {
+    printf ("unable to read %s\n", (core + ".gpf").c_str());
+    exit (1);
+  }
+  long long copies = (opt.points + gpf.numPoints() - 1) / gpf.numPoints();
+  if (copies * gpf.numPoints() > 2000000000LL)
+    copies = 2000000000LL / gpf.numPoints();
+  double points = (double) (copies * gpf.numPoints());
+  gpf.close();
+
+  std::string scaled = opt.workdir + "/gpfCheck_scaled";
+  std::string scaledCSV = scaled + "_pcAligned.csv";
+  std::string repeated = scaled + ".expected.csv";
+  files.insert(files.end(), { scaled + ".gpf", scaledCSV, repeated });
+  if (!scaleGpf(core + ".gpf", (int) copies, scaled + ".gpf") ||
+      !repeatFile(tfmCSV, (int) copies, scaledCSV) ||
+      !repeatFile(core + ".plain.csv", (int) copies, repeated)) {
+    printf ("error writing the scaled testdata to %s\n", opt.workdir.c_str());
+    exit (1);
+  }
+
+  printf ("\n%lld copies, %.0f points, %.1f MB\n", copies, points,
+          fileSize(scaled + ".gpf") / 1e6);
+  checkExport(opt, scaled, "scaled", files, failures);
+  expect("scaled csv is the testdata csv repeated",
+         compareBytes(scaled + ".plain.csv", repeated), failures);
+  checkMerge(opt, scaled, scaledCSV, "scaled", files, failures);
+
+  std::string exportTool = opt.bindir + "/gpfTies2LatLonHeightCSV_360sys";
+  std::string mergeTool = opt.bindir + "/mergeTransformedGPFties";
+  std::vector<CheckTiming> timings = {
+    { "export", timeTool(opt, toolArgs(exportTool, {}, { scaled + ".gpf" }), points) },
+    { "export_threads",
+      timeTool(opt, toolArgs(exportTool, { "-threads", "0" }, { scaled + ".gpf" }), points) },
+    { "merge", timeTool(opt, toolArgs(mergeTool, {},
+                                      { scaled + ".gpf", scaledCSV, scaled + "_tfm.gpf" }),
+                        points) },
+    { "merge_join",
+      timeTool(opt, toolArgs(mergeTool, { "-join", scaled + ".plain.tiePointIds.txt" },
+                             { scaled + ".gpf", scaledCSV, scaled + "_tfm.gpf" }),
+               points) } };
+
+  //------------------------------------------------
+  // throughput against the baseline
+  //------------------------------------------------
+
+  long long baselinePoints = 0;
+  std::vector<CheckTiming> baseline;
+  bool haveBaseline = !opt.baseline.empty() && !opt.record &&
+                      readBaseline(opt.baseline, baselinePoints, baseline);
+  if (haveBaseline && baselinePoints != (long long) points) {
+    printf ("  FAIL  %s was recorded on %lld points, not %.0f; give the -points it was\n"
+            "        recorded with, or -record a new one\n",
+            opt.baseline.c_str(), baselinePoints, points);
+    failures++;
+    haveBaseline = false;
+  }
+
+  printf ("\nthroughput\n");
+  for (const CheckTiming &t : timings) {
+    if (t.pointsPerSecond < 0) {
+      printf ("  FAIL  %-16s failed\n", t.name.c_str());
+      failures++;
+      continue;
+    }
+    const CheckTiming *base = NULL;
+    for (const CheckTiming &b : baseline) {
+      if (haveBaseline && b.name == t.name)
+        base = &b;
+    }
+    if (!base) {
+      printf ("  %-22s %10.3f Mpoints/s\n", t.name.c_str(), t.pointsPerSecond / 1e6);
+      continue;
+    }
+    double change = t.pointsPerSecond / base->pointsPerSecond - 1.0;
+    bool slow = t.pointsPerSecond < (1.0 - opt.tolerance) * base->pointsPerSecond;
+    printf ("  %-5s %-16s %10.3f Mpoints/s, baseline %.3f (%+.0f%%)\n",
+            slow ? "FAIL" : "ok", t.name.c_str(), t.pointsPerSecond / 1e6,
+            base->pointsPerSecond / 1e6, change * 100.0);
+    if (slow)
+      failures++;
+  }
+
+  if (!opt.baseline.empty() && !haveBaseline && failures == 0) {
+    if (!writeBaseline(opt.baseline, (long long) points, timings)) {
+      printf ("error writing baseline file: %s\n", opt.baseline.c_str());
+      exit (1);
+    }
+    printf ("  recorded the baseline in %s\n", opt.baseline.c_str());
+  }
+
+  if (!opt.keep) {
+    for (const std::string &f : files)
+      unlink(f.c_str());
+  }
+
+  if (failures)
+    printf ("\n%d checks failed\n", failures);
+  else
+    printf ("\nall checks passed\n");
+  return failures == 0;
+}
+
+int main(int argc, char *argv[])
+{
+
+  BenchOptions opt;
+  const char *generateFile = NULL;
+
+  // parse options, issue help if needed
+  //-----------------------------------------------------------
+  for (int argi = 1; argi < argc; argi++) {
+    if (strcmp(argv[argi],"-points") == 0 && argi+1 < argc)
+      opt.points = atoll(argv[++argi]);
+    else if (strcmp(argv[argi],"-seed") == 0 && argi+1 < argc)
+      opt.seed = strtoull(argv[++argi],NULL,10);
+    else if (strcmp(argv[argi],"-control") == 0 && argi+1 < argc)
+      opt.control = atof(argv[++argi]);
+    else if (strcmp(argv[argi],"-inactive") == 0 && argi+1 < argc)
+      opt.inactive = atof(argv[++argi]);
+    else if (strcmp(argv[argi],"-repeat") == 0 && argi+1 < argc)
+      opt.repeat = atoi(argv[++argi]);
+    else if (strcmp(argv[argi],"-threads") == 0 && argi+1 < argc)
+      opt.threads = atoi(argv[++argi]);
+    else if (strcmp(argv[argi],"-pipeline") == 0)
+      opt.pipelined = true;
+    else if (strcmp(argv[argi],"-bindir") == 0 && argi+1 < argc)
+      opt.bindir = argv[++argi];
+    else if (strcmp(argv[argi],"-workdir") == 0 && argi+1 < argc)
+      opt.workdir = argv[++argi];
+    else if (strcmp(argv[argi],"-keep") == 0)
+      opt.keep = true;
+    else if (strcmp(argv[argi],"-generate") == 0 && argi+1 < argc)
+      generateFile = argv[++argi];
+    else if (strcmp(argv[argi],"-check") == 0 && argi+1 < argc)
+      opt.checkDir = argv[++argi];
+    else if (strcmp(argv[argi],"-baseline") == 0 && argi+1 < argc)
+      opt.baseline = argv[++argi];
+    else if (strcmp(argv[argi],"-tolerance") == 0 && argi+1 < argc)
+      opt.tolerance = atof(argv[++argi]);
+    else if (strcmp(argv[argi],"-record") == 0)
+      opt.record = true;
+    else
+      usage(argv[0]);
+  }
+
+  // a gpf holds the point count as an int
+  if (opt.points < 1 || opt.points > 2000000000LL || opt.repeat < 1 || opt.threads < 0 ||
+      opt.tolerance < 0 || opt.tolerance >= 1 || (opt.record && opt.baseline.empty()) ||
+      (generateFile && !opt.checkDir.empty()))
+    usage(argv[0]);
+
+  if (generateFile) {
+    if (!generateGpf(generateFile,opt)) {
+      printf ("error writing synthetic gpf file: %s\n",generateFile);
+      exit (1);
+    }
+    return 0;
+  }
+
+  if (opt.bindir.empty()) {
+    const char *slash = strrchr(argv[0],'/');
+    opt.bindir = slash ? std::string(argv[0],slash-argv[0]) : std::string(".");
+  }
+
+  if (!opt.checkDir.empty())
+    return runCheck(opt) ? 0 : 1;
+
+  //------------------------------------------------
+  // generate the synthetic gpf
+  //------------------------------------------------
+
+  std::string core = opt.workdir + "/gpfBench_" + std::to_string(opt.points);
+  std::string gpfFile = core + ".gpf";
+  std::string csvFile = core + ".csv";
+  std::string ptsFile = core + ".tiePointIds.txt";
+  std::string tfmGPFFile = core + "_tfm.gpf";
+  std::string benchCSV = core + "_bench.csv";
+  std::string benchPts = core + "_bench.tiePointIds.txt";
+  std::string benchGPF = core + "_bench_tfm.gpf";
+
+  double start = now();
+  if (!generateGpf(gpfFile.c_str(),opt)) {
+    printf ("error writing synthetic gpf file: %s\n",gpfFile.c_str());
+    exit (1);
+  }
+  printf ("generated %s (%.1f MB) in %.2f s\n",gpfFile.c_str(),fileSize(gpfFile)/1e6,now()-start);
+
+  //------------------------------------------------
+  // export, then merge the exported csv back in
+  // (the merge does not care that the coordinates
+  // were not actually transformed)
+  //------------------------------------------------
+
+  double points = (double) opt.points;
+  std::vector<std::string> exportArgs;
+  exportArgs.push_back(opt.bindir + "/gpfTies2LatLonHeightCSV_360sys");
+  exportArgs.push_back("-threads");
+  exportArgs.push_back(std::to_string(opt.threads));
+  if (opt.pipelined)
+    exportArgs.push_back("-pipeline");
+  exportArgs.push_back(gpfFile);
+  bool ok = benchTool("gpfTies2LatLonHeightCSV_360sys",opt,exportArgs,benchExport,
+                      gpfFile,benchCSV,benchPts,csvFile,points,fileSize(gpfFile));
+
+  std::vector<std::string> mergeArgs;
+  mergeArgs.push_back(opt.bindir + "/mergeTransformedGPFties");
+  if (opt.pipelined)
+    mergeArgs.push_back("-pipeline");
+  mergeArgs.push_back(gpfFile);
+  mergeArgs.push_back(csvFile);
+  mergeArgs.push_back(tfmGPFFile);
+  ok = benchTool("mergeTransformedGPFties",opt,mergeArgs,benchMergeTool,
+                 gpfFile,benchGPF,csvFile,tfmGPFFile,points,
+                 fileSize(gpfFile)+fileSize(csvFile)) && ok;
+
+  if (!opt.keep) {
+    const std::string files[] = { gpfFile, csvFile, ptsFile, tfmGPFFile,
+                                  benchCSV, benchPts, benchGPF };
+    for (const std::string &f : files)
+      unlink(f.c_str());
+  }
+
+  return ok ? 0 : 1;
+
+} // end of program
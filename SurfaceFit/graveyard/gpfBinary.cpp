@@ -0,0 +1,203 @@
+#include "gpfBinary.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string.h>
+
+#include "gpfCompress.h"
+#include "gpfWriter.h"
+
+
+static uint64_t align8(uint64_t n) {
+  return (n + 7) & ~(uint64_t) 7;
+}
+
+
+// true if bytes [offset, offset + length) are inside a file of size bytes,
+// without the sum that a corrupt offset could wrap
+static bool inFile(uint64_t offset, uint64_t length, uint64_t size) {
+  return offset <= size && length <= size - offset;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// GpfBinaryWriter
+/////////////////////////////////////////////////////////////////////////////
+
+GpfBinaryWriter::GpfBinaryWriter(const GpfDatum &datum) : m_datum(datum) {
+  m_idOffset.push_back(0);
+}
+
+
+void GpfBinaryWriter::add(std::string_view pointID, double lat, double lon,
+                          double height) {
+  m_lat.push_back(lat);
+  m_lon.push_back(lon);
+  m_height.push_back(height);
+  m_idTable.append(pointID.data(), pointID.size());
+  m_idOffset.push_back(m_idTable.size());
+}
+
+
+void GpfBinaryWriter::append(const GpfBinaryWriter &other) {
+  m_lat.insert(m_lat.end(), other.m_lat.begin(), other.m_lat.end());
+  m_lon.insert(m_lon.end(), other.m_lon.begin(), other.m_lon.end());
+  m_height.insert(m_height.end(), other.m_height.begin(), other.m_height.end());
+  uint64_t base = m_idTable.size();
+  for (size_t i = 1; i < other.m_idOffset.size(); i++)
+    m_idOffset.push_back(base + other.m_idOffset[i]);
+  m_idTable += other.m_idTable;
+}
+
+
+bool GpfBinaryWriter::save(const char *path) const {
+  GpfWriter out;
+  if (!out.open(path))
+    return false;
+  save(out);
+  return out.close();
+}
+
+
+void GpfBinaryWriter::save(GpfWriter &out) const {
+  uint64_t count = m_lat.size();
+  uint64_t column = count * sizeof(double);
+
+  GpfBinaryHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, GPF_BINARY_MAGIC, sizeof(GPF_BINARY_MAGIC));
+  header.version = GPF_BINARY_VERSION;
+  header.headerSize = sizeof(header);
+  header.count = count;
+  header.semiMajor = m_datum.semiMajor;
+  header.semiMinor = m_datum.semiMinor;
+  header.latOffset = align8(sizeof(header));
+  header.lonOffset = header.latOffset + column;
+  header.heightOffset = header.lonOffset + column;
+  header.idOffsetOffset = header.heightOffset + column;
+  header.idTableOffset = header.idOffsetOffset + (count + 1) * sizeof(uint64_t);
+  header.idTableSize = m_idTable.size();
+
+  out.write(std::string_view((const char *) &header, sizeof(header)));
+  out.write(std::string(header.latOffset - sizeof(header), '\0'));
+  out.write(std::string_view((const char *) m_lat.data(), column));
+  out.write(std::string_view((const char *) m_lon.data(), column));
+  out.write(std::string_view((const char *) m_height.data(), column));
+  out.write(std::string_view((const char *) m_idOffset.data(),
+                             m_idOffset.size() * sizeof(uint64_t)));
+  out.write(m_idTable);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// GpfBinaryFile
+/////////////////////////////////////////////////////////////////////////////
+
+GpfBinaryFile::GpfBinaryFile()
+  : m_count(0), m_datum(GpfDatum::mars()), m_lat(NULL), m_lon(NULL),
+    m_height(NULL), m_idOffset(NULL), m_idTable(NULL) {
+}
+
+
+bool GpfBinaryFile::isBinary(const char *path) {
+  // only peek at regular files, reading a pipe here would eat its input
+  struct stat st;
+  if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+    return false;
+
+  char magic[sizeof(GPF_BINARY_MAGIC)];
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+  ssize_t n = read(fd, magic, sizeof(magic));
+
+  // a compressed file is peeked at through the decompressor
+  GpfCompression compression = gpfDetectCompression(magic, n > 0 ? (size_t) n : 0);
+  if (compression != GpfUncompressed) {
+    GpfDecompressStream stream;
+    std::string error;
+    size_t got = 0;
+    if (stream.open(compression, magic, (size_t) n, error)) {
+      char head[sizeof(magic)];
+      while (got < sizeof(head)) {
+        ssize_t m = stream.read(fd, head + got, sizeof(head) - got);
+        if (m <= 0)
+          break;
+        got += (size_t) m;
+      }
+      memcpy(magic, head, got);
+    }
+    n = (ssize_t) got;
+  }
+  ::close(fd);
+  return n == (ssize_t) sizeof(magic) &&
+         memcmp(magic, GPF_BINARY_MAGIC, sizeof(magic)) == 0;
+}
+
+
+bool GpfBinaryFile::open(const char *path) {
+  close();
+  if (!m_file.open(path))
+    return false;
+
+  GpfBinaryHeader header;
+  if (m_file.size() < sizeof(header)) {
+    m_error = "too short to be a binary tie point file";
+    return false;
+  }
+  memcpy(&header, m_file.data(), sizeof(header));
+  if (memcmp(header.magic, GPF_BINARY_MAGIC, sizeof(GPF_BINARY_MAGIC)) != 0) {
+    m_error = "not a binary tie point file";
+    return false;
+  }
+  if (header.version == __builtin_bswap32(GPF_BINARY_VERSION)) {
+    m_error = "binary tie point file was written on a host of the other byte order";
+    return false;
+  }
+  if (header.version != GPF_BINARY_VERSION) {
+    m_error = "unsupported binary tie point file version " +
+              std::to_string(header.version);
+    return false;
+  }
+
+  uint64_t column = header.count * sizeof(double);
+  uint64_t offsets = (header.count + 1) * sizeof(uint64_t);
+  uint64_t size = m_file.size();
+  if (header.count > size / sizeof(double) ||
+      header.latOffset % 8 || header.lonOffset % 8 ||
+      header.heightOffset % 8 || header.idOffsetOffset % 8 ||
+      !inFile(header.latOffset, column, size) || !inFile(header.lonOffset, column, size) ||
+      !inFile(header.heightOffset, column, size) ||
+      !inFile(header.idOffsetOffset, offsets, size) ||
+      !inFile(header.idTableOffset, header.idTableSize, size)) {
+    m_error = "binary tie point file is truncated or its header is corrupt";
+    return false;
+  }
+
+  const char *base = m_file.data();
+  m_count = header.count;
+  m_datum = GpfDatum{header.semiMajor, header.semiMinor};
+  m_lat = (const double *) (base + header.latOffset);
+  m_lon = (const double *) (base + header.lonOffset);
+  m_height = (const double *) (base + header.heightOffset);
+  m_idOffset = (const uint64_t *) (base + header.idOffsetOffset);
+  m_idTable = base + header.idTableOffset;
+
+  for (size_t i = 0; i < m_count; i++) {
+    if (m_idOffset[i] > m_idOffset[i+1] || m_idOffset[i+1] > header.idTableSize) {
+      m_error = "binary tie point file has a corrupt ID table";
+      return false;
+    }
+  }
+  return true;
+}
+
+
+void GpfBinaryFile::close() {
+  m_file.close();
+  m_error.clear();
+  m_count = 0;
+  m_lat = m_lon = m_height = NULL;
+  m_idOffset = NULL;
+  m_idTable = NULL;
+}
@@ -0,0 +1,118 @@
+#ifndef gpfBinary_h
+#define gpfBinary_h
+
+// Binary columnar tie point file (*.tiePoints.bin), the binary
+// counterpart of the lat,lon,height CSV plus .tiePointIds.txt pair.
+//
+// Layout, in the byte order of the host that wrote it (little-endian on
+// x86 and aarch64) and every section 8 byte aligned, so that a mapped
+// file can be used in place.  open() refuses a file written in the other
+// byte order.
+//
+//   GpfBinaryHeader
+//   double   lat[count]               degrees
+//   double   lon[count]               degrees, 0 to 360 domain
+//   double   height[count]            meters above the datum
+//   uint64_t idOffset[count + 1]      into the ID table
+//   char     idTable[]                point IDs, not terminated
+//
+// The columns hold exactly what the CSV holds, with the angle convention
+// of the CSVs handed to pc_align.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "gpfConvert.h"
+#include "gpfReader.h"
+
+#define GPF_BINARY_MAGIC   "GPFTIES"
+#define GPF_BINARY_VERSION 1
+
+struct GpfBinaryHeader {
+  char     magic[8];           // GPF_BINARY_MAGIC, NUL padded
+  uint32_t version;            // GPF_BINARY_VERSION
+  uint32_t headerSize;         // sizeof(GpfBinaryHeader)
+  uint64_t count;              // number of points
+  double   semiMajor;          // datum the heights are relative to
+  double   semiMinor;
+  uint64_t latOffset;          // byte offsets of the sections
+  uint64_t lonOffset;
+  uint64_t heightOffset;
+  uint64_t idOffsetOffset;
+  uint64_t idTableOffset;
+  uint64_t idTableSize;
+};
+
+//-----------------------------------------------------------------------
+// Collects points in memory and writes the file in one go, since the
+// number of points is not known until the export is done
+//-----------------------------------------------------------------------
+class GpfWriter;
+
+class GpfBinaryWriter {
+ public:
+  explicit GpfBinaryWriter(const GpfDatum &datum = GpfDatum::mars());
+
+  void add(std::string_view pointID, double lat, double lon, double height);
+
+  // Appends all the points of other, e.g. a part exported on another thread
+  void append(const GpfBinaryWriter &other);
+
+  size_t size() const { return m_lat.size(); }
+
+  bool save(const char *path) const;
+
+  // Writes the file to out, which the caller opened and closes
+  void save(GpfWriter &out) const;
+
+ private:
+  GpfDatum              m_datum;
+  std::vector<double>   m_lat, m_lon, m_height;
+  std::vector<uint64_t> m_idOffset;
+  std::string           m_idTable;
+};
+
+//-----------------------------------------------------------------------
+// Mapped, validated view of a binary tie point file
+//-----------------------------------------------------------------------
+class GpfBinaryFile {
+ public:
+  GpfBinaryFile();
+
+  bool open(const char *path);
+  void close();
+
+  // Empty unless open() found a problem with the file
+  const std::string &error() const { return m_error; }
+
+  size_t count() const { return m_count; }
+  size_t fileSize() const { return m_file.size(); }
+  GpfDatum datum() const { return m_datum; }
+  const double *lat() const { return m_lat; }
+  const double *lon() const { return m_lon; }
+  const double *height() const { return m_height; }
+
+  std::string_view pointID(size_t i) const {
+    return std::string_view(m_idTable + m_idOffset[i],
+                            m_idOffset[i+1] - m_idOffset[i]);
+  }
+
+  // true if the first bytes of path are a binary tie point header
+  static bool isBinary(const char *path);
+
+ private:
+  GpfMappedFile   m_file;
+  std::string     m_error;
+  size_t          m_count;
+  GpfDatum        m_datum;
+  const double   *m_lat;
+  const double   *m_lon;
+  const double   *m_height;
+  const uint64_t *m_idOffset;
+  const char     *m_idTable;
+};
+
+#endif
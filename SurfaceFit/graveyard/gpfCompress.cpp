@@ -0,0 +1,457 @@
+#include "gpfCompress.h"
+#include "gpfThreadPool.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+
+#ifdef GPF_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef GPF_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+static const size_t StreamBlockSize = 1 << 20;
+
+static std::atomic<unsigned> compressionThreads(0);
+
+
+GpfCompression gpfDetectCompression(const char *data, size_t size) {
+  const unsigned char *p = (const unsigned char *) data;
+  if (size >= 2 && p[0] == 0x1f && p[1] == 0x8b)
+    return GpfGzip;
+  if (size >= 4 && p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f && p[3] == 0xfd)
+    return GpfZstd;
+  return GpfUncompressed;
+}
+
+
+static bool endsWith(const char *s, const char *suffix) {
+  size_t n = strlen(s), m = strlen(suffix);
+  return n > m && strcmp(s + n - m, suffix) == 0;
+}
+
+
+GpfCompression gpfCompressionOf(const char *path) {
+  if (endsWith(path, ".gz"))
+    return GpfGzip;
+  if (endsWith(path, ".zst"))
+    return GpfZstd;
+  return GpfUncompressed;
+}
+
+
+bool gpfCompressionSupported(GpfCompression compression, std::string &error) {
+#ifndef GPF_WITH_ZLIB
+  if (compression == GpfGzip) {
+    error = "gzip (.gz) support is not built in, rebuild with -DGPF_WITH_ZLIB -lz";
+    return false;
+  }
+#endif
+#ifndef GPF_WITH_ZSTD
+  if (compression == GpfZstd) {
+    error = "zstd (.zst) support is not built in, rebuild with -DGPF_WITH_ZSTD -lzstd";
+    return false;
+  }
+#endif
+  (void) compression;
+  (void) error;
+  return true;
+}
+
+
+void gpfSetCompressionThreads(unsigned n) {
+  compressionThreads = n;
+}
+
+
+unsigned gpfCompressionThreads() {
+  return compressionThreads;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// GpfDecompressor
+/////////////////////////////////////////////////////////////////////////////
+
+struct GpfDecompressor::State {
+#ifdef GPF_WITH_ZLIB
+  z_stream   zs;
+  bool       zsInit;
+#endif
+#ifdef GPF_WITH_ZSTD
+  ZSTD_DCtx *dctx;
+#endif
+
+  State() {
+#ifdef GPF_WITH_ZLIB
+    memset(&zs, 0, sizeof(zs));
+    zsInit = false;
+#endif
+#ifdef GPF_WITH_ZSTD
+    dctx = NULL;
+#endif
+  }
+
+  ~State() {
+#ifdef GPF_WITH_ZLIB
+    if (zsInit)
+      inflateEnd(&zs);
+#endif
+#ifdef GPF_WITH_ZSTD
+    ZSTD_freeDCtx(dctx);
+#endif
+  }
+};
+
+
+GpfDecompressor::GpfDecompressor()
+  : m_compression(GpfUncompressed), m_boundary(true) {
+}
+
+
+GpfDecompressor::~GpfDecompressor() {
+}
+
+
+bool GpfDecompressor::init(GpfCompression compression, std::string &error) {
+  if (!gpfCompressionSupported(compression, error))
+    return false;
+  m_state.reset(new State);
+  m_compression = compression;
+  m_boundary = true;
+
+#ifdef GPF_WITH_ZLIB
+  if (compression == GpfGzip) {
+    // 15 + 32: the largest window, gzip or zlib header detected
+    if (inflateInit2(&m_state->zs, 15 + 32) != Z_OK) {
+      error = "unable to start gzip decompression";
+      return false;
+    }
+    m_state->zsInit = true;
+  }
+#endif
+#ifdef GPF_WITH_ZSTD
+  if (compression == GpfZstd) {
+    m_state->dctx = ZSTD_createDCtx();
+    if (!m_state->dctx) {
+      error = "unable to start zstd decompression";
+      return false;
+    }
+  }
+#endif
+  return true;
+}
+
+
+bool GpfDecompressor::run(const char *&in, const char *inEnd, char *&out, char *outEnd,
+                          std::string &error) {
+  if (m_compression == GpfUncompressed) {
+    size_t n = std::min((size_t) (inEnd - in), (size_t) (outEnd - out));
+    memcpy(out, in, n);
+    in += n;
+    out += n;
+    return true;
+  }
+
+#ifdef GPF_WITH_ZLIB
+  if (m_compression == GpfGzip) {
+    // inflate is called even with no input left, to flush what it holds
+    z_stream &zs = m_state->zs;
+    while (out < outEnd) {
+      // avail_in and avail_out are only 32 bits
+      zs.next_in = (Bytef *) in;
+      zs.avail_in = (uInt) std::min((size_t) (inEnd - in), (size_t) UINT_MAX);
+      zs.next_out = (Bytef *) out;
+      zs.avail_out = (uInt) std::min((size_t) (outEnd - out), (size_t) UINT_MAX);
+      int ret = inflate(&zs, Z_NO_FLUSH);
+      bool progress = ((const char *) zs.next_in != in || (char *) zs.next_out != out);
+      in = (const char *) zs.next_in;
+      out = (char *) zs.next_out;
+      if (ret == Z_STREAM_END) {
+        // another member may follow, as in concatenated .gz files
+        m_boundary = true;
+        inflateReset(&zs);
+        continue;
+      }
+      if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        error = std::string("corrupt gzip data") + (zs.msg ? std::string(": ") + zs.msg : "");
+        return false;
+      }
+      if (progress)
+        m_boundary = false;
+      if (!progress || in == inEnd)
+        break;
+    }
+    return true;
+  }
+#endif
+#ifdef GPF_WITH_ZSTD
+  if (m_compression == GpfZstd) {
+    // called even with no input left, to flush what it holds
+    ZSTD_inBuffer ib = { in, (size_t) (inEnd - in), 0 };
+    ZSTD_outBuffer ob = { out, (size_t) (outEnd - out), 0 };
+    while (ob.pos < ob.size) {
+      size_t inPos = ib.pos, outPos = ob.pos;
+      size_t ret = ZSTD_decompressStream(m_state->dctx, &ob, &ib);
+      if (ZSTD_isError(ret)) {
+        error = std::string("corrupt zstd data: ") + ZSTD_getErrorName(ret);
+        return false;
+      }
+      if (ib.pos == inPos && ob.pos == outPos)
+        break;
+      // 0 once a frame is complete, another may follow
+      m_boundary = (ret == 0);
+      if (ib.pos == ib.size && ob.pos < ob.size)
+        break;
+    }
+    in += ib.pos;
+    out += ob.pos;
+    return true;
+  }
+#endif
+  error = "unsupported compression";
+  return false;
+}
+
+
+// The size data will likely decompress to, from the gzip trailer or the
+// zstd frame header when they have it
+static size_t decompressedSizeHint(GpfCompression compression, const char *data, size_t size) {
+  size_t hint = 0;
+  if (compression == GpfGzip && size >= 18) {
+    // ISIZE, the size mod 2^32 of the last member
+    const unsigned char *p = (const unsigned char *) data + size - 4;
+    hint = (size_t) p[0] | ((size_t) p[1] << 8) | ((size_t) p[2] << 16) | ((size_t) p[3] << 24);
+  }
+#ifdef GPF_WITH_ZSTD
+  if (compression == GpfZstd) {
+    unsigned long long n = ZSTD_getFrameContentSize(data, size);
+    if (n != ZSTD_CONTENTSIZE_UNKNOWN && n != ZSTD_CONTENTSIZE_ERROR)
+      hint = (size_t) n;
+  }
+#endif
+  // text compresses several fold, anything smaller than that is a wrapped
+  // ISIZE or a first frame of many
+  if (hint < size)
+    hint = 4 * size;
+  return hint + 1;
+}
+
+
+bool gpfDecompress(GpfCompression compression, const char *data, size_t size,
+                   std::vector<char> &out, std::string &error) {
+  GpfDecompressor decoder;
+  if (!decoder.init(compression, error))
+    return false;
+
+  out.resize(decompressedSizeHint(compression, data, size));
+  const char *in = data, *inEnd = data + size;
+  size_t len = 0;
+  while (true) {
+    char *p = out.data() + len;
+    if (!decoder.run(in, inEnd, p, out.data() + out.size(), error))
+      return false;
+    len = p - out.data();
+    // done once the input is used up and the decoder has room to spare
+    if (in == inEnd && len < out.size())
+      break;
+    out.resize(out.size() * 2);
+  }
+  out.resize(len);
+
+  if (!decoder.atBoundary()) {
+    error = "compressed data is truncated";
+    return false;
+  }
+  return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// GpfDecompressStream
+/////////////////////////////////////////////////////////////////////////////
+
+GpfDecompressStream::GpfDecompressStream() : m_begin(0), m_len(0), m_eof(false) {
+}
+
+
+bool GpfDecompressStream::open(GpfCompression compression, const char *prefix,
+                               size_t prefixSize, std::string &error) {
+  if (!m_decoder.init(compression, error))
+    return false;
+  m_input.resize(std::max(StreamBlockSize, prefixSize));
+  memcpy(m_input.data(), prefix, prefixSize);
+  m_begin = 0;
+  m_len = prefixSize;
+  m_eof = false;
+  return true;
+}
+
+
+ssize_t GpfDecompressStream::read(int fd, char *buf, size_t n) {
+  while (true) {
+    // run even on no new input, the decoder may still hold output
+    const char *in = m_input.data() + m_begin;
+    char *out = buf;
+    if (!m_decoder.run(in, m_input.data() + m_len, out, buf + n, m_error))
+      return -1;
+    size_t consumed = (in - m_input.data()) - m_begin;
+    m_begin += consumed;
+    if (out > buf)
+      return out - buf;
+    if (m_begin < m_len) {
+      if (consumed > 0)
+        continue;
+      m_error = "compressed data is corrupt";
+      return -1;
+    }
+    if (m_eof)
+      return m_decoder.atBoundary() ? 0 : -1;
+
+    ssize_t got = ::read(fd, m_input.data(), m_input.size());
+    if (got < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    m_begin = 0;
+    m_len = (size_t) got;
+    m_eof = (got == 0);
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// GpfCompressor
+/////////////////////////////////////////////////////////////////////////////
+
+struct GpfCompressor::State {
+#ifdef GPF_WITH_ZLIB
+  z_stream   zs;
+  bool       zsInit;
+#endif
+#ifdef GPF_WITH_ZSTD
+  ZSTD_CCtx *cctx;
+#endif
+
+  State() {
+#ifdef GPF_WITH_ZLIB
+    memset(&zs, 0, sizeof(zs));
+    zsInit = false;
+#endif
+#ifdef GPF_WITH_ZSTD
+    cctx = NULL;
+#endif
+  }
+
+  ~State() {
+#ifdef GPF_WITH_ZLIB
+    if (zsInit)
+      deflateEnd(&zs);
+#endif
+#ifdef GPF_WITH_ZSTD
+    ZSTD_freeCCtx(cctx);
+#endif
+  }
+};
+
+
+GpfCompressor::GpfCompressor() : m_compression(GpfUncompressed) {
+}
+
+
+GpfCompressor::~GpfCompressor() {
+}
+
+
+bool GpfCompressor::init(GpfCompression compression, std::string &error) {
+  if (!gpfCompressionSupported(compression, error))
+    return false;
+  m_state.reset(new State);
+  m_compression = compression;
+  m_output.resize(StreamBlockSize);
+
+#ifdef GPF_WITH_ZLIB
+  if (compression == GpfGzip) {
+    // gzip -1: the tools are bound by I/O, not by the ratio
+    if (deflateInit2(&m_state->zs, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      error = "unable to start gzip compression";
+      return false;
+    }
+    m_state->zsInit = true;
+  }
+#endif
+#ifdef GPF_WITH_ZSTD
+  if (compression == GpfZstd) {
+    m_state->cctx = ZSTD_createCCtx();
+    if (!m_state->cctx) {
+      error = "unable to start zstd compression";
+      return false;
+    }
+    // a library built without threads refuses workers, and compresses on
+    // the calling thread instead
+    unsigned threads = GpfThreadPool::threadCount(gpfCompressionThreads());
+    if (threads > 1)
+      ZSTD_CCtx_setParameter(m_state->cctx, ZSTD_c_nbWorkers, (int) threads);
+  }
+#endif
+  return true;
+}
+
+
+bool GpfCompressor::write(const char *p, size_t n, bool finish, const Sink &sink) {
+  if (m_compression == GpfUncompressed)
+    return n == 0 || sink(p, n);
+
+#ifdef GPF_WITH_ZLIB
+  if (m_compression == GpfGzip) {
+    z_stream &zs = m_state->zs;
+    const char *end = p + n;
+    while (true) {
+      size_t chunk = std::min((size_t) (end - p), (size_t) UINT_MAX);
+      bool last = (p + chunk == end);
+      zs.next_in = (Bytef *) p;
+      zs.avail_in = (uInt) chunk;
+      int flush = (finish && last) ? Z_FINISH : Z_NO_FLUSH;
+      int ret;
+      do {
+        zs.next_out = (Bytef *) m_output.data();
+        zs.avail_out = (uInt) m_output.size();
+        ret = deflate(&zs, flush);
+        if (ret == Z_STREAM_ERROR)
+          return false;
+        size_t have = m_output.size() - zs.avail_out;
+        if (have > 0 && !sink(m_output.data(), have))
+          return false;
+      } while (zs.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+      p += chunk;
+      if (last)
+        return true;
+    }
+  }
+#endif
+#ifdef GPF_WITH_ZSTD
+  if (m_compression == GpfZstd) {
+    ZSTD_inBuffer ib = { p, n, 0 };
+    ZSTD_EndDirective mode = finish ? ZSTD_e_end : ZSTD_e_continue;
+    while (true) {
+      ZSTD_outBuffer ob = { m_output.data(), m_output.size(), 0 };
+      size_t left = ZSTD_compressStream2(m_state->cctx, &ob, &ib, mode);
+      if (ZSTD_isError(left))
+        return false;
+      if (ob.pos > 0 && !sink(m_output.data(), ob.pos))
+        return false;
+      // done once the input is taken and, when finishing, flushed out
+      if (finish ? left == 0 : ib.pos == ib.size)
+        return true;
+    }
+  }
+#endif
+  (void) finish;
+  return false;
+}
@@ -0,0 +1,132 @@
+#ifndef gpfCompress_h
+#define gpfCompress_h
+
+// gzip and zstd for the files the GPF tools read and write.
+//
+// Inputs are recognized by their magic number, so a compressed GPF, CSV
+// or ID list can be given under any name.  Outputs are compressed when
+// their name ends in ".gz" or ".zst".  Each format is only available when
+// the library for it is built in:
+//
+//   -DGPF_WITH_ZLIB -lz       .gz
+//   -DGPF_WITH_ZSTD -lzstd    .zst
+//
+// zstd output is compressed on gpfCompressionThreads() worker threads;
+// gzip is single threaded.
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum GpfCompression {
+  GpfUncompressed,
+  GpfGzip,
+  GpfZstd
+};
+
+// How data, the first bytes of a file, is compressed.  Four bytes are
+// enough to tell.
+GpfCompression gpfDetectCompression(const char *data, size_t size);
+
+// How an output named path is to be compressed, by its extension
+GpfCompression gpfCompressionOf(const char *path);
+
+// false, with error set, if this build can not handle compression
+bool gpfCompressionSupported(GpfCompression compression, std::string &error);
+
+// Worker threads for zstd output (0 = one per core, the default)
+void gpfSetCompressionThreads(unsigned n);
+unsigned gpfCompressionThreads();
+
+//-----------------------------------------------------------------------
+// Incremental decompressor of a gzip or zstd stream, which may hold
+// several members or frames one after another
+//-----------------------------------------------------------------------
+class GpfDecompressor {
+ public:
+  GpfDecompressor();
+  ~GpfDecompressor();
+  GpfDecompressor(const GpfDecompressor &) = delete;
+  GpfDecompressor &operator=(const GpfDecompressor &) = delete;
+
+  bool init(GpfCompression compression, std::string &error);
+
+  // Decompresses from [in, inEnd) into [out, outEnd), advancing in and out
+  // past what was consumed and produced.  Returns false with error set on
+  // corrupt input.
+  bool run(const char *&in, const char *inEnd, char *&out, char *outEnd,
+           std::string &error);
+
+  // true between members or frames, i.e. the input may end here
+  bool atBoundary() const { return m_boundary; }
+
+ private:
+  struct State;
+  std::unique_ptr<State> m_state;
+  GpfCompression         m_compression;
+  bool                   m_boundary;
+};
+
+// Decompresses the whole of data into out.  Returns false with error set
+// on corrupt or truncated input.
+bool gpfDecompress(GpfCompression compression, const char *data, size_t size,
+                   std::vector<char> &out, std::string &error);
+
+//-----------------------------------------------------------------------
+// Decompressing reads from a file descriptor, for the inputs that are
+// streamed rather than mapped
+//-----------------------------------------------------------------------
+class GpfDecompressStream {
+ public:
+  GpfDecompressStream();
+
+  // prefix holds bytes already read from the descriptor, e.g. the magic
+  // number the compression was recognized by
+  bool open(GpfCompression compression, const char *prefix, size_t prefixSize,
+            std::string &error);
+
+  // Like read(2): fills up to n bytes of buf and returns how many, 0 at
+  // the end of the stream, -1 on a read error or corrupt or truncated
+  // input
+  ssize_t read(int fd, char *buf, size_t n);
+
+ private:
+  GpfDecompressor   m_decoder;
+  std::vector<char> m_input;
+  size_t            m_begin;    // first unconsumed byte of m_input
+  size_t            m_len;      // bytes of m_input holding data
+  bool              m_eof;
+  std::string       m_error;
+};
+
+//-----------------------------------------------------------------------
+// Compressor for an output file.  The compressed bytes are handed to a
+// sink as they come out.
+//-----------------------------------------------------------------------
+class GpfCompressor {
+ public:
+  typedef std::function<bool(const char *, size_t)> Sink;
+
+  GpfCompressor();
+  ~GpfCompressor();
+  GpfCompressor(const GpfCompressor &) = delete;
+  GpfCompressor &operator=(const GpfCompressor &) = delete;
+
+  bool init(GpfCompression compression, std::string &error);
+
+  // Compresses n bytes at p.  With finish the stream is ended after them.
+  // Returns false if compression or the sink failed.
+  bool write(const char *p, size_t n, bool finish, const Sink &sink);
+
+ private:
+  struct State;
+  std::unique_ptr<State> m_state;
+  GpfCompression         m_compression;
+  std::vector<char>      m_output;
+};
+
+#endif
@@ -0,0 +1,458 @@
+#include "gpfConvert.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpfReader.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// The results must not depend on the compiler fusing a multiply and add
+// into an FMA, which -std=gnu++17 (or clang by default) would allow and
+// which changes the last bit of some results, so keep it off here.
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+namespace {
+
+//-----------------------------------------------------------------------
+// The few vector operations the conversion kernels need, for each
+// instruction set.  Scalar is the tail loop (and everything on other
+// targets).
+//-----------------------------------------------------------------------
+struct ScalarOps {
+  typedef double V;
+  typedef bool   M;
+  static const size_t Width = 1;
+  static V load(const double *p) { return *p; }
+  static void store(double *p, V v) { *p = v; }
+  static V set1(double d) { return d; }
+  static V mul(V a, V b) { return a * b; }
+  static V div(V a, V b) { return a / b; }
+  static V add(V a, V b) { return a + b; }
+  static V sub(V a, V b) { return a - b; }
+  static V sqrt(V a) { return ::sqrt(a); }
+  static V abs(V a) { return fabs(a); }
+  static M lt(V a, V b) { return a < b; }
+  static M gt(V a, V b) { return a > b; }
+  static M le(V a, V b) { return a <= b; }
+  static M ge(V a, V b) { return a >= b; }
+  static M both(M a, M b) { return a && b; }
+  static M either(M a, M b) { return a || b; }
+  static unsigned bits(M m) { return m ? 1 : 0; }
+  static V select(M m, V a, V b) { return m ? a : b; }
+};
+
+#if defined(__AVX2__)
+struct SimdOps {
+  typedef __m256d V;
+  typedef __m256d M;
+  static const size_t Width = 4;
+  static V load(const double *p) { return _mm256_loadu_pd(p); }
+  static void store(double *p, V v) { _mm256_storeu_pd(p, v); }
+  static V set1(double d) { return _mm256_set1_pd(d); }
+  static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+  static V div(V a, V b) { return _mm256_div_pd(a, b); }
+  static V add(V a, V b) { return _mm256_add_pd(a, b); }
+  static V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+  static V sqrt(V a) { return _mm256_sqrt_pd(a); }
+  static V abs(V a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+  static M lt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+  static M gt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+  static M le(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+  static M ge(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+  static M both(M a, M b) { return _mm256_and_pd(a, b); }
+  static M either(M a, M b) { return _mm256_or_pd(a, b); }
+  static unsigned bits(M m) { return (unsigned) _mm256_movemask_pd(m); }
+  static V select(M m, V a, V b) { return _mm256_blendv_pd(b, a, m); }
+};
+#define GPF_HAVE_SIMD 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+struct SimdOps {
+  typedef float64x2_t V;
+  typedef uint64x2_t  M;
+  static const size_t Width = 2;
+  static V load(const double *p) { return vld1q_f64(p); }
+  static void store(double *p, V v) { vst1q_f64(p, v); }
+  static V set1(double d) { return vdupq_n_f64(d); }
+  static V mul(V a, V b) { return vmulq_f64(a, b); }
+  static V div(V a, V b) { return vdivq_f64(a, b); }
+  static V add(V a, V b) { return vaddq_f64(a, b); }
+  static V sub(V a, V b) { return vsubq_f64(a, b); }
+  static V sqrt(V a) { return vsqrtq_f64(a); }
+  static V abs(V a) { return vabsq_f64(a); }
+  static M lt(V a, V b) { return vcltq_f64(a, b); }
+  static M gt(V a, V b) { return vcgtq_f64(a, b); }
+  static M le(V a, V b) { return vcleq_f64(a, b); }
+  static M ge(V a, V b) { return vcgeq_f64(a, b); }
+  static M both(M a, M b) { return vandq_u64(a, b); }
+  static M either(M a, M b) { return vorrq_u64(a, b); }
+  static unsigned bits(M m) {
+    return (unsigned) (vgetq_lane_u64(m, 0) & 1) | (unsigned) ((vgetq_lane_u64(m, 1) & 1) << 1);
+  }
+  static V select(M m, V a, V b) { return vbslq_f64(m, a, b); }
+};
+#define GPF_HAVE_SIMD 1
+#endif
+
+// Converts elements [begin, n) Width at a time and returns where it
+// stopped.  The fold is a select rather than adding 0 or 360, so -0.0
+// stays -0.0 exactly as in the branching code.
+template <class Ops, bool ToDegrees>
+size_t angleKernel(size_t begin, size_t n, const double *lat, const double *lon,
+                   double *outLat, double *outLon) {
+  typedef typename Ops::V V;
+  const V rad2dd = Ops::set1(GPF_RAD2DD);
+  const V zero = Ops::set1(0.0);
+  const V d180 = Ops::set1(180.0);
+  const V d360 = Ops::set1(360.0);
+
+  size_t i = begin;
+  for (; i + Ops::Width <= n; i += Ops::Width) {
+    V la = Ops::load(lat + i);
+    V lo = Ops::load(lon + i);
+    if (ToDegrees) {
+      V dd = Ops::mul(rad2dd, lo);
+      Ops::store(outLat + i, Ops::mul(rad2dd, la));
+      Ops::store(outLon + i, Ops::select(Ops::lt(lo, zero), Ops::add(dd, d360), dd));
+    }
+    else {
+      V lo180 = Ops::select(Ops::gt(lo, d180), Ops::sub(lo, d360), lo);
+      Ops::store(outLat + i, Ops::div(la, rad2dd));
+      Ops::store(outLon + i, Ops::div(lo180, rad2dd));
+    }
+  }
+  return i;
+}
+
+template <bool ToDegrees>
+void convertAngles(size_t n, const double *lat, const double *lon,
+                   double *outLat, double *outLon) {
+  size_t i = 0;
+#ifdef GPF_HAVE_SIMD
+  i = angleKernel<SimdOps, ToDegrees>(i, n, lat, lon, outLat, outLon);
+#endif
+  angleKernel<ScalarOps, ToDegrees>(i, n, lat, lon, outLat, outLon);
+}
+
+
+// keep[i] for elements [begin, n), Width at a time, and returns where it
+// stopped
+template <class Ops>
+size_t boxKernel(size_t begin, size_t n, const GpfLatLonBox &box, const double *ddLat,
+                 const double *ddLon360, unsigned char *keep) {
+  typedef typename Ops::V V;
+  typedef typename Ops::M M;
+  const V minLat = Ops::set1(box.minLat);
+  const V maxLat = Ops::set1(box.maxLat);
+  const V minLon = Ops::set1(box.minLon360);
+  const V maxLon = Ops::set1(box.maxLon360);
+  bool wraps = box.wraps();
+
+  size_t i = begin;
+  for (; i + Ops::Width <= n; i += Ops::Width) {
+    V la = Ops::load(ddLat + i);
+    V lo = Ops::load(ddLon360 + i);
+    M inLat = Ops::both(Ops::ge(la, minLat), Ops::le(la, maxLat));
+    M inLon = wraps ? Ops::either(Ops::ge(lo, minLon), Ops::le(lo, maxLon))
+                    : Ops::both(Ops::ge(lo, minLon), Ops::le(lo, maxLon));
+    unsigned mask = Ops::bits(Ops::both(inLat, inLon));
+    for (size_t k = 0; k < Ops::Width; k++)
+      keep[i + k] = (mask >> k) & 1;
+  }
+  return i;
+}
+
+
+// The geodetic conversions run a chunk of points at a time: the sines,
+// cosines and arctangents element by element through libm into arrays of
+// Chunk, the algebra around them in the kernels below, Width at a time.
+// Each kernel evaluates the scalar expressions in the same order, and
+// sqrt and the four operations are correctly rounded in every variant,
+// so the results are bit identical.
+const size_t Chunk = 256;
+
+// x, y, z from the sines and cosines of lat and lon
+template <class Ops>
+size_t ecefKernel(size_t begin, size_t n, double a, double e2, double b2a2,
+                  const double *sinLat, const double *cosLat, const double *sinLon,
+                  const double *cosLon, const double *h, double *x, double *y, double *z) {
+  typedef typename Ops::V V;
+  const V va = Ops::set1(a);
+  const V ve2 = Ops::set1(e2);
+  const V vb2a2 = Ops::set1(b2a2);
+  const V one = Ops::set1(1.0);
+
+  size_t i = begin;
+  for (; i + Ops::Width <= n; i += Ops::Width) {
+    V sLat = Ops::load(sinLat + i);
+    V hi = Ops::load(h + i);
+    // prime vertical radius of curvature, just a on a sphere
+    V N = Ops::div(va, Ops::sqrt(Ops::sub(one, Ops::mul(Ops::mul(ve2, sLat), sLat))));
+    V r = Ops::mul(Ops::add(N, hi), Ops::load(cosLat + i));
+    Ops::store(x + i, Ops::mul(r, Ops::load(cosLon + i)));
+    Ops::store(y + i, Ops::mul(r, Ops::load(sinLon + i)));
+    Ops::store(z + i, Ops::mul(Ops::add(Ops::mul(N, vb2a2), hi), sLat));
+  }
+  return i;
+}
+
+// p = distance from the polar axis, and sqrt(p*p + z*z) - a, the height
+// on a sphere, or p * (1 - e2), the first latitude estimate on an ellipsoid
+template <class Ops, bool Sphere>
+size_t axisKernel(size_t begin, size_t n, double a, double e2, const double *x,
+                  const double *y, const double *z, double *p, double *out) {
+  typedef typename Ops::V V;
+  const V va = Ops::set1(a);
+  const V scale = Ops::set1(1.0 - e2);
+
+  size_t i = begin;
+  for (; i + Ops::Width <= n; i += Ops::Width) {
+    V xi = Ops::load(x + i);
+    V yi = Ops::load(y + i);
+    V pi = Ops::sqrt(Ops::add(Ops::mul(xi, xi), Ops::mul(yi, yi)));
+    Ops::store(p + i, pi);
+    if (Sphere) {
+      V zi = Ops::load(z + i);
+      Ops::store(out + i, Ops::sub(Ops::sqrt(Ops::add(Ops::mul(pi, pi), Ops::mul(zi, zi))), va));
+    }
+    else
+      Ops::store(out + i, Ops::mul(pi, scale));
+  }
+  return i;
+}
+
+// One step of the latitude iteration: the height at the latitude whose
+// sine and cosine are given, and the second argument of the atan2 for the
+// next latitude
+template <class Ops>
+size_t latitudeKernel(size_t begin, size_t n, double a, double e2, const double *p,
+                      const double *z, const double *sinPhi, const double *cosPhi,
+                      double *height, double *next) {
+  typedef typename Ops::V V;
+  const V va = Ops::set1(a);
+  const V ve2 = Ops::set1(e2);
+  const V one = Ops::set1(1.0);
+  const V scale = Ops::set1(1.0 - e2);
+
+  size_t i = begin;
+  for (; i + Ops::Width <= n; i += Ops::Width) {
+    V s = Ops::load(sinPhi + i);
+    V c = Ops::load(cosPhi + i);
+    V pi = Ops::load(p + i);
+    V N = Ops::div(va, Ops::sqrt(Ops::sub(one, Ops::mul(Ops::mul(ve2, s), s))));
+    // near the poles p/cos(phi) loses precision, use z instead
+    V hi = Ops::select(Ops::gt(Ops::abs(c), Ops::abs(s)), Ops::sub(Ops::div(pi, c), N),
+                       Ops::sub(Ops::div(Ops::load(z + i), s), Ops::mul(N, scale)));
+    Ops::store(height + i, hi);
+    Ops::store(next + i, Ops::mul(pi, Ops::sub(one, Ops::div(Ops::mul(ve2, N), Ops::add(N, hi)))));
+  }
+  return i;
+}
+
+// p' = M * [x y z 1]^T
+template <class Ops>
+size_t transformKernel(size_t begin, size_t n, const double (*m)[4],
+                       double *x, double *y, double *z) {
+  typedef typename Ops::V V;
+  V row[3][4];
+  for (int r = 0; r < 3; r++)
+    for (int c = 0; c < 4; c++)
+      row[r][c] = Ops::set1(m[r][c]);
+
+  size_t i = begin;
+  for (; i + Ops::Width <= n; i += Ops::Width) {
+    V px = Ops::load(x + i);
+    V py = Ops::load(y + i);
+    V pz = Ops::load(z + i);
+    V out[3];
+    for (int r = 0; r < 3; r++)
+      out[r] = Ops::add(Ops::add(Ops::add(Ops::mul(row[r][0], px), Ops::mul(row[r][1], py)),
+                                 Ops::mul(row[r][2], pz)), row[r][3]);
+    Ops::store(x + i, out[0]);
+    Ops::store(y + i, out[1]);
+    Ops::store(z + i, out[2]);
+  }
+  return i;
+}
+
+} // namespace
+
+
+bool GpfDatum::fromName(const char *name, GpfDatum &datum) {
+  if (strcmp(name, "D_MARS") == 0)
+    datum = GpfDatum{3396190.0, 3396190.0};
+  else if (strcmp(name, "MOLA") == 0)
+    datum = GpfDatum{3396000.0, 3396000.0};
+  else if (strcmp(name, "D_MOON") == 0)
+    datum = GpfDatum{1737400.0, 1737400.0};
+  else if (strcmp(name, "WGS84") == 0)
+    datum = GpfDatum{6378137.0, 6356752.314245};
+  else
+    return false;
+  return true;
+}
+
+
+bool GpfDatum::fromRadii(const char *semiMajor, const char *semiMinor, GpfDatum &datum) {
+  double radius[2];
+  const char *text[2] = {semiMajor, semiMinor};
+  for (int i = 0; i < 2; i++) {
+    char *end;
+    radius[i] = strtod(text[i], &end);
+    if (end == text[i] || *end != '\0' || !isfinite(radius[i]) || radius[i] <= 0)
+      return false;
+  }
+  if (radius[1] > radius[0])
+    return false;
+  datum = GpfDatum{radius[0], radius[1]};
+  return true;
+}
+
+
+bool GpfTransform::read(const char *path) {
+  GpfMappedFile file;
+  if (!file.open(path))
+    return false;
+
+  std::string_view text(file.data(), file.size());
+  for (int r = 0; r < 4; r++) {
+    for (int c = 0; c < 4; c++) {
+      std::string_view token = gpfNextToken(text);
+      if (token.empty())
+        return false;
+      m[r][c] = gpfToDouble(token);
+    }
+  }
+  return true;
+}
+
+
+void gpfGeodeticToEcef(const GpfDatum &datum, size_t n,
+                       const double *lat, const double *lon, const double *h,
+                       double *x, double *y, double *z) {
+  const double a = datum.semiMajor;
+  const double b2a2 = (datum.semiMinor * datum.semiMinor) / (a * a);
+  const double e2 = 1.0 - b2a2;
+
+  double sinLat[Chunk], cosLat[Chunk], sinLon[Chunk], cosLon[Chunk];
+  for (size_t base = 0; base < n; base += Chunk) {
+    size_t count = n - base < Chunk ? n - base : Chunk;
+    for (size_t k = 0; k < count; k++) {
+      sinLat[k] = sin(lat[base + k]);
+      cosLat[k] = cos(lat[base + k]);
+      sinLon[k] = sin(lon[base + k]);
+      cosLon[k] = cos(lon[base + k]);
+    }
+    size_t k = 0;
+#ifdef GPF_HAVE_SIMD
+    k = ecefKernel<SimdOps>(k, count, a, e2, b2a2, sinLat, cosLat, sinLon, cosLon,
+                            h + base, x + base, y + base, z + base);
+#endif
+    ecefKernel<ScalarOps>(k, count, a, e2, b2a2, sinLat, cosLat, sinLon, cosLon,
+                          h + base, x + base, y + base, z + base);
+  }
+}
+
+
+void gpfEcefToGeodetic(const GpfDatum &datum, size_t n,
+                       const double *x, const double *y, const double *z,
+                       double *lat, double *lon, double *h) {
+  const double a = datum.semiMajor;
+
+  // lat holds p, the distance from the polar axis, until its atan2
+  if (datum.isSphere()) {
+    size_t i = 0;
+#ifdef GPF_HAVE_SIMD
+    i = axisKernel<SimdOps, true>(i, n, a, 0.0, x, y, z, lat, h);
+#endif
+    axisKernel<ScalarOps, true>(i, n, a, 0.0, x, y, z, lat, h);
+    for (i = 0; i < n; i++) {
+      lat[i] = atan2(z[i], lat[i]);
+      lon[i] = atan2(y[i], x[i]);
+    }
+    return;
+  }
+
+  // Fixed point iteration on latitude, which converges to well below a
+  // millimetre within a few steps for points near the surface
+  const double e2 = 1.0 - (datum.semiMinor * datum.semiMinor) / (a * a);
+  double p[Chunk], next[Chunk], sinPhi[Chunk], cosPhi[Chunk];
+  for (size_t base = 0; base < n; base += Chunk) {
+    size_t count = n - base < Chunk ? n - base : Chunk;
+    const double *zc = z + base;
+    double *phi = lat + base;
+    size_t k = 0;
+#ifdef GPF_HAVE_SIMD
+    k = axisKernel<SimdOps, false>(k, count, a, e2, x + base, y + base, zc, p, next);
+#endif
+    axisKernel<ScalarOps, false>(k, count, a, e2, x + base, y + base, zc, p, next);
+    for (k = 0; k < count; k++)
+      phi[k] = atan2(zc[k], next[k]);
+
+    for (int iter = 0; iter < 6; iter++) {
+      for (k = 0; k < count; k++) {
+        sinPhi[k] = sin(phi[k]);
+        cosPhi[k] = cos(phi[k]);
+      }
+      k = 0;
+#ifdef GPF_HAVE_SIMD
+      k = latitudeKernel<SimdOps>(k, count, a, e2, p, zc, sinPhi, cosPhi, h + base, next);
+#endif
+      latitudeKernel<ScalarOps>(k, count, a, e2, p, zc, sinPhi, cosPhi, h + base, next);
+      for (k = 0; k < count; k++)
+        phi[k] = atan2(zc[k], next[k]);
+    }
+    for (k = 0; k < count; k++)
+      lon[base + k] = atan2(y[base + k], x[base + k]);
+  }
+}
+
+
+void gpfApplyTransform(const GpfTransform &tfm, size_t n,
+                       double *x, double *y, double *z) {
+  size_t i = 0;
+#ifdef GPF_HAVE_SIMD
+  i = transformKernel<SimdOps>(i, n, tfm.m, x, y, z);
+#endif
+  transformKernel<ScalarOps>(i, n, tfm.m, x, y, z);
+}
+
+
+void gpfRadiansToDegrees360(size_t n, const double *radLat, const double *radLon,
+                            double *ddLat, double *ddLon360) {
+  convertAngles<true>(n, radLat, radLon, ddLat, ddLon360);
+}
+
+
+void gpfDegrees360ToRadians(size_t n, const double *ddLat, const double *ddLon360,
+                            double *radLat, double *radLon180) {
+  convertAngles<false>(n, ddLat, ddLon360, radLat, radLon180);
+}
+
+
+void gpfInsideBox(const GpfLatLonBox &box, size_t n, const double *ddLat,
+                  const double *ddLon360, unsigned char *keep) {
+  size_t i = 0;
+#ifdef GPF_HAVE_SIMD
+  i = boxKernel<SimdOps>(i, n, box, ddLat, ddLon360, keep);
+#endif
+  boxKernel<ScalarOps>(i, n, box, ddLat, ddLon360, keep);
+}
+
+
+void gpfDegreesToDegrees360(size_t n, const double *ddLat, const double *ddLon,
+                            double *ddLat360, double *ddLon360) {
+  for (size_t i = 0; i < n; i++) {
+    ddLat360[i] = ddLat[i];
+    ddLon360[i] = ddLon[i] < 0 ? ddLon[i] + 360 : ddLon[i];
+  }
+}
@@ -0,0 +1,106 @@
+#ifndef gpfConvert_h
+#define gpfConvert_h
+
+// Batched coordinate conversions for the GPF tools.
+//
+// Every routine works on whole arrays (structure of arrays, one array per
+// coordinate) so the conversion of a block of points is a tight loop the
+// compiler can keep in registers, rather than a call per point inside the
+// parse loop.  Angles are in radians unless noted.
+
+#include <stddef.h>
+
+// degrees per radian, the constant the tools have always used
+#define GPF_RAD2DD 57.295779513082320876798154814105
+
+//-----------------------------------------------------------------------
+// Reference ellipsoid, named the way pc_align's --datum option names them
+//-----------------------------------------------------------------------
+struct GpfDatum {
+  double semiMajor;
+  double semiMinor;
+
+  // D_MARS, the datum the surface fit scripts hand to pc_align
+  static GpfDatum mars() { return GpfDatum{3396190.0, 3396190.0}; }
+
+  // D_MARS, MOLA, D_MOON or WGS84.  Returns false for anything else.
+  static bool fromName(const char *name, GpfDatum &datum);
+
+  // The ellipsoid of the two radii in meters, semi-major first.  Returns
+  // false unless both are positive finite numbers and the semi-minor one
+  // is not the larger.
+  static bool fromRadii(const char *semiMajor, const char *semiMinor, GpfDatum &datum);
+
+  bool isSphere() const { return semiMajor == semiMinor; }
+};
+
+//-----------------------------------------------------------------------
+// 4x4 rigid/similarity transform as written by pc_align (*-transform.txt),
+// applied to ECEF column vectors: p' = M * [x y z 1]^T
+//-----------------------------------------------------------------------
+struct GpfTransform {
+  double m[4][4];
+
+  // Reads the 16 whitespace separated values of a pc_align transform file
+  bool read(const char *path);
+};
+
+// The geodetic conversions and the transform are vectorized like the angle
+// conversions below, except for the sines, cosines and arctangents, which
+// are libm's, point by point.  Results are bit identical to the scalar
+// loops.
+void gpfGeodeticToEcef(const GpfDatum &datum, size_t n,
+                       const double *lat, const double *lon, const double *h,
+                       double *x, double *y, double *z);
+
+// Longitudes come back in the -pi to pi domain
+void gpfEcefToGeodetic(const GpfDatum &datum, size_t n,
+                       const double *x, const double *y, const double *z,
+                       double *lat, double *lon, double *h);
+
+// Transforms the points in place
+void gpfApplyTransform(const GpfTransform &tfm, size_t n,
+                       double *x, double *y, double *z);
+
+//-----------------------------------------------------------------------
+// Socet Set <-> pc_align angle conversion.  Socet Set GPFs hold latitude
+// and longitude in radians with longitude in the -180 to 180 domain, the
+// CSVs handed to pc_align hold degrees with longitude in the 0 to 360
+// domain.  Both directions run through one kernel that is vectorized with
+// AVX2 (build with -mavx2 or -march=native) or NEON on aarch64, and folds
+// the longitude domain with a blend instead of a branch.  Results are bit
+// identical to the scalar expressions the tools always used.
+//-----------------------------------------------------------------------
+
+// ddLat = rad2dd*radLat, ddLon360 = rad2dd*radLon (+360 if radLon < 0)
+void gpfRadiansToDegrees360(size_t n, const double *radLat, const double *radLon,
+                            double *ddLat, double *ddLon360);
+
+// radLat = ddLat/rad2dd, radLon180 = (ddLon360 (-360 if > 180))/rad2dd
+void gpfDegrees360ToRadians(size_t n, const double *ddLat, const double *ddLon360,
+                            double *radLat, double *radLon180);
+
+//-----------------------------------------------------------------------
+// Latitude/longitude box in degrees, longitude in the 0 to 360 domain.
+// A box with minLon360 > maxLon360 wraps through longitude 0, e.g. 350 to
+// 10.  The edges are inside.
+//-----------------------------------------------------------------------
+struct GpfLatLonBox {
+  double minLat, maxLat;
+  double minLon360, maxLon360;
+
+  bool wraps() const { return minLon360 > maxLon360; }
+};
+
+// keep[i] = 1 if point i is inside box, else 0, for a block of points in
+// the pc_align degrees.  Vectorized like the angle conversions.
+void gpfInsideBox(const GpfLatLonBox &box, size_t n, const double *ddLat,
+                  const double *ddLon360, unsigned char *keep);
+
+// GXP angles are already degrees, with longitude in either domain:
+// ddLon360 = ddLon (+360 if ddLon < 0).  gpfDegrees360ToRadians takes
+// them back to Socet Set radians as they are.
+void gpfDegreesToDegrees360(size_t n, const double *ddLat, const double *ddLon,
+                            double *ddLat360, double *ddLon360);
+
+#endif
@@ -0,0 +1,32 @@
+#include "gpfCsvFormat.h"
+
+
+bool GpfCsvFormat::parseColumns(const std::string &spec, GpfCsvFormat &format,
+                                std::string &error) {
+  int field[3] = { -1, -1, -1 };    // of lat, lon and height
+  static const char *names[3] = { "lat", "lon", "height" };
+
+  size_t begin = 0;
+  int n = 0;
+  bool ok = true;
+  while (ok && begin <= spec.size()) {
+    size_t end = spec.find(',', begin);
+    if (end == std::string::npos)
+      end = spec.size();
+    std::string name = spec.substr(begin, end - begin);
+    int column = 0;
+    while (column < 3 && name != names[column])
+      column++;
+    ok = (n < 3 && column < 3 && field[column] < 0);
+    if (ok)
+      field[column] = n++;
+    begin = end + 1;
+  }
+  if (!ok || n != 3) {
+    error = "expected the columns lat, lon and height in some order, e.g. lon,lat,height: " + spec;
+    return false;
+  }
+  format.latField = field[0];
+  format.lonField = field[1];
+  return true;
+}
@@ -0,0 +1,120 @@
+#ifndef gpfCsvFormat_h
+#define gpfCsvFormat_h
+
+// Column layouts of the tie point CSVs.
+//
+// The legacy CSV is "lat,lon360,height": latitude and longitude in
+// degrees, longitude in the 0 to 360 domain.  A GpfCsvFormat describes
+// any order of the three columns, with longitudes in 0 to 360 or -180 to
+// 180, e.g. for a pc_align run with --csv-format "1:lon 2:lat
+// 3:height_above_datum".
+//
+// Each layout is a GpfCsvLayout<> instantiation, so the loops that split
+// and format the rows are compiled once per layout with the column order
+// fixed, and gpfWithCsvLayout() picks the instantiation for a format once,
+// outside the loop:
+//
+//   gpfWithCsvLayout(format, [&](auto layout) {
+//     typedef decltype(layout) Layout;
+//     for (size_t t = 0; t < n; t++)
+//       Layout::put(csv, ddLat[t], ddLon360[t], height[t]);
+//   });
+//
+// Reading takes longitudes in either domain whatever the format says,
+// since gpfDegrees360ToRadians folds them the same way.
+
+#include <string>
+#include <string_view>
+
+#include "gpfReader.h"
+#include "gpfWriter.h"
+
+enum GpfLonDomain {
+  GpfLon360,      // 0 to 360, as the legacy CSV
+  GpfLon180       // -180 to 180
+};
+
+struct GpfCsvFormat {
+  int          latField;      // 0, 1 or 2, the height takes the field left
+  int          lonField;
+  GpfLonDomain domain;
+
+  // lat,lon360,height
+  GpfCsvFormat() : latField(0), lonField(1), domain(GpfLon360) {}
+
+  bool isDefault() const { return latField == 0 && lonField == 1 && domain == GpfLon360; }
+
+  // Parses an order of the three column names (lat, lon and height,
+  // comma separated) into latField and lonField.  Returns false with
+  // error set if spec is not one.
+  static bool parseColumns(const std::string &spec, GpfCsvFormat &format,
+                           std::string &error);
+};
+
+//-----------------------------------------------------------------------
+// One column layout, fixed at compile time
+//-----------------------------------------------------------------------
+template <int LatField, int LonField, GpfLonDomain Domain>
+struct GpfCsvLayout {
+  static constexpr int HeightField = 3 - LatField - LonField;
+
+  // The fields of a row, separated by commas and/or blanks
+  static void split(std::string_view line, std::string_view &lat, std::string_view &lon,
+                    std::string_view &height) {
+    std::string_view field[3];
+    field[0] = gpfNextField(line);
+    field[1] = gpfNextField(line);
+    field[2] = gpfNextField(line);
+    lat = field[LatField];
+    lon = field[LonField];
+    height = field[HeightField];
+  }
+
+  // Writes a row, the angles as "%.14lf" and the height as given
+  static void put(GpfWriter &out, double lat, double lon360, std::string_view height) {
+    putField<0>(out, lat, lon360, height);
+    out.put(',');
+    putField<1>(out, lat, lon360, height);
+    out.put(',');
+    putField<2>(out, lat, lon360, height);
+    out.put('\n');
+  }
+
+ private:
+  template <int Field>
+  static void putField(GpfWriter &out, double lat, double lon360, std::string_view height) {
+    if constexpr (Field == LatField)
+      out.putFixed(lat, 14);
+    else if constexpr (Field == LonField) {
+      if constexpr (Domain == GpfLon180)
+        out.putFixed(lon360 > 180.0 ? lon360 - 360.0 : lon360, 14);
+      else
+        out.putFixed(lon360, 14);
+    }
+    else
+      out.write(height);
+  }
+};
+
+template <int LatField, int LonField, class Fn>
+void gpfWithCsvDomain(GpfLonDomain domain, Fn &fn) {
+  if (domain == GpfLon180)
+    fn(GpfCsvLayout<LatField, LonField, GpfLon180>());
+  else
+    fn(GpfCsvLayout<LatField, LonField, GpfLon360>());
+}
+
+// Calls fn with the GpfCsvLayout<> of format
+template <class Fn>
+void gpfWithCsvLayout(const GpfCsvFormat &format, Fn &&fn) {
+  switch (format.latField * 3 + format.lonField) {
+    case 0 * 3 + 2: gpfWithCsvDomain<0, 2>(format.domain, fn); break;
+    case 1 * 3 + 0: gpfWithCsvDomain<1, 0>(format.domain, fn); break;
+    case 1 * 3 + 2: gpfWithCsvDomain<1, 2>(format.domain, fn); break;
+    case 2 * 3 + 0: gpfWithCsvDomain<2, 0>(format.domain, fn); break;
+    case 2 * 3 + 1: gpfWithCsvDomain<2, 1>(format.domain, fn); break;
+    default:        gpfWithCsvDomain<0, 1>(format.domain, fn); break;
+  }
+}
+
+#endif
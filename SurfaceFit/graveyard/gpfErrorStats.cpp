@@ -0,0 +1,233 @@
+#include "gpfErrorStats.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "gpfReader.h"
+#include "gpfWriter.h"
+
+// Relative accuracy of the quantiles, and the bucket growth factor it
+// takes: every value in a bucket is within Accuracy of its midpoint
+static const double Accuracy = 0.01;
+static const double Gamma = (1.0 + Accuracy) / (1.0 - Accuracy);
+
+// Magnitudes below this are counted as zero
+static const double ZeroMagnitude = 1e-12;
+
+static const char *axisNames[3] = { "x", "y", "z" };
+
+/////////////////////////////////////////////////////////////////////////////
+// GpfQuantileSketch
+/////////////////////////////////////////////////////////////////////////////
+
+void GpfQuantileSketch::Store::add(int bucket, uint64_t n) {
+  if (counts.empty()) {
+    first = bucket;
+    counts.push_back(0);
+  }
+  else if (bucket < first) {
+    counts.insert(counts.begin(), (size_t) (first - bucket), 0);
+    first = bucket;
+  }
+  else if (bucket >= first + (int) counts.size())
+    counts.resize((size_t) (bucket - first) + 1, 0);
+  counts[(size_t) (bucket - first)] += n;
+}
+
+
+void GpfQuantileSketch::Store::merge(const Store &other) {
+  for (size_t i = 0; i < other.counts.size(); i++) {
+    if (other.counts[i] > 0)
+      add(other.first + (int) i, other.counts[i]);
+  }
+}
+
+
+GpfQuantileSketch::GpfQuantileSketch()
+  : m_zero(0), m_count(0), m_min(INFINITY), m_max(-INFINITY) {
+}
+
+
+int GpfQuantileSketch::bucketOf(double magnitude) const {
+  return (int) ceil(log(magnitude) / log(Gamma));
+}
+
+
+double GpfQuantileSketch::valueOf(int bucket) const {
+  return 2.0 * pow(Gamma, bucket) / (Gamma + 1.0);
+}
+
+
+void GpfQuantileSketch::add(double value) {
+  if (value != value)
+    return;
+  m_count++;
+  m_min = std::min(m_min, value);
+  m_max = std::max(m_max, value);
+  double magnitude = fabs(value);
+  if (magnitude < ZeroMagnitude)
+    m_zero++;
+  else if (value > 0.0)
+    m_positive.add(bucketOf(magnitude), 1);
+  else
+    m_negative.add(bucketOf(magnitude), 1);
+}
+
+
+void GpfQuantileSketch::merge(const GpfQuantileSketch &other) {
+  m_positive.merge(other.m_positive);
+  m_negative.merge(other.m_negative);
+  m_zero += other.m_zero;
+  m_count += other.m_count;
+  m_min = std::min(m_min, other.m_min);
+  m_max = std::max(m_max, other.m_max);
+}
+
+
+double GpfQuantileSketch::quantile(double q) const {
+  if (m_count == 0)
+    return 0.0;
+  q = std::min(std::max(q, 0.0), 1.0);
+  uint64_t rank = (uint64_t) floor(q * (double) (m_count - 1));
+
+  // from the most negative value up
+  double value = m_max;
+  uint64_t seen = 0;
+  bool found = false;
+  for (size_t i = m_negative.counts.size(); i-- > 0 && !found;) {
+    seen += m_negative.counts[i];
+    if (seen > rank) {
+      value = -valueOf(m_negative.first + (int) i);
+      found = true;
+    }
+  }
+  if (!found) {
+    seen += m_zero;
+    if (seen > rank) {
+      value = 0.0;
+      found = true;
+    }
+  }
+  for (size_t i = 0; i < m_positive.counts.size() && !found; i++) {
+    seen += m_positive.counts[i];
+    if (seen > rank) {
+      value = valueOf(m_positive.first + (int) i);
+      found = true;
+    }
+  }
+  return std::min(std::max(value, m_min), m_max);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// GpfRunningStats
+/////////////////////////////////////////////////////////////////////////////
+
+GpfRunningStats::GpfRunningStats()
+  : count(0), sum(0.0), sumSquares(0.0), min(INFINITY), max(-INFINITY) {
+}
+
+
+void GpfRunningStats::add(double value) {
+  if (value != value)
+    return;
+  count++;
+  sum += value;
+  sumSquares += value * value;
+  min = std::min(min, value);
+  max = std::max(max, value);
+  sketch.add(value);
+}
+
+
+void GpfRunningStats::merge(const GpfRunningStats &other) {
+  count += other.count;
+  sum += other.sum;
+  sumSquares += other.sumSquares;
+  min = std::min(min, other.min);
+  max = std::max(max, other.max);
+  sketch.merge(other.sketch);
+}
+
+
+double GpfRunningStats::rms() const {
+  return count ? sqrt(sumSquares / count) : 0.0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// GpfErrorStats
+/////////////////////////////////////////////////////////////////////////////
+
+GpfErrorStats::GpfErrorStats() : m_skipped(0) {
+}
+
+
+void GpfErrorStats::add(const GpfPointRecord *recs, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    const GpfPointRecord &rec = recs[i];
+    int known = rec.knownValue();
+    if (known < 0 || known > MaxKnown) {
+      m_skipped++;
+      continue;
+    }
+    if ((size_t) known >= m_groups.size())
+      m_groups.resize((size_t) known + 1);
+    Group &group = m_groups[(size_t) known];
+    for (int j = 0; j < 3; j++) {
+      group.sigma[j].add(gpfToDouble(rec.sigma[j]));
+      group.residual[j].add(gpfToDouble(rec.residual[j]));
+    }
+  }
+}
+
+
+void GpfErrorStats::merge(const GpfErrorStats &other) {
+  if (other.m_groups.size() > m_groups.size())
+    m_groups.resize(other.m_groups.size());
+  for (size_t k = 0; k < other.m_groups.size(); k++) {
+    for (int j = 0; j < 3; j++) {
+      m_groups[k].sigma[j].merge(other.m_groups[k].sigma[j]);
+      m_groups[k].residual[j].merge(other.m_groups[k].residual[j]);
+    }
+  }
+  m_skipped += other.m_skipped;
+}
+
+
+uint64_t GpfErrorStats::records() const {
+  uint64_t n = 0;
+  for (const Group &group : m_groups)
+    n += group.sigma[0].count;
+  return n;
+}
+
+
+// One summary line of s
+static void writeLine(GpfWriter &out, size_t known, const char *quantity, int axis,
+                      const GpfRunningStats &s) {
+  char line[512];
+  snprintf(line, sizeof(line), "%zu,%s_%s,%llu,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f\n",
+           known, quantity, axisNames[axis], (unsigned long long) s.count, s.mean(), s.rms(),
+           s.count ? s.min : 0.0, s.count ? s.max : 0.0, s.sketch.quantile(0.50),
+           s.sketch.quantile(0.90), s.sketch.quantile(0.95), s.sketch.quantile(0.99));
+  out.write(line);
+}
+
+
+bool GpfErrorStats::write(const char *path) const {
+  GpfWriter out;
+  if (!out.open(path))
+    return false;
+  out.write("known,quantity,count,mean,rms,min,max,p50,p90,p95,p99\n");
+  for (size_t k = 0; k < m_groups.size(); k++) {
+    const Group &group = m_groups[k];
+    if (group.sigma[0].count == 0)
+      continue;
+    for (int j = 0; j < 3; j++)
+      writeLine(out, k, "sigma", j, group.sigma[j]);
+    for (int j = 0; j < 3; j++)
+      writeLine(out, k, "residual", j, group.residual[j]);
+  }
+  return out.close();
+}
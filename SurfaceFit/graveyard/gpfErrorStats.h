@@ -0,0 +1,120 @@
+#ifndef gpfErrorStats_h
+#define gpfErrorStats_h
+
+// Sigma and residual statistics of a GPF, gathered while a tool reads it
+// anyway, instead of in a separate pass afterwards.
+//
+// The records are grouped by their known value (0 tie point, 1 XY, 2 Z
+// and 3 XYZ control, or transformed tie points after a merge).  For each
+// group and each of the three sigmas and the three residuals (the x, y
+// and z values of the record's sigma and residual lines, in the order
+// the GPF holds them) the summary has the count, mean, RMS, minimum and
+// maximum, which are exact, and the 50th, 90th, 95th and 99th
+// percentiles, estimated by a sketch to within 1% of the true value.
+//
+// The sketch (GpfQuantileSketch) keeps counts in logarithmic buckets, so
+// it takes little memory however many points are added, and two sketches
+// merge exactly: a GPF read on several threads gets the same counts,
+// extremes and percentiles as one read on one (the sums behind the mean
+// and RMS are only added in a different order).
+//
+// write() saves the summary as a CSV, one line per group and quantity:
+//
+//   known,quantity,count,mean,rms,min,max,p50,p90,p95,p99
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct GpfPointRecord;
+
+//-----------------------------------------------------------------------
+// Quantiles of a stream of values, to a relative accuracy of 1%
+//-----------------------------------------------------------------------
+class GpfQuantileSketch {
+ public:
+  GpfQuantileSketch();
+
+  void add(double value);
+  void merge(const GpfQuantileSketch &other);
+
+  uint64_t count() const { return m_count; }
+
+  // The q quantile (0 to 1), 0 if nothing was added
+  double quantile(double q) const;
+
+ private:
+  // counts of the buckets first .. first + counts.size() - 1
+  struct Store {
+    int                   first;
+    std::vector<uint64_t> counts;
+
+    Store() : first(0) {}
+    void add(int bucket, uint64_t n);
+    void merge(const Store &other);
+  };
+
+  int bucketOf(double magnitude) const;
+  double valueOf(int bucket) const;
+
+  Store    m_positive;
+  Store    m_negative;    // by magnitude
+  uint64_t m_zero;
+  uint64_t m_count;
+  double   m_min, m_max;
+};
+
+//-----------------------------------------------------------------------
+// Exact moments and extremes of one quantity, and its sketch
+//-----------------------------------------------------------------------
+struct GpfRunningStats {
+  uint64_t          count;
+  double            sum, sumSquares;
+  double            min, max;
+  GpfQuantileSketch sketch;
+
+  GpfRunningStats();
+
+  void add(double value);
+  void merge(const GpfRunningStats &other);
+
+  double mean() const { return count ? sum / count : 0.0; }
+  double rms() const;
+};
+
+//-----------------------------------------------------------------------
+// The summary of a GPF
+//-----------------------------------------------------------------------
+class GpfErrorStats {
+ public:
+  // Records with a known value outside 0 to MaxKnown are only counted
+  static constexpr int MaxKnown = 255;
+
+  GpfErrorStats();
+
+  // Parses the sigmas and residuals of n records into the summary
+  void add(const GpfPointRecord *recs, size_t n);
+
+  // Adds all of other, e.g. a part read on another thread
+  void merge(const GpfErrorStats &other);
+
+  // Records in the summary, and the ones left out for their known value
+  uint64_t records() const;
+  uint64_t skipped() const { return m_skipped; }
+
+  // Writes the summary CSV to path.  Returns false if it could not be
+  // written.
+  bool write(const char *path) const;
+
+ private:
+  struct Group {
+    GpfRunningStats sigma[3];
+    GpfRunningStats residual[3];
+  };
+
+  std::vector<Group> m_groups;    // by known value
+  uint64_t           m_skipped;
+};
+
+#endif
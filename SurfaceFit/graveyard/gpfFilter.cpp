@@ -0,0 +1,103 @@
+#include "gpfFilter.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+static const uint32_t StatTie = 1u << 1;
+static const uint32_t KnownTie = 1u << 0;
+
+
+GpfFilterSpec::GpfFilterSpec()
+  : statMask(StatTie), knownMask(KnownTie), hasBox(false), box{-90.0, 90.0, 0.0, 360.0} {
+}
+
+
+bool GpfFilterSpec::isDefault() const {
+  return statMask == StatTie && knownMask == KnownTie && !hasBox && idsFile.empty();
+}
+
+
+bool GpfFilterSpec::parseValues(const std::string &list, uint32_t &mask, std::string &error) {
+  if (list == "any") {
+    mask = AnyValue;
+    return true;
+  }
+
+  mask = 0;
+  size_t begin = 0;
+  while (begin <= list.size()) {
+    size_t end = list.find(',', begin);
+    if (end == std::string::npos)
+      end = list.size();
+    std::string value = list.substr(begin, end - begin);
+    char *stop = NULL;
+    long v = strtol(value.c_str(), &stop, 10);
+    if (value.empty() || *stop != '\0' || v < 0 || v > 31) {
+      error = "expected any or a comma separated list of values 0 to 31: " + list;
+      return false;
+    }
+    mask |= 1u << v;
+    begin = end + 1;
+  }
+  return true;
+}
+
+
+// lon folded into 0 to 360
+static double fold360(double lon) {
+  lon = fmod(lon, 360.0);
+  return lon < 0.0 ? lon + 360.0 : lon;
+}
+
+
+bool GpfFilterSpec::setBox(double minLat, double maxLat, double minLon, double maxLon,
+                           std::string &error) {
+  if (!(minLat <= maxLat)) {
+    error = "the -bbox latitudes are out of order";
+    return false;
+  }
+  box.minLat = minLat;
+  box.maxLat = maxLat;
+  if (maxLon - minLon >= 360.0) {
+    box.minLon360 = 0.0;
+    box.maxLon360 = 360.0;
+  }
+  else {
+    box.minLon360 = fold360(minLon);
+    box.maxLon360 = fold360(maxLon);
+  }
+  hasBox = true;
+  return true;
+}
+
+
+GpfPointFilter::GpfPointFilter() : m_haveIds(false) {
+}
+
+
+bool GpfPointFilter::open(const GpfFilterSpec &spec, std::string &error) {
+  m_spec = spec;
+  m_ids.clear();
+  m_idsFile.close();
+  m_haveIds = !spec.idsFile.empty();
+  if (!m_haveIds)
+    return true;
+
+  if (!m_idsFile.open(spec.idsFile.c_str())) {
+    error = "unable to open point id list: " + spec.idsFile;
+    if (!m_idsFile.error().empty())
+      error += "\n  " + m_idsFile.error();
+    return false;
+  }
+
+  // one ID per line, a repeated ID is the same point
+  const char *cur = m_idsFile.data();
+  const char *end = cur + m_idsFile.size();
+  while (cur < end) {
+    std::string_view line = gpfNextLine(cur, end);
+    std::string_view pointID = gpfNextToken(line);
+    if (!pointID.empty())
+      m_ids.insert(pointID, 0);
+  }
+  return true;
+}
@@ -0,0 +1,96 @@
+#ifndef gpfFilter_h
+#define gpfFilter_h
+
+// Selection of the points the exporter writes.
+//
+// By default the exporter writes the active tie points, stat 1 and known
+// 0, as the legacy tool does.  A GpfFilterSpec widens or narrows that:
+//
+//   stat, known  the values accepted for each field, e.g. "1" or "0,1",
+//                or "any"; -allpoints is both "any", every record of the
+//                GPF (control included), like gpf_transform.py --all-points
+//   box          a latitude/longitude box, see GpfLatLonBox in gpfConvert.h
+//   idsFile      a point ID list, one ID per line (the first token of the
+//                line, so a .tiePointIds.txt will do)
+//
+// A point is exported when it passes all of them.  The stat/known and ID
+// tests are made on each record as it is parsed; the box is tested a
+// block of points at a time, on the converted degrees, with
+// gpfInsideBox().
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+
+#include "gpfConvert.h"
+#include "gpfPointIndex.h"
+#include "gpfReader.h"
+
+//-----------------------------------------------------------------------
+// What to select, as given on the command line
+//-----------------------------------------------------------------------
+struct GpfFilterSpec {
+  // bit v is set if value v (0 to 31) is accepted; AnyValue accepts all
+  static constexpr uint32_t AnyValue = 0xffffffffu;
+
+  uint32_t     statMask;
+  uint32_t     knownMask;
+  bool         hasBox;
+  GpfLatLonBox box;
+  std::string  idsFile;
+
+  // the active tie points, stat 1 and known 0
+  GpfFilterSpec();
+
+  // true if only the active tie points are selected
+  bool isDefault() const;
+
+  // Parses "any" or a comma separated list of values 0 to 31 into mask.
+  // Returns false with error set if list is not one.
+  static bool parseValues(const std::string &list, uint32_t &mask, std::string &error);
+
+  // Sets box from degrees, longitudes in either domain; minLon > maxLon
+  // (after folding into 0 to 360) wraps through 0, and a box 360 degrees
+  // or more wide takes every longitude.  Returns false with error set if
+  // the latitudes are out of order.
+  bool setBox(double minLat, double maxLat, double minLon, double maxLon,
+              std::string &error);
+};
+
+//-----------------------------------------------------------------------
+// A spec ready to test points with.  The ID list is mapped and indexed
+// by open(), and the index refers to the mapping, so a filter can not be
+// copied.
+//-----------------------------------------------------------------------
+class GpfPointFilter {
+ public:
+  GpfPointFilter();
+  GpfPointFilter(const GpfPointFilter &) = delete;
+  GpfPointFilter &operator=(const GpfPointFilter &) = delete;
+
+  // Returns false with error set if the ID list can not be read
+  bool open(const GpfFilterSpec &spec, std::string &error);
+
+  // The stat/known and ID tests
+  bool accepts(std::string_view pointID, int stat, int known) const {
+    return accepted(m_spec.statMask, stat) && accepted(m_spec.knownMask, known) &&
+           (!m_haveIds || m_ids.find(pointID) != GpfPointIndex::NotFound);
+  }
+
+  bool hasBox() const { return m_spec.hasBox; }
+  const GpfLatLonBox &box() const { return m_spec.box; }
+
+ private:
+  static bool accepted(uint32_t mask, int value) {
+    if (mask == GpfFilterSpec::AnyValue)
+      return true;
+    return value >= 0 && value < 32 && ((mask >> value) & 1);
+  }
+
+  GpfFilterSpec m_spec;
+  GpfMappedFile m_idsFile;
+  GpfPointIndex m_ids;
+  bool          m_haveIds;
+};
+
+#endif
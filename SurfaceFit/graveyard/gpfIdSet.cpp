@@ -0,0 +1,59 @@
+#include "gpfIdSet.h"
+
+#include <string.h>
+
+#include "gpfPointIndex.h"
+
+
+GpfIdSet::GpfIdSet() : m_mask(0), m_size(0) {
+}
+
+
+void GpfIdSet::reserve(size_t n) {
+  size_t capacity = 16;
+  while (capacity < 2 * n)
+    capacity <<= 1;
+  if (capacity > m_slots.size())
+    rehash(capacity);
+}
+
+
+size_t GpfIdSet::memoryBytes() const {
+  return m_slots.capacity() * sizeof(Slot) + m_ids.reserved();
+}
+
+
+void GpfIdSet::rehash(size_t capacity) {
+  std::vector<Slot> old;
+  old.swap(m_slots);
+  m_slots.assign(capacity, Slot{0, NULL});
+  m_mask = capacity - 1;
+  for (const Slot &s : old) {
+    if (s.hash == 0)
+      continue;
+    size_t i = s.hash & m_mask;
+    while (m_slots[i].hash != 0)
+      i = (i + 1) & m_mask;
+    m_slots[i] = s;
+  }
+}
+
+
+bool GpfIdSet::insert(std::string_view id) {
+  if (2 * (m_size + 1) > m_slots.size())
+    rehash(m_slots.empty() ? 16 : 2 * m_slots.size());
+
+  uint64_t h = gpfHashId(id);
+  size_t i = h & m_mask;
+  while (m_slots[i].hash != 0) {
+    // strncmp stops at the copy's NUL, so a shorter copy is never read past
+    const char *copy = m_slots[i].id;
+    if (m_slots[i].hash == h && strncmp(copy, id.data(), id.size()) == 0 &&
+        copy[id.size()] == '\0')
+      return false;
+    i = (i + 1) & m_mask;
+  }
+  m_slots[i] = Slot{h, m_ids.copyTerminated(id)};
+  m_size++;
+  return true;
+}
@@ -0,0 +1,52 @@
+#ifndef gpfIdSet_h
+#define gpfIdSet_h
+
+// Compact set of point IDs, for dropping the repeats of a point when
+// several GPFs are merged into one (gpfMerge).
+//
+// Each ID is copied once into an arena (gpfArena.h), NUL terminated, so
+// the set does not hold on to the files the IDs came from, and a slot of
+// the table is just the ID's hash and a pointer to the copy.  Linear
+// probing over a power of two table kept at most half full, like
+// GpfPointIndex, so a set of n IDs takes about 32 bytes a point plus the
+// IDs themselves, whatever the size of the records they name.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+#include <vector>
+
+#include "gpfArena.h"
+
+class GpfIdSet {
+ public:
+  GpfIdSet();
+  GpfIdSet(const GpfIdSet &) = delete;
+  GpfIdSet &operator=(const GpfIdSet &) = delete;
+
+  // Sizes the table for n IDs so inserting them never rehashes
+  void reserve(size_t n);
+
+  // Adds id.  Returns false if it is already in the set.
+  bool insert(std::string_view id);
+
+  size_t size() const { return m_size; }
+
+  // Bytes allocated for the table and the copied IDs
+  size_t memoryBytes() const;
+
+ private:
+  struct Slot {
+    uint64_t    hash;     // 0 marks an empty slot
+    const char *id;
+  };
+
+  void rehash(size_t capacity);
+
+  std::vector<Slot> m_slots;
+  size_t            m_mask;
+  size_t            m_size;
+  GpfArena          m_ids;
+};
+
+#endif
@@ -0,0 +1,256 @@
+#include "gpfIndexFile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "gpfPointIndex.h"
+#include "gpfWriter.h"
+
+
+std::string gpfIndexPath(const std::string &gpfPath) {
+  std::string corename = gpfPath;
+  if (corename.size() > 4)
+    corename.resize(corename.size() - 4);
+  return corename + ".gpfidx";
+}
+
+
+// true if bytes [offset, offset + length) are inside a file of size bytes,
+// without the sum that a corrupt offset could wrap
+static bool inFile(uint64_t offset, uint64_t length, uint64_t size) {
+  return offset <= size && length <= size - offset;
+}
+
+
+// The size and modification time of path, in the header's fields
+static bool stampOf(const char *path, GpfIndexHeader &header, std::string &error) {
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    error = std::string("unable to stat ") + path + ": " + strerror(errno);
+    return false;
+  }
+  header.gpfSize = (uint64_t) st.st_size;
+  header.gpfMtimeSec = (int64_t) st.st_mtim.tv_sec;
+  header.gpfMtimeNsec = (int64_t) st.st_mtim.tv_nsec;
+  return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// GpfIndexBuilder
+/////////////////////////////////////////////////////////////////////////////
+
+GpfIndexBuilder::GpfIndexBuilder(const char *base) : m_base(base), m_end(0) {
+}
+
+
+void GpfIndexBuilder::add(std::string_view pointID, std::string_view raw) {
+  uint64_t offset = (uint64_t) (raw.data() - m_base);
+  m_offset.push_back(offset);
+  m_hash.push_back(gpfHashId(pointID));
+  m_end = offset + raw.size();
+}
+
+
+void GpfIndexBuilder::add(std::string_view pointID, uint64_t offset, uint64_t end) {
+  m_offset.push_back(offset);
+  m_hash.push_back(gpfHashId(pointID));
+  m_end = end;
+}
+
+
+void GpfIndexBuilder::append(const GpfIndexBuilder &other) {
+  if (other.m_offset.empty())
+    return;
+  m_offset.insert(m_offset.end(), other.m_offset.begin(), other.m_offset.end());
+  m_hash.insert(m_hash.end(), other.m_hash.begin(), other.m_hash.end());
+  m_end = other.m_end;
+}
+
+
+bool GpfIndexBuilder::save(const char *path, const char *gpfPath, GpfLayout layout,
+                           std::string &error) const {
+  uint64_t count = m_offset.size();
+
+  GpfIndexHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, GPF_INDEX_MAGIC, sizeof(GPF_INDEX_MAGIC));
+  header.version = GPF_INDEX_VERSION;
+  header.headerSize = sizeof(header);
+  header.count = count;
+  header.layout = (uint32_t) layout;
+  header.offsetOffset = sizeof(header);
+  header.entryOffset = header.offsetOffset + (count + 1) * sizeof(uint64_t);
+  if (!stampOf(gpfPath, header, error))
+    return false;
+
+  std::vector<GpfIndexEntry> entries(count);
+  for (size_t i = 0; i < count; i++)
+    entries[i] = GpfIndexEntry{m_hash[i], i};
+  std::sort(entries.begin(), entries.end(), [](const GpfIndexEntry &a, const GpfIndexEntry &b) {
+    return a.hash < b.hash || (a.hash == b.hash && a.ordinal < b.ordinal);
+  });
+
+  GpfWriter out;
+  if (!out.open(path)) {
+    error = std::string("unable to open output point index file: ") + path;
+    return false;
+  }
+  out.preallocate(header.entryOffset + count * sizeof(GpfIndexEntry));
+  out.write(std::string_view((const char *) &header, sizeof(header)));
+  out.write(std::string_view((const char *) m_offset.data(), count * sizeof(uint64_t)));
+  out.write(std::string_view((const char *) &m_end, sizeof(m_end)));
+  out.write(std::string_view((const char *) entries.data(), count * sizeof(GpfIndexEntry)));
+  if (!out.close()) {
+    error = std::string("error writing output point index file: ") + path;
+    return false;
+  }
+  return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// GpfIndexFile
+/////////////////////////////////////////////////////////////////////////////
+
+GpfIndexFile::GpfIndexFile()
+  : m_count(0), m_layout(GpfSocetSet), m_offset(NULL), m_entry(NULL) {
+}
+
+
+bool GpfIndexFile::open(const char *path, const char *gpfPath, std::string &error) {
+  close();
+  if (!m_file.open(path)) {
+    error = std::string("unable to open point index file: ") + path;
+    return false;
+  }
+
+  GpfIndexHeader header;
+  if (m_file.size() < sizeof(header) ||
+      memcmp(m_file.data(), GPF_INDEX_MAGIC, sizeof(GPF_INDEX_MAGIC)) != 0) {
+    error = std::string("not a point index file: ") + path;
+    return false;
+  }
+  memcpy(&header, m_file.data(), sizeof(header));
+  if (header.version == __builtin_bswap32(GPF_INDEX_VERSION)) {
+    error = std::string("point index file was written on a host of the other byte order: ") + path;
+    return false;
+  }
+  if (header.version != GPF_INDEX_VERSION) {
+    error = "unsupported point index file version " + std::to_string(header.version);
+    return false;
+  }
+
+  uint64_t size = m_file.size();
+  if (header.count > size / sizeof(GpfIndexEntry) ||
+      header.offsetOffset % 8 || header.entryOffset % 8 ||
+      !inFile(header.offsetOffset, (header.count + 1) * sizeof(uint64_t), size) ||
+      !inFile(header.entryOffset, header.count * sizeof(GpfIndexEntry), size)) {
+    error = std::string("point index file is truncated or its header is corrupt: ") + path;
+    return false;
+  }
+
+  GpfIndexHeader current;
+  if (!stampOf(gpfPath, current, error))
+    return false;
+  if (current.gpfSize != header.gpfSize || current.gpfMtimeSec != header.gpfMtimeSec ||
+      current.gpfMtimeNsec != header.gpfMtimeNsec) {
+    error = std::string("point index file is out of date: ") + path;
+    return false;
+  }
+
+  m_count = header.count;
+  m_layout = (GpfLayout) header.layout;
+  m_offset = (const uint64_t *) (m_file.data() + header.offsetOffset);
+  m_entry = (const GpfIndexEntry *) (m_file.data() + header.entryOffset);
+
+  // every lookup trusts the offsets, check them once
+  for (size_t i = 0; i < m_count; i++) {
+    if (m_offset[i] >= m_offset[i+1] || m_entry[i].ordinal >= m_count) {
+      close();
+      error = std::string("point index file is corrupt: ") + path;
+      return false;
+    }
+  }
+  if (m_offset[m_count] > header.gpfSize) {
+    close();
+    error = std::string("point index file is corrupt: ") + path;
+    return false;
+  }
+  return true;
+}
+
+
+void GpfIndexFile::close() {
+  m_file.close();
+  m_count = 0;
+  m_offset = NULL;
+  m_entry = NULL;
+}
+
+
+GpfRecordRange GpfIndexFile::record(const char *gpfData, size_t ordinal) const {
+  GpfRecordRange range;
+  range.begin = gpfData + m_offset[ordinal];
+  range.end = gpfData + m_offset[ordinal + 1];
+  range.first = (int) ordinal;
+  range.count = 1;
+  range.layout = m_layout;
+  return range;
+}
+
+
+uint64_t GpfIndexFile::find(std::string_view pointID, const char *gpfData,
+                            bool *repeated) const {
+  uint64_t hash = gpfHashId(pointID);
+  const GpfIndexEntry *end = m_entry + m_count;
+  const GpfIndexEntry *e = std::lower_bound(m_entry, end, hash,
+                                            [](const GpfIndexEntry &a, uint64_t h) {
+                                              return a.hash < h;
+                                            });
+  uint64_t found = NotFound;
+  if (repeated)
+    *repeated = false;
+  for (; e < end && e->hash == hash; e++) {
+    // the ID is the first field of the record's first line
+    const char *cur = gpfData + m_offset[e->ordinal];
+    std::string_view line = gpfNextLine(cur, gpfData + m_offset[e->ordinal + 1]);
+    if (gpfNextField(line) != pointID)
+      continue;
+    if (found != NotFound) {
+      if (repeated)
+        *repeated = true;
+      break;
+    }
+    found = e->ordinal;
+    if (!repeated)
+      break;
+  }
+  return found;
+}
+
+
+bool GpfIndexFile::restamp(const char *path, const char *gpfPath, std::string &error) {
+  GpfIndexHeader header;
+  if (!stampOf(gpfPath, header, error))
+    return false;
+
+  int fd = ::open(path, O_WRONLY);
+  if (fd < 0) {
+    error = std::string("unable to open point index file: ") + path;
+    return false;
+  }
+  // gpfSize through gpfMtimeNsec are consecutive in the header
+  size_t first = offsetof(GpfIndexHeader, gpfSize);
+  size_t n = offsetof(GpfIndexHeader, offsetOffset) - first;
+  bool ok = pwrite(fd, (const char *) &header + first, n, (off_t) first) == (ssize_t) n;
+  if (::close(fd) != 0)
+    ok = false;
+  if (!ok)
+    error = std::string("error updating point index file: ") + path;
+  return ok;
+}
@@ -0,0 +1,139 @@
+#ifndef gpfIndexFile_h
+#define gpfIndexFile_h
+
+// Point index sidecar (<corename>.gpfidx) of a GPF, for going straight to
+// a record instead of scanning from the first.
+//
+// The exporter writes it with -index, from the same pass that exports the
+// tie points, and the merge the one of its tfmGPF, from the pass that
+// writes it.  It records, for every record of the GPF in file order, the
+// byte offset of its "pointID stat known" line, and a table of point ID
+// hashes (gpfHashId) sorted for binary search, each with the ordinal of
+// its record.  The IDs themselves are not stored: a lookup checks the ID
+// at the offset it found in the GPF, so a hash collision can not return
+// the wrong record.
+//
+// Layout, in the byte order of the host that wrote it and 8 byte aligned,
+// so it is used mapped (open() refuses one of the other byte order):
+//
+//   GpfIndexHeader
+//   uint64_t offset[count + 1]         of each record, then the end of the last
+//   GpfIndexEntry entry[count]         sorted by hash, then ordinal
+//
+// The header keeps the size and modification time of the GPF it was
+// built from, and open() refuses a sidecar that no longer matches, e.g.
+// after the GPF was rewritten.  Only an uncompressed GPF is indexed,
+// since the offsets are into the file on disk.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "gpfReader.h"
+
+#define GPF_INDEX_MAGIC   "GPFIDX"
+#define GPF_INDEX_VERSION 1
+
+struct GpfIndexHeader {
+  char     magic[8];           // GPF_INDEX_MAGIC, NUL padded
+  uint32_t version;            // GPF_INDEX_VERSION
+  uint32_t headerSize;         // sizeof(GpfIndexHeader)
+  uint64_t count;              // number of records
+  uint32_t layout;             // GpfLayout of the GPF
+  uint32_t reserved;
+  uint64_t gpfSize;            // the GPF the index was built from
+  int64_t  gpfMtimeSec;
+  int64_t  gpfMtimeNsec;
+  uint64_t offsetOffset;       // byte offsets of the sections
+  uint64_t entryOffset;
+};
+
+struct GpfIndexEntry {
+  uint64_t hash;
+  uint64_t ordinal;
+};
+
+// <corename>.gpfidx for gpfPath, the corename being what the exporter
+// names its outputs after (gpfPath without its .gpf)
+std::string gpfIndexPath(const std::string &gpfPath);
+
+//-----------------------------------------------------------------------
+// Collects the records of a GPF as they are parsed, and writes the
+// sidecar once they are all in
+//-----------------------------------------------------------------------
+class GpfIndexBuilder {
+ public:
+  // base is the first byte of the mapped GPF the record views point into
+  explicit GpfIndexBuilder(const char *base = NULL);
+
+  // Adds the next record, raw being its bytes (GpfPointRecord::raw)
+  void add(std::string_view pointID, std::string_view raw);
+
+  // Adds the next record of a GPF as it is written rather than mapped,
+  // the record being bytes [offset, end) of the output
+  void add(std::string_view pointID, uint64_t offset, uint64_t end);
+
+  // Appends all the records of other, the ones that follow in the file,
+  // e.g. a part parsed on another thread
+  void append(const GpfIndexBuilder &other);
+
+  size_t size() const { return m_offset.size(); }
+
+  // Writes the sidecar of the GPF at gpfPath to path.  Returns false with
+  // error set if it could not be written.
+  bool save(const char *path, const char *gpfPath, GpfLayout layout,
+            std::string &error) const;
+
+ private:
+  const char           *m_base;
+  std::vector<uint64_t> m_offset;
+  std::vector<uint64_t> m_hash;
+  uint64_t              m_end;
+};
+
+//-----------------------------------------------------------------------
+// Mapped, validated sidecar
+//-----------------------------------------------------------------------
+class GpfIndexFile {
+ public:
+  static constexpr uint64_t NotFound = ~(uint64_t) 0;
+
+  GpfIndexFile();
+
+  // Maps the sidecar at path and checks it against the GPF at gpfPath.
+  // Returns false with error set if it is missing, corrupt or out of date.
+  bool open(const char *path, const char *gpfPath, std::string &error);
+  void close();
+
+  size_t count() const { return m_count; }
+  GpfLayout layout() const { return m_layout; }
+
+  // Byte offset of record ordinal in the GPF, and of the end of the last
+  // record for ordinal == count()
+  uint64_t offset(size_t ordinal) const { return m_offset[ordinal]; }
+
+  // The record range of a single record, for GpfReader::openRange();
+  // gpfData is the mapped GPF
+  GpfRecordRange record(const char *gpfData, size_t ordinal) const;
+
+  // Ordinal of the first record of pointID in the GPF mapped at gpfData,
+  // or NotFound.  repeated, if given, is set when pointID names more than
+  // one record.
+  uint64_t find(std::string_view pointID, const char *gpfData, bool *repeated = NULL) const;
+
+  // Records the current size and modification time of the GPF at gpfPath
+  // in the sidecar at path, after the GPF was patched in place without
+  // moving any record.  Returns false with error set on failure.
+  static bool restamp(const char *path, const char *gpfPath, std::string &error);
+
+ private:
+  GpfMappedFile        m_file;
+  size_t               m_count;
+  GpfLayout            m_layout;
+  const uint64_t      *m_offset;
+  const GpfIndexEntry *m_entry;
+};
+
+#endif
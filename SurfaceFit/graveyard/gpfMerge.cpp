@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#include "gpfAsyncIO.h"
+#include "gpfCompress.h"
+#include "gpfIdSet.h"
+#include "gpfReader.h"
+#include "gpfStats.h"
+#include "gpfWriter.h"
+
+// number of records parsed together
+#define BLOCKSIZE 65536
+
+static void usage(const char *prog)
+{
+     printf ("\nrun %s as follows:\n",prog);
+     printf ("   %s [-stats] [-zthreads N] [-direct] [-fadvise] [-pipeline]\n",prog);
+     printf ("      outGPF inGPF [inGPF ...] [-list gpfList]\n");
+     printf ("\nwhere:\n");
+     printf ("  outGPF = the merged ground point file.  It is written compressed when\n");
+     printf ("           named *.gz or *.zst (on N threads for zst with -zthreads N,\n");
+     printf ("           default 0 = one per core)\n\n");
+     printf ("  inGPF = the ground point files to merge, in order, all Socet Set or all\n");
+     printf ("          Socet GXP.  They may be gzip or zstd compressed\n\n");
+     printf ("  -list gpfList = also merge the gpfs named in gpfList, one per line, after\n");
+     printf ("          the ones on the command line\n\n");
+     printf ("  -stats = print the wall time of each phase (parse, write), the bytes\n");
+     printf ("           read and written, the number of records of each stat/known\n");
+     printf ("           category written and the number of repeated points dropped\n");
+     printf ("           as one line of JSON, whose input is the inGPFs in order and\n");
+     printf ("           output is outGPF\n\n");
+     printf ("  -direct, -fadvise, -pipeline = as for gpfTies2LatLonHeightCSV_360sys\n\n");
+     printf ("  This program merges several gpfs into one, as merge_gpf.py does, but\n");
+     printf ("  streams them instead of loading them whole.  A point whose ID was\n");
+     printf ("  already written, from an earlier gpf or earlier in the same one, is a\n");
+     printf ("  repeat of that point and is dropped, the first record of each point\n");
+     printf ("  being the one kept.  The records are copied as they are; the header is\n");
+     printf ("  the title and column names of the first inGPF with the number of\n");
+     printf ("  points written.  Only the point IDs are held in memory, except that a\n");
+     printf ("  compressed inGPF is decompressed whole into memory, one at a time, in\n");
+     printf ("  each of the two passes.\n");
+     exit(1);
+}
+
+//-----------------------------------------------------------------------
+// The records of one input gpf that are written, as runs of consecutive
+// bytes of the (decompressed) file.  Runs only break at a dropped repeat,
+// so a gpf without repeats is one run.
+//-----------------------------------------------------------------------
+struct MergeRun {
+  size_t begin;
+  size_t end;
+};
+
+struct MergeInput {
+  std::string           path;
+  std::vector<MergeRun> runs;
+};
+
+// The three header lines of the merged gpf, from the first input
+struct MergeHeader {
+  bool        found;
+  GpfLayout   layout;
+  std::string title;
+  std::string columns;
+
+  MergeHeader() : found(false), layout(GpfSocetSet) {}
+};
+
+static bool sameFile(const std::string &a, const std::string &b)
+{
+  struct stat sa, sb;
+  return stat(a.c_str(),&sa) == 0 && stat(b.c_str(),&sb) == 0 &&
+         sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+//-----------------------------------------------------------------------
+// First pass over one input: keeps each record whose point ID is new to
+// ids, counting it into stats, and records the runs of kept records.
+// Returns an error message, empty on success.
+//-----------------------------------------------------------------------
+static std::string scanInput(MergeInput &input, GpfIdSet &ids, MergeHeader &header,
+                             GpfStats &stats)
+{
+  double mark = GpfStats::now();
+  GpfReader gpf;
+  if (!gpf.open(input.path.c_str())) {
+    std::string message = "unable to open input gpf file: " + input.path;
+    if (!gpf.error().empty())
+      message += "\n  " + gpf.error();
+    return message;
+  }
+
+  if (!header.found) {
+    // title and column names, the number of points comes from the merge
+    std::string_view lines = gpf.header();
+    const char *cur = lines.data();
+    const char *end = cur + lines.size();
+    header.title = std::string(gpfNextLine(cur,end));
+    gpfNextLine(cur,end);
+    header.columns = std::string(gpfNextLine(cur,end));
+    header.layout = gpf.layout();
+    header.found = true;
+  }
+  else if (gpf.layout() != header.layout)
+    return "the input gpfs mix the Socet Set and GXP layouts, " + input.path +
+           " is not like the first one";
+
+  const char *base = gpf.file().data();
+  std::vector<GpfPointRecord> block(BLOCKSIZE);
+  size_t nrec;
+  while ((nrec = gpf.nextBlock(block.data(),BLOCKSIZE)) > 0) {
+    for (size_t i=0; i<nrec; i++) {
+      const GpfPointRecord &rec = block[i];
+      if (!ids.insert(rec.pointID)) {
+        stats.duplicates++;
+        continue;
+      }
+      stats.count(rec.statValue(),rec.knownValue());
+      size_t begin = (size_t) (rec.raw.data() - base);
+      size_t end = begin + rec.raw.size();
+      if (!input.runs.empty() && input.runs.back().end == begin)
+        input.runs.back().end = end;
+      else
+        input.runs.push_back(MergeRun{begin,end});
+    }
+  }
+  if (!gpf.error().empty())
+    return input.path + ": " + gpf.error();
+
+  stats.bytesRead += gpf.fileSize();
+  stats.lap(GpfStats::Parse,mark);
+  return std::string();
+}
+
+//-----------------------------------------------------------------------
+// Second pass: copies the kept runs of one input to the merged gpf, long
+// ones file to file in the kernel.  Returns an error message, empty on
+// success.
+//-----------------------------------------------------------------------
+static std::string writeInput(const MergeInput &input, GpfWriter &out, GpfStats &stats)
+{
+  double mark = GpfStats::now();
+  GpfMappedFile gpf;
+  if (!gpf.open(input.path.c_str()))
+    return "unable to open input gpf file again: " + input.path;
+
+  for (const MergeRun &run : input.runs) {
+    if (run.end > gpf.size())
+      return "input gpf file changed during the merge: " + input.path;
+    gpf.readAhead(gpf.data() + run.begin);
+    std::string_view bytes(gpf.data() + run.begin, run.end - run.begin);
+    out.writeCopy(bytes,gpf.fd(),run.begin);
+
+    // the last record of a file may end without its blank line
+    if (run.end == gpf.size() && !gpfEndsWithBlankLine(bytes)) {
+      if (bytes.back() != '\n')
+        out.put('\n');
+      out.put('\n');
+    }
+  }
+  stats.lap(GpfStats::Write,mark);
+  return std::string();
+}
+
+int main(int argc, char *argv[])
+{
+
+  //-----------------------------------------------------------
+  // parse options, then check number of command line args and issue
+  // help if needed
+  //-----------------------------------------------------------
+  bool printStats = false;
+  int zthreads = 0;
+  GpfOutputOptions output;
+  bool pipelined = false;
+  const char *listFile = NULL;
+  std::vector<std::string> files;
+  for (int argi = 1; argi < argc; argi++) {
+    if (strcmp(argv[argi],"-stats") == 0 || strcmp(argv[argi],"--stats") == 0)
+      printStats = true;
+    else if (strcmp(argv[argi],"-zthreads") == 0 && argi+1 < argc)
+      zthreads = atoi(argv[++argi]);
+    else if (strcmp(argv[argi],"-direct") == 0)
+      output.directIO = true;
+    else if (strcmp(argv[argi],"-fadvise") == 0)
+      output.dropCache = true;
+    else if (strcmp(argv[argi],"-pipeline") == 0)
+      pipelined = true;
+    else if (strcmp(argv[argi],"-list") == 0 && argi+1 < argc)
+      listFile = argv[++argi];
+    else if (argv[argi][0] == '-' && argv[argi][1] != '\0')
+      usage(argv[0]);
+    else
+      files.push_back(argv[argi]);
+  }
+  if (files.empty() || (files.size() < 2 && !listFile) || zthreads < 0)
+    usage(argv[0]);
+  gpfSetCompressionThreads((unsigned) zthreads);
+  gpfSetOutputOptions(output);
+  gpfSetPipelined(pipelined);
+
+  std::string outFile = files[0];
+  std::vector<MergeInput> inputs;
+  for (size_t f=1; f<files.size(); f++)
+    inputs.push_back(MergeInput{files[f],std::vector<MergeRun>()});
+
+  if (listFile) {
+    GpfLineReader list;
+    if (!list.open(listFile)) {
+      printf ("unable to open list file of input gpfs: %s\n",listFile);
+      exit (1);
+    }
+    std::string_view line;
+    while (list.next(line)) {
+      std::string_view path = gpfNextToken(line);
+      if (!path.empty())
+        inputs.push_back(MergeInput{std::string(path),std::vector<MergeRun>()});
+    }
+  }
+  if (inputs.empty()) {
+    printf ("no input gpf files to merge\n");
+    exit (1);
+  }
+  for (const MergeInput &input : inputs) {
+    if (sameFile(input.path,outFile)) {
+      printf ("the output gpf file is also an input: %s\n",outFile.c_str());
+      exit (1);
+    }
+  }
+
+  GpfStats stats;
+  stats.deduplicated = true;
+  double start = GpfStats::now();
+
+  //------------------------------------------------
+  // first pass: the point IDs of every input, in
+  // order, keeping the first record of each point
+  //------------------------------------------------
+
+  GpfIdSet ids;
+  MergeHeader header;
+  for (MergeInput &input : inputs) {
+    std::string error = scanInput(input,ids,header,stats);
+    if (!error.empty()) {
+      printf ("%s\n",error.c_str());
+      exit (1);
+    }
+  }
+  if (stats.records > (uint64_t) INT_MAX) {
+    printf ("the merged gpf would have %llu points, more than a gpf header can hold\n",
+            (unsigned long long) stats.records);
+    exit (1);
+  }
+
+  //------------------------------------------------
+  // second pass: the header, then the kept records
+  //------------------------------------------------
+
+  GpfWriter out;
+  if (!out.open(outFile.c_str())) {
+    printf ("unable to open output merged gpf file: %s\n",outFile.c_str());
+    if (!out.error().empty())
+      printf ("  %s\n",out.error().c_str());
+    exit (1);
+  }
+  // the merge is at most the size of its inputs
+  if (gpfCompressionOf(outFile.c_str()) == GpfUncompressed)
+    out.preallocate(stats.bytesRead);
+
+  out.write(header.title);
+  out.putInt((int) stats.records);
+  out.put('\n');
+  out.write(header.columns);
+  for (const MergeInput &input : inputs) {
+    std::string error = writeInput(input,out,stats);
+    if (!error.empty()) {
+      printf ("%s\n",error.c_str());
+      exit (1);
+    }
+  }
+
+  double mark = GpfStats::now();
+  if (!out.close()) {
+    printf ("error writing output merged gpf file: %s\n",outFile.c_str());
+    exit (1);
+  }
+  stats.lap(GpfStats::Write,mark);
+  stats.bytesWritten = out.bytesWritten();
+  stats.wallSeconds = GpfStats::now() - start;
+  stats.output = outFile;
+
+  if (printStats) {
+    // the inputs in merge order, as they would be given on the command line
+    std::string inputList;
+    for (const MergeInput &input : inputs)
+      inputList += (inputList.empty() ? "" : " ") + input.path;
+    printf ("%s\n",stats.json("gpfMerge",inputList,"ties").c_str());
+  }
+  return 0;
+
+} // end of program
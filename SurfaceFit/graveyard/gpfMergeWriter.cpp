@@ -0,0 +1,234 @@
+#include "gpfMergeWriter.h"
+
+#include "gpfConvert.h"
+
+static const char *LegacyColumns =
+  "point_id,stat,known,lat_Y_North,long_X_East,ht,sig(3),res(3)\n";
+
+
+// The four lines after "pointID stat known" of a GXP record, in the
+// Socet Set layout
+static void writeLegacyBody(GpfWriter &tfmgpf, const GpfPointRecord &rec) {
+  double ddLat = gpfToDouble(rec.lat);
+  double ddLon = gpfToDouble(rec.lon);
+  double radLat, radLon180;
+  gpfDegrees360ToRadians(1, &ddLat, &ddLon, &radLat, &radLon180);
+
+  tfmgpf.putFixed(radLat,14);
+  tfmgpf.write("         ");
+  tfmgpf.putFixed(radLon180,14);
+  tfmgpf.write("         ");
+  tfmgpf.write(rec.height);
+  tfmgpf.write("    \n");
+  for (int j = 0; j < 3; j++) {
+    tfmgpf.write(rec.sigma[j]);
+    tfmgpf.put(j < 2 ? ' ' : '\n');
+  }
+  for (int j = 0; j < 3; j++) {
+    tfmgpf.write(rec.residual[j]);
+    tfmgpf.put(j < 2 ? ' ' : '\n');
+  }
+  tfmgpf.put('\n');
+}
+
+
+static void writeHeaderLine(GpfWriter &tfmgpf, const GpfPointRecord &rec, int stat,
+                            int known) {
+  tfmgpf.write(rec.pointID);
+  tfmgpf.put(' ');
+  tfmgpf.putInt(stat);
+  tfmgpf.put(' ');
+  tfmgpf.putInt(known);
+  tfmgpf.put('\n');
+}
+
+
+//-----------------------------------------------------------------------
+// The verbatim parts of consecutive records (all of an inactive tie, the
+// body of a control point) mostly follow each other in the mapped gpf.
+// They are gathered into runs and each run goes out with one write, or
+// one copy_file_range from the gpf when it is long and source is given.
+//-----------------------------------------------------------------------
+class VerbatimRuns {
+ public:
+  VerbatimRuns(GpfWriter &tfmgpf, const GpfMappedFile *source)
+    : m_tfmgpf(tfmgpf), m_source(source), m_begin(NULL), m_end(NULL) {}
+  ~VerbatimRuns() { flush(); }
+
+  void add(std::string_view bytes) {
+    if (bytes.data() != m_end) {
+      flush();
+      m_begin = bytes.data();
+    }
+    m_end = bytes.data() + bytes.size();
+  }
+
+  // Bytes gathered that are not written yet
+  size_t pending() const { return (size_t) (m_end - m_begin); }
+
+  // Writes the run so far, before anything that is not verbatim
+  void flush() {
+    if (m_begin == m_end)
+      return;
+    std::string_view run(m_begin, m_end - m_begin);
+    if (m_source && m_begin >= m_source->data() &&
+        m_end <= m_source->data() + m_source->size())
+      m_tfmgpf.writeCopy(run, m_source->fd(), m_begin - m_source->data());
+    else
+      m_tfmgpf.write(run);
+    m_begin = m_end = NULL;
+  }
+
+ private:
+  GpfWriter           &m_tfmgpf;
+  const GpfMappedFile *m_source;
+  const char          *m_begin;
+  const char          *m_end;
+};
+
+
+// Change a non-tie point to tie point in the tfm GPF
+static void writeAsTie(GpfWriter &tfmgpf, VerbatimRuns &runs, const GpfPointRecord &rec,
+                       int stat, GpfLayout layout) {
+  runs.flush();
+  if (layout == GpfGxp) {
+    writeHeaderLine(tfmgpf,rec,stat,0);
+    writeLegacyBody(tfmgpf,rec);
+    return;
+  }
+  tfmgpf.write(rec.pointID);
+  tfmgpf.put(' ');
+  tfmgpf.putInt(stat);
+  tfmgpf.write(" 0\n");
+  runs.add(rec.body);
+}
+
+
+// Write a transformed point as XYZ control, with default weights and
+// zero residuals
+static void writeAsControl(GpfWriter &tfmgpf, const GpfPointRecord &rec, int stat,
+                           double radLat, double radLon180) {
+  tfmgpf.write(rec.pointID);
+  tfmgpf.put(' ');
+  tfmgpf.putInt(stat);
+  tfmgpf.write(" 3\n");
+  tfmgpf.putFixed(radLat,14);
+  tfmgpf.write("    ");
+  tfmgpf.putFixed(radLon180,14);
+  tfmgpf.write("    ");
+}
+
+
+static void writeControlTail(GpfWriter &tfmgpf) {
+  tfmgpf.write("\n1.0 1.0 1.0\n0.0 0.0 0.0\n\n");
+}
+
+
+void gpfWriteMergedHeader(GpfWriter &tfmgpf, const GpfReader &origgpf) {
+  std::string_view header = origgpf.header();
+  if (origgpf.layout() != GpfGxp) {
+    tfmgpf.write(header);
+    return;
+  }
+  // title and number of points as they are, Socet Set column names
+  const char *cur = header.data();
+  const char *end = cur + header.size();
+  gpfNextLine(cur,end);
+  gpfNextLine(cur,end);
+  tfmgpf.write(std::string_view(header.data(),cur - header.data()));
+  tfmgpf.write(LegacyColumns);
+}
+
+
+void gpfWriteMergedBlock(GpfWriter &tfmgpf, const GpfPointRecord *block, size_t nrec,
+                         const GpfTieCoords &ties, GpfLayout layout, GpfStats &stats,
+                         const GpfMappedFile *source, GpfIndexBuilder *index) {
+  double mark = GpfStats::now();
+  double written = tfmgpf.writeSeconds();
+
+  VerbatimRuns runs(tfmgpf,source);
+  size_t t = 0;
+  for (size_t i=0; i<nrec; i++) {
+    const GpfPointRecord &rec = block[i];
+    int stat = rec.statValue();
+    int known = rec.knownValue();
+    stats.count(stat,known);
+    uint64_t begin = index ? tfmgpf.position() + runs.pending() : 0;
+
+    if (known > 0) {
+      // Change a non-tie point to tie point in the tfm GPF
+      // regardless if it was used or not
+      writeAsTie(tfmgpf,runs,rec,stat,layout);
+    }
+
+    if (stat == 0 && known == 0) {
+      // This is a tie point that was off in the original GPF
+      // so just copy it into the trm GPF
+      if (layout == GpfGxp) {
+        writeHeaderLine(tfmgpf,rec,stat,known);
+        writeLegacyBody(tfmgpf,rec);
+      }
+      else
+        runs.add(rec.raw);
+    }
+
+    if (stat == 1 && known == 0) {
+      // This point was transformed.  Make it an XYZ control point
+      // in the GPF file, and output coordinate, weights and residuals
+      runs.flush();
+      writeAsControl(tfmgpf,rec,stat,ties.radLat[t],ties.radLon180[t]);
+      if (ties.textHeights) {
+        size_t begin = t ? ties.heightEnd[t-1] : 0;
+        tfmgpf.write(std::string_view(ties.heightText).substr(begin,ties.heightEnd[t]-begin));
+      }
+      else
+        tfmgpf.putFixed(ties.height[t],14);
+      writeControlTail(tfmgpf);
+      t++;
+    }
+    if (index)
+      index->add(rec.pointID,begin,tfmgpf.position() + runs.pending());
+  }
+  runs.flush();
+
+  stats.lap(GpfStats::Format,mark);
+  written = tfmgpf.writeSeconds() - written;
+  stats.seconds[GpfStats::Format] -= written;
+  stats.seconds[GpfStats::Write] += written;
+}
+
+
+size_t gpfCountTies(const GpfPointRecord *block, size_t nrec) {
+  size_t n = 0;
+  for (size_t i=0; i<nrec; i++)
+    if (block[i].statValue() == 1 && block[i].knownValue() == 0)
+      n++;
+  return n;
+}
+
+
+bool gpfReadCsvTies(GpfLineReader &csv, size_t n, std::vector<double> &ddLat,
+                    std::vector<double> &ddLon360, GpfTieCoords &ties,
+                    const GpfCsvFormat &format) {
+  bool complete = true;
+  gpfWithCsvLayout(format, [&](auto layout) {
+    typedef decltype(layout) Layout;
+    for (size_t t=0; t<n; t++) {
+      // get transformed coordinate string, fields are separated by commas
+      // and/or spaces
+      std::string_view csvLine;
+      if (!csv.next(csvLine)) {
+        complete = false;
+        return;
+      }
+      std::string_view valLat, valLon360, Height;
+      Layout::split(csvLine, valLat, valLon360, Height);
+
+      ddLat.push_back(gpfToDouble(valLat));
+      ddLon360.push_back(gpfToDouble(valLon360));
+      ties.heightText.append(Height.data(),Height.size());
+      ties.heightEnd.push_back(ties.heightText.size());
+    }
+  });
+  return complete;
+}
@@ -0,0 +1,77 @@
+#ifndef gpfMergeWriter_h
+#define gpfMergeWriter_h
+
+// Output records of a merged (transformed) GPF, shared by
+// mergeTransformedGPFties and the resident gpfServer.
+//
+// Every record of the original GPF is written in its original order:
+//
+//   known > 0               -> "pointID stat 0" and the body, as a tie point
+//   stat == 0 && known == 0 -> the record verbatim
+//   stat == 1 && known == 0 -> "pointID stat 3", the transformed
+//                              coordinate, sigmas 1.0 and residuals 0.0
+//
+// A GXP input is written out in the legacy Socet Set layout, as
+// gpf_transform.py --gxp does: the column names are the Socet Set ones,
+// the records that are passed through get their angles converted to
+// radians, and any GXP lines after the residuals are dropped.
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "gpfCsvFormat.h"
+#include "gpfIndexFile.h"
+#include "gpfReader.h"
+#include "gpfStats.h"
+#include "gpfWriter.h"
+
+//-----------------------------------------------------------------------
+// Transformed coordinates for the active tie points of one block of
+// records, in record order.  Heights read from a csv are passed through
+// as text, exactly as they were written.
+//-----------------------------------------------------------------------
+struct GpfTieCoords {
+  std::vector<double> radLat, radLon180, height;
+  std::string         heightText;
+  std::vector<size_t> heightEnd;
+  bool                textHeights;
+
+  void clear()
+  {
+    radLat.clear(); radLon180.clear(); height.clear();
+    heightText.clear(); heightEnd.clear();
+  }
+};
+
+// Number of active tie points (stat 1, known 0) among the records
+size_t gpfCountTies(const GpfPointRecord *block, size_t nrec);
+
+// Reads the next n lines of a transformed csv ("lat,lon360,height", or
+// the columns of format, commas and/or spaces between fields), appending
+// the degrees to ddLat and ddLon360 and the height text to ties.  Returns
+// false if the csv ends first.
+bool gpfReadCsvTies(GpfLineReader &csv, size_t n, std::vector<double> &ddLat,
+                    std::vector<double> &ddLon360, GpfTieCoords &ties,
+                    const GpfCsvFormat &format = GpfCsvFormat());
+
+// Writes the three header lines of the merged gpf
+void gpfWriteMergedHeader(GpfWriter &tfmgpf, const GpfReader &origgpf);
+
+// Writes one block of records read from a gpf of the given layout,
+// counting them into stats.  ties holds one coordinate per active tie
+// point of the block.  The time spent flushing tfmgpf on the way is
+// counted as writing rather than formatting.
+//
+// Only the transformed records and the rewritten "pointID stat 0" lines
+// of control points are formatted; the rest is passed through in runs of
+// consecutive verbatim bytes, one write each.  With source, the mapped gpf
+// the records are views of, a long run is copied from it in the kernel
+// (GpfWriter::writeCopy).  With index, each record is added to it at its
+// offset in tfmgpf, for the .gpfidx sidecar of the merged gpf.
+void gpfWriteMergedBlock(GpfWriter &tfmgpf, const GpfPointRecord *block, size_t nrec,
+                         const GpfTieCoords &ties, GpfLayout layout, GpfStats &stats,
+                         const GpfMappedFile *source = NULL,
+                         GpfIndexBuilder *index = NULL);
+
+#endif
@@ -0,0 +1,123 @@
+#include "gpfPatch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gpfWriter.h"
+
+
+void GpfPatchSet::add(size_t offset, size_t length, std::string_view text) {
+  Patch patch;
+  patch.offset = offset;
+  patch.length = length;
+  patch.textBegin = m_text.size();
+  m_text.append(text.data(), text.size());
+  patch.textEnd = m_text.size();
+  m_patches.push_back(patch);
+}
+
+
+void GpfPatchSet::clear() {
+  m_patches.clear();
+  m_text.clear();
+}
+
+
+bool GpfPatchSet::fitsInPlace() const {
+  for (const Patch &p : m_patches) {
+    if (p.textEnd - p.textBegin > p.length)
+      return false;
+  }
+  return true;
+}
+
+
+bool GpfPatchSet::apply(const char *path, const char *data, size_t size,
+                        size_t &bytesWritten, std::string &error) const {
+  bytesWritten = 0;
+  if (m_patches.empty())
+    return true;
+  if (fitsInPlace())
+    return applyInPlace(path, bytesWritten, error);
+  return applyCopy(path, data, size, bytesWritten, error);
+}
+
+
+bool GpfPatchSet::applyInPlace(const char *path, size_t &bytesWritten,
+                               std::string &error) const {
+  int fd = ::open(path, O_WRONLY);
+  if (fd < 0) {
+    error = std::string("unable to open for update: ") + strerror(errno);
+    return false;
+  }
+
+  std::string padded;
+  for (const Patch &p : m_patches) {
+    padded.assign(m_text, p.textBegin, p.textEnd - p.textBegin);
+    padded.resize(p.length, ' ');
+
+    const char *cur = padded.data();
+    size_t left = padded.size();
+    off_t offset = (off_t) p.offset;
+    while (left > 0) {
+      ssize_t n = pwrite(fd, cur, left, offset);
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        error = std::string("write failed: ") + strerror(errno);
+        ::close(fd);
+        return false;
+      }
+      cur += n;
+      offset += n;
+      left -= (size_t) n;
+    }
+    bytesWritten += padded.size();
+  }
+
+  if (::close(fd) != 0) {
+    error = std::string("write failed: ") + strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+
+bool GpfPatchSet::applyCopy(const char *path, const char *data, size_t size,
+                            size_t &bytesWritten, std::string &error) const {
+  std::string tmpPath = std::string(path) + ".patch.tmp";
+  GpfWriter out;
+  if (!out.open(tmpPath.c_str())) {
+    error = "unable to create " + tmpPath;
+    return false;
+  }
+
+  size_t done = 0;
+  for (const Patch &p : m_patches) {
+    out.write(std::string_view(data + done, p.offset - done));
+    out.write(std::string_view(m_text.data() + p.textBegin, p.textEnd - p.textBegin));
+    done = p.offset + p.length;
+  }
+  out.write(std::string_view(data + done, size - done));
+
+  bool ok = out.close();
+  bytesWritten = out.bytesWritten();
+
+  // keep the permissions of the file being replaced
+  struct stat st;
+  if (ok && stat(path, &st) == 0)
+    chmod(tmpPath.c_str(), st.st_mode & 07777);
+
+  if (!ok || rename(tmpPath.c_str(), path) != 0) {
+    error = ok ? std::string("unable to replace the file: ") + strerror(errno)
+               : "error writing " + tmpPath;
+    unlink(tmpPath.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,58 @@
+#ifndef gpfPatch_h
+#define gpfPatch_h
+
+// Byte range patches to a file written earlier, for updating a few
+// records of a large GPF without writing all of it again.
+//
+// Each patch replaces a span of the current file with new text.  When
+// every replacement fits in the span it replaces, the file is patched in
+// place, one pwrite(2) per patch, and a shorter replacement is padded
+// with spaces to the length of its span; callers replace spans that end
+// a whitespace separated line, where the padding reads as trailing
+// blanks.  Otherwise a patched copy is written next to the file, the
+// untouched runs copied straight from the mapped original, and renamed
+// over it, so the file is never seen half written.
+
+#include <stddef.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class GpfPatchSet {
+ public:
+  // Replaces bytes [offset, offset + length) of the file with text.
+  // Patches must be added in file order and must not overlap.
+  void add(size_t offset, size_t length, std::string_view text);
+
+  size_t size() const { return m_patches.size(); }
+  void clear();
+
+  // true if every replacement fits in its span, i.e. apply() will patch
+  // the file in place
+  bool fitsInPlace() const;
+
+  // Applies the patches to path, whose current contents are the size
+  // bytes at data (its mapping).  bytesWritten is set to the bytes
+  // written to the file or its replacement.  Returns false with error set
+  // if the file could not be updated, leaving it unchanged in the copy
+  // case.
+  bool apply(const char *path, const char *data, size_t size,
+             size_t &bytesWritten, std::string &error) const;
+
+ private:
+  struct Patch {
+    size_t offset;
+    size_t length;
+    size_t textBegin;    // into m_text
+    size_t textEnd;
+  };
+
+  bool applyInPlace(const char *path, size_t &bytesWritten, std::string &error) const;
+  bool applyCopy(const char *path, const char *data, size_t size,
+                 size_t &bytesWritten, std::string &error) const;
+
+  std::vector<Patch> m_patches;
+  std::string        m_text;
+};
+
+#endif
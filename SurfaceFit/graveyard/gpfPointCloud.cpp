@@ -0,0 +1,194 @@
+#include "gpfPointCloud.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <string_view>
+
+#include "gpfWriter.h"
+
+// TIFF field types and tags used below
+enum {
+  TiffShort = 3, TiffLong = 4, TiffLong8 = 16
+};
+
+enum {
+  TagImageWidth = 256, TagImageLength = 257, TagBitsPerSample = 258,
+  TagCompression = 259, TagPhotometric = 262, TagStripOffsets = 273,
+  TagSamplesPerPixel = 277, TagRowsPerStrip = 278, TagStripByteCounts = 279,
+  TagPlanarConfig = 284, TagExtraSamples = 338, TagSampleFormat = 339
+};
+
+static const uint64_t PixelBytes = 3 * sizeof(double);
+
+// strips of about this many bytes, rather than one strip for the image
+static const uint64_t StripTarget = 1 << 20;
+
+// The file is in host byte order, which the TIFF header declares ("II" or
+// "MM"), so the samples are written as they are in memory
+static constexpr bool BigEndianHost = (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__);
+
+// Appends the low size bytes of value in host byte order
+static void putTiff(std::string &out, uint64_t value, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    size_t shift = BigEndianHost ? size - 1 - i : i;
+    out.push_back((char) (value >> (8 * shift)));
+  }
+}
+
+
+//-----------------------------------------------------------------------
+// Builds the image file directory of a classic TIFF or a BigTIFF.  Values
+// that do not fit in an entry go to an area right after the directory.
+//-----------------------------------------------------------------------
+namespace {
+
+class TiffDirectory {
+ public:
+  TiffDirectory(bool big, uint64_t offset, size_t nentries)
+    : m_big(big) {
+    m_dataOffset = offset + (big ? 8 + 20 * nentries + 8 : 2 + 12 * nentries + 4);
+    if (big)
+      putTiff(m_entries, (uint64_t) nentries, 8);
+    else
+      putTiff(m_entries, (uint64_t) nentries, 2);
+  }
+
+  // Entries must be added in ascending tag order
+  void add(uint16_t tag, uint16_t type, const std::vector<uint64_t> &values) {
+    size_t size = (type == TiffShort) ? 2 : (type == TiffLong) ? 4 : 8;
+    std::string bytes;
+    for (uint64_t v : values)
+      putTiff(bytes, v, size);
+
+    putTiff(m_entries, tag, 2);
+    putTiff(m_entries, type, 2);
+    putTiff(m_entries, values.size(), m_big ? 8 : 4);
+    size_t inlineSize = m_big ? 8 : 4;
+    if (bytes.size() <= inlineSize) {
+      bytes.resize(inlineSize, '\0');
+      m_entries += bytes;
+    }
+    else {
+      putTiff(m_entries, m_dataOffset + m_data.size(), inlineSize);
+      m_data += bytes;
+      m_data.resize((m_data.size() + 7) & ~(size_t) 7, '\0');
+    }
+  }
+
+  // The directory and its out of line values, with no next directory
+  std::string bytes() const {
+    std::string out = m_entries;
+    putTiff(out, 0, m_big ? 8 : 4);
+    return out + m_data;
+  }
+
+ private:
+  bool        m_big;
+  uint64_t    m_dataOffset;
+  std::string m_entries;
+  std::string m_data;
+};
+
+}
+
+
+GpfPointCloudWriter::GpfPointCloudWriter(const GpfDatum &datum) : m_datum(datum) {
+}
+
+
+void GpfPointCloudWriter::add(size_t n, const double *x, const double *y,
+                              const double *z) {
+  size_t base = m_xyz.size();
+  m_xyz.resize(base + 3 * n);
+  double *p = m_xyz.data() + base;
+  for (size_t i = 0; i < n; i++) {
+    p[3*i] = x[i];
+    p[3*i+1] = y[i];
+    p[3*i+2] = z[i];
+  }
+}
+
+
+void GpfPointCloudWriter::addGeodetic(size_t n, const double *lat,
+                                      const double *lon, const double *height) {
+  m_x.resize(n);
+  m_y.resize(n);
+  m_z.resize(n);
+  gpfGeodeticToEcef(m_datum, n, lat, lon, height, m_x.data(), m_y.data(), m_z.data());
+  add(n, m_x.data(), m_y.data(), m_z.data());
+}
+
+
+void GpfPointCloudWriter::append(const GpfPointCloudWriter &other) {
+  m_xyz.insert(m_xyz.end(), other.m_xyz.begin(), other.m_xyz.end());
+}
+
+
+bool GpfPointCloudWriter::save(const char *path) const {
+  GpfWriter out;
+  if (!out.open(path))
+    return false;
+  save(out);
+  return out.close();
+}
+
+
+void GpfPointCloudWriter::save(GpfWriter &out) const {
+  // an empty cloud is a single no data pixel, TIFF has no empty images
+  uint64_t count = size();
+  uint64_t width = count < GPF_CLOUD_WIDTH ? (count ? count : 1) : GPF_CLOUD_WIDTH;
+  uint64_t height = count ? (count + width - 1) / width : 1;
+  uint64_t rowBytes = width * PixelBytes;
+  uint64_t rowsPerStrip = rowBytes < StripTarget ? StripTarget / rowBytes : 1;
+  if (rowsPerStrip > height)
+    rowsPerStrip = height;
+  uint64_t nstrips = (height + rowsPerStrip - 1) / rowsPerStrip;
+  uint64_t imageBytes = height * rowBytes;
+
+  // the directory and strip tables come to well under 64 bytes a strip
+  bool big = 16 + imageBytes + 64 * (nstrips + 4) > 0xffffffffULL;
+  uint64_t headerSize = big ? 16 : 8;
+  uint64_t ifdOffset = headerSize + imageBytes;
+
+  std::vector<uint64_t> offsets(nstrips), counts(nstrips);
+  for (uint64_t s = 0; s < nstrips; s++) {
+    uint64_t rows = (s + 1 < nstrips) ? rowsPerStrip : height - s * rowsPerStrip;
+    offsets[s] = headerSize + s * rowsPerStrip * rowBytes;
+    counts[s] = rows * rowBytes;
+  }
+
+  TiffDirectory ifd(big, ifdOffset, 12);
+  uint16_t longType = big ? TiffLong8 : TiffLong;
+  ifd.add(TagImageWidth, TiffLong, {width});
+  ifd.add(TagImageLength, TiffLong, {height});
+  ifd.add(TagBitsPerSample, TiffShort, {64, 64, 64});
+  ifd.add(TagCompression, TiffShort, {1});        // none
+  ifd.add(TagPhotometric, TiffShort, {1});        // min is black
+  ifd.add(TagStripOffsets, longType, offsets);
+  ifd.add(TagSamplesPerPixel, TiffShort, {3});
+  ifd.add(TagRowsPerStrip, TiffLong, {rowsPerStrip});
+  ifd.add(TagStripByteCounts, longType, counts);
+  ifd.add(TagPlanarConfig, TiffShort, {1});       // xyz interleaved
+  ifd.add(TagExtraSamples, TiffShort, {0, 0});    // y, z unspecified
+  ifd.add(TagSampleFormat, TiffShort, {3, 3, 3}); // IEEE floating point
+
+  // byte order, 42 (43 and offset size 8, 0 for a BigTIFF), first directory
+  std::string header(BigEndianHost ? "MM" : "II");
+  if (big) {
+    putTiff(header, 43, 2);
+    putTiff(header, 8, 2);
+    putTiff(header, 0, 2);
+    putTiff(header, ifdOffset, 8);
+  }
+  else {
+    putTiff(header, 42, 2);
+    putTiff(header, ifdOffset, 4);
+  }
+  out.write(header);
+
+  out.write(std::string_view((const char *) m_xyz.data(), m_xyz.size() * sizeof(double)));
+  out.write(std::string((width * height - count) * PixelBytes, '\0'));
+  out.write(ifd.bytes());
+}
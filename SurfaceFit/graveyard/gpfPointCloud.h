@@ -0,0 +1,56 @@
+#ifndef gpfPointCloud_h
+#define gpfPointCloud_h
+
+// ECEF point cloud output (*.tiePoints.tif) in the layout of the
+// *-PC.tif clouds that the ASP stereo tools write and pc_align reads: an
+// uncompressed TIFF with three float64 samples (x, y, z in meters) per
+// pixel and no georeference, in the byte order of the host, which the
+// header declares (little-endian on x86 and aarch64).  The points fill the image row
+// by row, GPF_CLOUD_WIDTH to a row, in export order, so pixel i is the
+// point on line i of the .tiePointIds.txt list.  The unused pixels at the
+// end of the last row are 0,0,0, which ASP treats as no data.
+//
+// A cloud that would not fit in the 4 GB a classic TIFF can address is
+// written as a BigTIFF, which GDAL (and so pc_align) reads the same way.
+
+#include <stddef.h>
+#include <vector>
+
+#include "gpfConvert.h"
+
+#define GPF_CLOUD_WIDTH 1024
+
+class GpfWriter;
+
+//-----------------------------------------------------------------------
+// Collects points in memory and writes the file in one go, since the
+// size of the image is not known until the export is done
+//-----------------------------------------------------------------------
+class GpfPointCloudWriter {
+ public:
+  explicit GpfPointCloudWriter(const GpfDatum &datum = GpfDatum::mars());
+
+  void add(size_t n, const double *x, const double *y, const double *z);
+
+  // Converts a block of geodetic points (radians, meters above the datum)
+  // to ECEF on the datum and adds them
+  void addGeodetic(size_t n, const double *lat, const double *lon,
+                   const double *height);
+
+  // Appends all the points of other, e.g. a part exported on another thread
+  void append(const GpfPointCloudWriter &other);
+
+  size_t size() const { return m_xyz.size() / 3; }
+
+  bool save(const char *path) const;
+
+  // Writes the file to out, which the caller opened and closes
+  void save(GpfWriter &out) const;
+
+ private:
+  GpfDatum            m_datum;
+  std::vector<double> m_xyz;   // interleaved, as the pixels are stored
+  std::vector<double> m_x, m_y, m_z;
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include "gpfPointIndex.h"
+
+#include <string.h>
+
+
+// Reads the ID eight bytes at a time and mixes each word in with a
+// multiply/rotate, then finishes with the murmur3 avalanche
+uint64_t gpfHashId(std::string_view id) {
+  const uint64_t k = 0x9e3779b97f4a7c15ull;
+  const char *p = id.data();
+  size_t n = id.size();
+  uint64_t h = n * k;
+
+  while (n >= 8) {
+    uint64_t w;
+    memcpy(&w, p, 8);
+    h = (h ^ (w * k)) * k;
+    h = (h << 29) | (h >> 35);
+    p += 8;
+    n -= 8;
+  }
+  if (n > 0) {
+    uint64_t w = 0;
+    memcpy(&w, p, n);
+    h = (h ^ (w * k)) * k;
+  }
+
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h ? h : 1;
+}
+
+
+GpfPointIndex::GpfPointIndex() : m_mask(0), m_size(0) {
+}
+
+
+void GpfPointIndex::reserve(size_t n) {
+  size_t capacity = 16;
+  while (capacity < 2 * n)
+    capacity <<= 1;
+  if (capacity > m_slots.size())
+    rehash(capacity);
+}
+
+
+void GpfPointIndex::clear() {
+  m_slots.clear();
+  m_mask = 0;
+  m_size = 0;
+}
+
+
+void GpfPointIndex::rehash(size_t capacity) {
+  std::vector<Slot> old;
+  old.swap(m_slots);
+  m_slots.assign(capacity, Slot{0, std::string_view(), 0});
+  m_mask = capacity - 1;
+  for (const Slot &s : old) {
+    if (s.hash == 0)
+      continue;
+    size_t i = s.hash & m_mask;
+    while (m_slots[i].hash != 0)
+      i = (i + 1) & m_mask;
+    m_slots[i] = s;
+  }
+}
+
+
+bool GpfPointIndex::insert(std::string_view id, uint32_t value) {
+  if (2 * (m_size + 1) > m_slots.size())
+    rehash(m_slots.empty() ? 16 : 2 * m_slots.size());
+
+  uint64_t h = gpfHashId(id);
+  size_t i = h & m_mask;
+  while (m_slots[i].hash != 0) {
+    if (m_slots[i].hash == h && m_slots[i].id == id)
+      return false;
+    i = (i + 1) & m_mask;
+  }
+  m_slots[i] = Slot{h, id, value};
+  m_size++;
+  return true;
+}
+
+
+uint32_t GpfPointIndex::find(std::string_view id) const {
+  if (m_size == 0)
+    return NotFound;
+
+  uint64_t h = gpfHashId(id);
+  size_t i = h & m_mask;
+  while (m_slots[i].hash != 0) {
+    if (m_slots[i].hash == h && m_slots[i].id == id)
+      return m_slots[i].value;
+    i = (i + 1) & m_mask;
+  }
+  return NotFound;
+}
@@ -0,0 +1,52 @@
+#ifndef gpfPointIndex_h
+#define gpfPointIndex_h
+
+// Open-addressing hash index from point ID to a 32-bit value (typically a
+// row or record number).
+//
+// Keys are views, the index does not copy the IDs, so whatever they point
+// into (usually a mapped file) has to outlive the index.  Linear probing
+// over a power of two table kept at most half full.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+#include <vector>
+
+class GpfPointIndex {
+ public:
+  static constexpr uint32_t NotFound = 0xffffffffu;
+
+  GpfPointIndex();
+
+  // Sizes the table for n IDs so inserting them never rehashes
+  void reserve(size_t n);
+
+  // Adds id -> value.  Returns false, leaving the index unchanged, if id
+  // is already present.
+  bool insert(std::string_view id, uint32_t value);
+
+  // Returns the value stored for id, or NotFound
+  uint32_t find(std::string_view id) const;
+
+  size_t size() const { return m_size; }
+  void clear();
+
+ private:
+  struct Slot {
+    uint64_t         hash;   // 0 marks an empty slot
+    std::string_view id;
+    uint32_t         value;
+  };
+
+  void rehash(size_t capacity);
+
+  std::vector<Slot> m_slots;
+  size_t            m_mask;
+  size_t            m_size;
+};
+
+// 64-bit hash of a point ID, never 0
+uint64_t gpfHashId(std::string_view id);
+
+#endif
@@ -0,0 +1,320 @@
+#include "gpfPointTable.h"
+
+#include <algorithm>
+#include <charconv>
+
+#include "gpfConvert.h"
+#include "gpfReader.h"
+#include "gpfWriter.h"
+
+// number of records parsed and converted together, as in the tools
+static const size_t BlockSize = 65536;
+
+// column names of a Socet Set GPF, written for a table loaded from GXP
+static const char *LegacyColumns =
+  "point_id,stat,known,lat_Y_North,long_X_East,ht,sig(3),res(3)";
+
+
+GpfPointTable::GpfPointTable()
+  : m_columns(LegacyColumns), m_domain(Radians180), m_indexed(false) {
+}
+
+
+void GpfPointTable::clear() {
+  m_arena.clear();
+  m_title.clear();
+  m_columns = LegacyColumns;
+  m_domain = Radians180;
+  m_id.clear();
+  m_stat.clear();
+  m_known.clear();
+  m_lat.clear();
+  m_lon.clear();
+  m_height.clear();
+  for (int j = 0; j < 3; j++) {
+    m_sigma[j].clear();
+    m_residual[j].clear();
+  }
+  m_index.clear();
+  m_indexed = false;
+  m_error.clear();
+}
+
+
+// The line without its newline (or CR LF)
+static std::string_view chomp(std::string_view line) {
+  while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+    line.remove_suffix(1);
+  return line;
+}
+
+
+bool GpfPointTable::load(const char *path) {
+  clear();
+
+  GpfReader gpf;
+  if (!gpf.open(path)) {
+    m_error = "unable to open input gpf file: " + std::string(path);
+    if (!gpf.error().empty())
+      m_error += ": " + gpf.error();
+    return false;
+  }
+
+  const char *cur = gpf.header().data();
+  const char *end = cur + gpf.header().size();
+  m_title = std::string(chomp(gpfNextLine(cur, end)));
+  gpfNextLine(cur, end);
+  std::string_view columns = chomp(gpfNextLine(cur, end));
+  bool gxp = (gpf.layout() == GpfGxp);
+  if (!gxp)
+    m_columns = std::string(columns);
+
+  size_t npts = (size_t) gpf.numPoints();
+  m_id.reserve(npts);
+  m_stat.reserve(npts);
+  m_known.reserve(npts);
+  m_lat.reserve(npts);
+  m_lon.reserve(npts);
+  m_height.reserve(npts);
+  for (int j = 0; j < 3; j++) {
+    m_sigma[j].reserve(npts);
+    m_residual[j].reserve(npts);
+  }
+
+  std::vector<GpfPointRecord> block(BlockSize);
+  size_t nrec;
+  while ((nrec = gpf.nextBlock(block.data(), BlockSize)) > 0) {
+    for (size_t i = 0; i < nrec; i++) {
+      const GpfPointRecord &rec = block[i];
+      m_id.push_back(m_arena.copy(rec.pointID));
+      m_stat.push_back(rec.statValue());
+      m_known.push_back(rec.knownValue());
+      m_lat.push_back(gpfToDouble(rec.lat));
+      m_lon.push_back(gpfToDouble(rec.lon));
+      m_height.push_back(gpfToDouble(rec.height));
+      for (int j = 0; j < 3; j++) {
+        m_sigma[j].push_back(gpfToDouble(rec.sigma[j]));
+        m_residual[j].push_back(gpfToDouble(rec.residual[j]));
+      }
+    }
+  }
+  if (!gpf.error().empty()) {
+    m_error = "error reading input gpf file: " + std::string(path) + ": " + gpf.error();
+    return false;
+  }
+
+  // GXP degrees, in either longitude domain, fold into 0 to 360
+  if (gxp) {
+    gpfDegreesToDegrees360(size(), m_lat.data(), m_lon.data(), m_lat.data(), m_lon.data());
+    m_domain = Degrees360;
+  }
+  return true;
+}
+
+
+size_t GpfPointTable::add(std::string_view pointID, int stat, int known,
+                          double lat, double lon, double height,
+                          const double sigma[3], const double residual[3]) {
+  m_id.push_back(m_arena.copy(pointID));
+  m_stat.push_back(stat);
+  m_known.push_back(known);
+  m_lat.push_back(lat);
+  m_lon.push_back(lon);
+  m_height.push_back(height);
+  for (int j = 0; j < 3; j++) {
+    m_sigma[j].push_back(sigma[j]);
+    m_residual[j].push_back(residual[j]);
+  }
+  m_indexed = false;
+  return size() - 1;
+}
+
+
+uint32_t GpfPointTable::find(std::string_view pointID) {
+  if (!m_indexed) {
+    m_index.clear();
+    m_index.reserve(size());
+    // the first of any repeated ID wins
+    for (size_t i = 0; i < size(); i++)
+      m_index.insert(m_id[i], (uint32_t) i);
+    m_indexed = true;
+  }
+  return m_index.find(pointID);
+}
+
+
+std::vector<uint32_t> GpfPointTable::activeTies() const {
+  return select([this](size_t i) { return m_stat[i] == 1 && m_known[i] == 0; });
+}
+
+
+void GpfPointTable::convert(Domain domain) {
+  if (domain == m_domain)
+    return;
+
+  // one block at a time through scratch buffers, the kernels do not take
+  // their output on top of their input
+  std::vector<double> lat(BlockSize), lon(BlockSize);
+  for (size_t first = 0; first < size(); first += BlockSize) {
+    size_t n = std::min(BlockSize, size() - first);
+    double *pLat = m_lat.data() + first;
+    double *pLon = m_lon.data() + first;
+    if (domain == Degrees360)
+      gpfRadiansToDegrees360(n, pLat, pLon, lat.data(), lon.data());
+    else
+      gpfDegrees360ToRadians(n, pLat, pLon, lat.data(), lon.data());
+    std::copy(lat.begin(), lat.begin() + n, pLat);
+    std::copy(lon.begin(), lon.begin() + n, pLon);
+  }
+  m_domain = domain;
+}
+
+
+// "%.14lf" the way Socet Set prints it: at most 17 significant digits,
+// zero padded to 14 decimals, so e.g. a height comes out as
+// -2877.70287590942010 where the exact expansion would end in ...42007
+static void putSocetFixed(GpfWriter &out, double value) {
+  char digits[32];
+  std::to_chars_result r = std::to_chars(digits, digits + sizeof(digits), value,
+                                         std::chars_format::scientific, 16);
+  const char *e = std::find(digits, r.ptr, 'e');
+  const char *x = e + 1;
+  if (*x == '+')
+    x++;
+  int exponent = 0;
+  std::from_chars(x, r.ptr, exponent);
+  if (exponent + 1 + 14 <= 17) {
+    out.putFixed(value, 14);
+    return;
+  }
+
+  // sign, the 17 digits with the point moved exponent places right, and
+  // zeros out to 14 decimals
+  const char *p = digits;
+  if (*p == '-')
+    out.put(*p++);
+  std::string mantissa;
+  for (; p < e; p++) {
+    if (*p != '.')
+      mantissa.push_back(*p);
+  }
+  size_t whole = (size_t) exponent + 1;
+  std::string text = mantissa.size() > whole ? mantissa.substr(0, whole)
+                                             : mantissa + std::string(whole - mantissa.size(), '0');
+  text.push_back('.');
+  if (mantissa.size() > whole)
+    text += mantissa.substr(whole);
+  size_t decimals = mantissa.size() > whole ? mantissa.size() - whole : 0;
+  text.append(14 - decimals, '0');
+  out.write(text);
+}
+
+
+bool GpfPointTable::save(const char *path) {
+  GpfWriter out;
+  if (!out.open(path)) {
+    m_error = "unable to open output gpf file: " + std::string(path);
+    return false;
+  }
+
+  out.write(m_title);
+  out.put('\n');
+  out.putInt((int) size());
+  out.put('\n');
+  out.write(m_columns);
+  out.put('\n');
+
+  std::vector<double> radLat(BlockSize), radLon(BlockSize);
+  for (size_t first = 0; first < size(); first += BlockSize) {
+    size_t n = std::min(BlockSize, size() - first);
+    const double *lat = m_lat.data() + first;
+    const double *lon = m_lon.data() + first;
+    if (m_domain == Degrees360) {
+      gpfDegrees360ToRadians(n, lat, lon, radLat.data(), radLon.data());
+      lat = radLat.data();
+      lon = radLon.data();
+    }
+
+    for (size_t k = 0; k < n; k++) {
+      size_t i = first + k;
+      out.write(m_id[i]);
+      out.put(' ');
+      out.putInt(m_stat[i]);
+      out.put(' ');
+      out.putInt(m_known[i]);
+      out.put('\n');
+      putSocetFixed(out, lat[k]);
+      out.write("         ");
+      putSocetFixed(out, lon[k]);
+      out.write("         ");
+      putSocetFixed(out, m_height[i]);
+      out.write("    \n");
+      for (int j = 0; j < 3; j++) {
+        out.putFixed(m_sigma[j][i], 6);
+        out.put(j < 2 ? ' ' : '\n');
+      }
+      for (int j = 0; j < 3; j++) {
+        out.putFixed(m_residual[j][i], 6);
+        out.put(j < 2 ? ' ' : '\n');
+      }
+      out.put('\n');
+    }
+  }
+
+  if (!out.close()) {
+    m_error = "error writing output gpf file: " + std::string(path);
+    return false;
+  }
+  return true;
+}
+
+
+bool GpfPointTable::saveCsv(const char *csvPath, const char *idsPath,
+                            const std::vector<uint32_t> &rows) {
+  GpfWriter csv, pts;
+  if (!csv.open(csvPath)) {
+    m_error = "unable to open output csv file: " + std::string(csvPath);
+    return false;
+  }
+  if (!pts.open(idsPath)) {
+    m_error = "unable to open output list file of tie point ids: " + std::string(idsPath);
+    return false;
+  }
+
+  std::vector<double> ddLat(BlockSize), ddLon(BlockSize), rLat(BlockSize), rLon(BlockSize);
+  for (size_t first = 0; first < rows.size(); first += BlockSize) {
+    size_t n = std::min(BlockSize, rows.size() - first);
+    const uint32_t *row = rows.data() + first;
+    for (size_t k = 0; k < n; k++) {
+      rLat[k] = m_lat[row[k]];
+      rLon[k] = m_lon[row[k]];
+    }
+    if (m_domain == Radians180)
+      gpfRadiansToDegrees360(n, rLat.data(), rLon.data(), ddLat.data(), ddLon.data());
+    else {
+      ddLat.swap(rLat);
+      ddLon.swap(rLon);
+    }
+
+    for (size_t k = 0; k < n; k++) {
+      csv.putFixed(ddLat[k], 14);
+      csv.put(',');
+      csv.putFixed(ddLon[k], 14);
+      csv.put(',');
+      putSocetFixed(csv, m_height[row[k]]);
+      csv.put('\n');
+      pts.write(m_id[row[k]]);
+      pts.put('\n');
+    }
+  }
+
+  if (!csv.close()) {
+    m_error = "error writing output csv file: " + std::string(csvPath);
+    return false;
+  }
+  if (!pts.close()) {
+    m_error = "error writing output list file of tie point ids: " + std::string(idsPath);
+    return false;
+  }
+  return true;
+}
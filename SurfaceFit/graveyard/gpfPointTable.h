@@ -0,0 +1,152 @@
+#ifndef gpfPointTable_h
+#define gpfPointTable_h
+
+// In-memory point table, for C++ tools that want to work on a GPF
+// directly instead of running the two executables on text files.
+//
+// load() parses a GPF (Socet Set or GXP, see gpfReader.h) once into
+// structure-of-arrays columns: the point IDs live in a monotonic arena
+// (gpfArena.h) and every numeric field in a vector of its own, so a pass
+// over one coordinate touches only that coordinate, and the columns can
+// be handed straight to the batched conversions of gpfConvert.h.  The
+// table owns all of its data; the file is closed once it is loaded.
+//
+// Angles are held in one of two domains, switched in place with
+// convert(): Socet Set radians with longitude in -pi to pi, as in a
+// Socet Set GPF, or degrees with longitude in 0 to 360, as in the CSVs
+// handed to pc_align.  A GXP file loads in degrees, 0 to 360.
+//
+//   GpfPointTable gpf;
+//   if (!gpf.load("M2020_NE_Syrtis.gpf"))
+//     ... gpf.error() ...
+//   std::vector<uint32_t> ties = gpf.select([&](size_t i) {
+//     return gpf.stat(i) == 1 && gpf.known(i) == 0;
+//   });
+//   gpf.convert(GpfPointTable::Degrees360);
+//   gpf.saveCsv("ties.csv", "ties.tiePointIds.txt", ties);
+//
+// save() writes a Socet Set GPF with the fields formatted as Socet Set
+// writes them: "%.14lf" coordinates, carried to at most 17 significant
+// digits and zero padded past that, and "%.6lf" sigmas and residuals.
+// Loading and saving a GPF written by Socet Set gives back the same bytes.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "gpfArena.h"
+#include "gpfPointIndex.h"
+
+class GpfPointTable {
+ public:
+  enum Domain {
+    Radians180,     // Socet Set GPF
+    Degrees360      // pc_align CSV
+  };
+
+  GpfPointTable();
+  GpfPointTable(const GpfPointTable &) = delete;
+  GpfPointTable &operator=(const GpfPointTable &) = delete;
+
+  // Replaces the table with the points of the GPF at path.  Returns false
+  // with error() set if it can not be read.
+  bool load(const char *path);
+
+  // Empty unless load() or a save found a problem
+  const std::string &error() const { return m_error; }
+
+  void clear();
+
+  size_t size() const { return m_id.size(); }
+
+  // First header line of the GPF, without its newline
+  const std::string &title() const { return m_title; }
+  void setTitle(std::string_view title) { m_title = std::string(title); }
+
+  // Appends a point and returns its row
+  size_t add(std::string_view pointID, int stat, int known,
+             double lat, double lon, double height,
+             const double sigma[3], const double residual[3]);
+
+  //-------------------------------------------------------------------
+  // Columns.  Row i of every column is point i, in file order.
+  //-------------------------------------------------------------------
+  std::string_view pointID(size_t i) const { return m_id[i]; }
+  int stat(size_t i) const { return m_stat[i]; }
+  int known(size_t i) const { return m_known[i]; }
+
+  double *lat() { return m_lat.data(); }
+  double *lon() { return m_lon.data(); }
+  double *height() { return m_height.data(); }
+  double *sigma(int axis) { return m_sigma[axis].data(); }
+  double *residual(int axis) { return m_residual[axis].data(); }
+  const double *lat() const { return m_lat.data(); }
+  const double *lon() const { return m_lon.data(); }
+  const double *height() const { return m_height.data(); }
+  const double *sigma(int axis) const { return m_sigma[axis].data(); }
+  const double *residual(int axis) const { return m_residual[axis].data(); }
+
+  void setStat(size_t i, int stat) { m_stat[i] = stat; }
+  void setKnown(size_t i, int known) { m_known[i] = known; }
+
+  //-------------------------------------------------------------------
+  // Lookup and filtering
+  //-------------------------------------------------------------------
+
+  // Row of pointID, or GpfPointIndex::NotFound.  The ID index is built on
+  // the first call after the table changes.
+  uint32_t find(std::string_view pointID);
+
+  // Rows for which keep(row) is true, in row order
+  template <typename Pred>
+  std::vector<uint32_t> select(Pred keep) const {
+    std::vector<uint32_t> rows;
+    for (size_t i = 0; i < size(); i++) {
+      if (keep(i))
+        rows.push_back((uint32_t) i);
+    }
+    return rows;
+  }
+
+  // The active tie points (stat 1, known 0), the points the tools export
+  std::vector<uint32_t> activeTies() const;
+
+  //-------------------------------------------------------------------
+  // Angle domain
+  //-------------------------------------------------------------------
+  Domain domain() const { return m_domain; }
+
+  // Converts every latitude and longitude to domain, in one batch
+  void convert(Domain domain);
+
+  //-------------------------------------------------------------------
+  // Output.  Both return false with error() set if the write failed.
+  //-------------------------------------------------------------------
+
+  // Writes all the points as a Socet Set GPF
+  bool save(const char *path);
+
+  // Writes rows as "lat,lon360,height" and their point IDs, one per line,
+  // like gpfTies2LatLonHeightCSV_360sys.  Heights are formatted as save()
+  // does, so the ties of a GPF Socet Set wrote come out as the exporter
+  // writes them, copying the height text of the GPF.
+  bool saveCsv(const char *csvPath, const char *idsPath,
+               const std::vector<uint32_t> &rows);
+
+ private:
+  GpfArena                      m_arena;
+  std::string                   m_title;
+  std::string                   m_columns;
+  Domain                        m_domain;
+  std::vector<std::string_view> m_id;
+  std::vector<int32_t>          m_stat, m_known;
+  std::vector<double>           m_lat, m_lon, m_height;
+  std::vector<double>           m_sigma[3], m_residual[3];
+  GpfPointIndex                 m_index;
+  bool                          m_indexed;
+  std::string                   m_error;
+};
+
+#endif
@@ -0,0 +1,760 @@
+#include "gpfReader.h"
+#include "gpfAsyncIO.h"
+#include "gpfThreadPool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <charconv>
+#include <future>
+#include <system_error>
+
+/////////////////////////////////////////////////////////////////////////////
+// GpfMappedFile
+/////////////////////////////////////////////////////////////////////////////
+
+GpfMappedFile::GpfMappedFile()
+  : m_data(NULL), m_size(0), m_mapped(false), m_fd(-1), m_compression(GpfUncompressed),
+    m_aheadMark(NULL) {
+}
+
+
+GpfMappedFile::~GpfMappedFile() {
+  close();
+}
+
+
+bool GpfMappedFile::open(const char *path) {
+  close();
+
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    return false;
+  }
+
+  // mmap refuses zero length maps, so an empty file is just no bytes
+  m_size = (size_t) st.st_size;
+  if (m_size == 0) {
+    ::close(fd);
+    m_data = "";
+    return true;
+  }
+
+  void *map = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    ::close(fd);
+    m_size = 0;
+    return false;
+  }
+
+  // records are consumed front to back exactly once
+  madvise(map, m_size, MADV_SEQUENTIAL);
+
+  m_data = (const char *) map;
+  m_mapped = true;
+
+  // a compressed file is decompressed whole, and the map dropped
+  m_compression = gpfDetectCompression(m_data, m_size);
+  if (m_compression == GpfUncompressed) {
+    m_fd = fd;
+    if (gpfPipelined())
+      m_aheadMark = m_data;
+  }
+  else {
+    ::close(fd);
+    bool ok = gpfDecompress(m_compression, m_data, m_size, m_inflated, m_error);
+    munmap(map, m_size);
+    m_mapped = false;
+    if (!ok) {
+      m_inflated = std::vector<char>();
+      m_data = NULL;
+      m_size = 0;
+      return false;
+    }
+    m_data = m_inflated.empty() ? "" : m_inflated.data();
+    m_size = m_inflated.size();
+  }
+  return true;
+}
+
+
+void GpfMappedFile::close() {
+  // before the descriptor it reads from goes
+  m_readAhead.reset();
+  m_aheadMark = NULL;
+  if (m_mapped)
+    munmap((void *) m_data, m_size);
+  if (m_fd >= 0)
+    ::close(m_fd);
+  m_fd = -1;
+  m_data = NULL;
+  m_size = 0;
+  m_mapped = false;
+  m_compression = GpfUncompressed;
+  m_inflated = std::vector<char>();
+  m_error.clear();
+}
+
+
+// The reads start with the first call, so a file that is only mapped for
+// lookups is not read ahead
+void GpfMappedFile::advanceReadAhead(const char *cur) {
+  if (!m_readAhead)
+    m_readAhead.reset(new GpfReadAhead(m_fd, m_size));
+  size_t next = m_readAhead->advance((size_t) (cur - m_data));
+  m_aheadMark = (next < m_size) ? m_data + next : NULL;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// GpfLineReader
+/////////////////////////////////////////////////////////////////////////////
+
+static const size_t StreamBlockSize = 1 << 20;
+
+
+GpfLineReader::GpfLineReader()
+  : m_cur(NULL), m_end(NULL), m_fd(-1), m_ownsFd(false), m_begin(0), m_len(0),
+    m_streamed(0), m_eof(false), m_failed(false) {
+}
+
+
+GpfLineReader::~GpfLineReader() {
+  close();
+}
+
+
+bool GpfLineReader::open(const char *path) {
+  close();
+
+  int fd = (strcmp(path, "-") == 0) ? STDIN_FILENO : ::open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    if (fd != STDIN_FILENO)
+      ::close(fd);
+    return false;
+  }
+
+  if (S_ISREG(st.st_mode) && fd != STDIN_FILENO) {
+    // a compressed file is streamed rather than decompressed whole
+    char magic[4];
+    ssize_t n = pread(fd, magic, sizeof(magic), 0);
+    if (n > 0 && gpfDetectCompression(magic, (size_t) n) != GpfUncompressed)
+      return openStreamed(fd);
+
+    ::close(fd);
+    if (!m_file.open(path))
+      return false;
+    m_cur = m_file.data();
+    m_end = m_cur + m_file.size();
+    return true;
+  }
+
+  return openStreamed(fd);
+}
+
+
+// Streams from fd, which is closed on failure.  The first bytes are read
+// up front to see if the input is compressed.
+bool GpfLineReader::openStreamed(int fd) {
+  // read front to back once, for a file (a pipe ignores it)
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  m_fd = fd;
+  m_ownsFd = true;
+  m_buffer.resize(StreamBlockSize);
+
+  char magic[4];
+  size_t got = 0;
+  while (got < sizeof(magic)) {
+    ssize_t n = read(fd, magic + got, sizeof(magic) - got);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0) {
+      close();
+      return false;
+    }
+    if (n == 0)
+      break;
+    got += (size_t) n;
+  }
+
+  GpfCompression compression = gpfDetectCompression(magic, got);
+  if (compression == GpfUncompressed) {
+    memcpy(m_buffer.data(), magic, got);
+    m_len = got;
+    m_streamed = got;
+    return true;
+  }
+  m_decoder.reset(new GpfDecompressStream);
+  if (!m_decoder->open(compression, magic, got, m_error)) {
+    std::string error = m_error;
+    close();
+    m_error = error;
+    return false;
+  }
+  return true;
+}
+
+
+void GpfLineReader::openStream(int fd) {
+  close();
+  m_fd = fd;
+  m_ownsFd = false;
+  m_buffer.resize(StreamBlockSize);
+}
+
+
+void GpfLineReader::close() {
+  m_file.close();
+  if (m_fd > STDIN_FILENO && m_ownsFd)
+    ::close(m_fd);
+  m_fd = -1;
+  m_ownsFd = false;
+  m_cur = m_end = NULL;
+  m_buffer.clear();
+  m_begin = m_len = 0;
+  m_streamed = 0;
+  m_eof = false;
+  m_failed = false;
+  m_decoder.reset();
+  m_error.clear();
+}
+
+
+// Reads more of a streamed input, first sliding the unconsumed tail to the
+// front of the buffer.  The buffer only grows when a single line does not
+// fit in it.
+bool GpfLineReader::fill() {
+  if (m_begin > 0) {
+    memmove(m_buffer.data(), m_buffer.data() + m_begin, m_len - m_begin);
+    m_len -= m_begin;
+    m_begin = 0;
+  }
+  if (m_len == m_buffer.size()) {
+    if (m_buffer.size() >= MaxLineLength) {
+      m_failed = true;
+      m_eof = true;
+      return false;
+    }
+    m_buffer.resize(m_buffer.size() * 2);
+  }
+
+  while (true) {
+    char *buf = m_buffer.data() + m_len;
+    size_t room = m_buffer.size() - m_len;
+    ssize_t n = m_decoder ? m_decoder->read(m_fd, buf, room) : read(m_fd, buf, room);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      m_failed = true;
+      m_eof = true;
+      return false;
+    }
+    if (n == 0) {
+      m_eof = true;
+      return false;
+    }
+    m_len += (size_t) n;
+    m_streamed += (size_t) n;
+    return true;
+  }
+}
+
+
+size_t GpfLineReader::bytesRead() const {
+  if (m_fd < 0)
+    return m_file.data() ? (size_t) (m_cur - m_file.data()) : 0;
+  return m_streamed;
+}
+
+
+bool GpfLineReader::next(std::string_view &line) {
+  if (m_fd < 0) {
+    if (m_cur >= m_end)
+      return false;
+    line = gpfNextLine(m_cur, m_end);
+    m_file.readAhead(m_cur);
+    return true;
+  }
+
+  size_t searched = m_begin;
+  while (true) {
+    const char *data = m_buffer.data();
+    const char *nl = (const char *) memchr(data + searched, '\n',
+                                           m_len - searched);
+    if (nl) {
+      size_t stop = (nl - data) + 1;
+      line = std::string_view(data + m_begin, stop - m_begin);
+      m_begin = stop;
+      return true;
+    }
+    if (m_eof) {
+      // last line without a newline
+      if (m_begin == m_len || m_failed)
+        return false;
+      line = std::string_view(data + m_begin, m_len - m_begin);
+      m_begin = m_len;
+      return true;
+    }
+    // no newline in what has been read so far, don't rescan it after refilling
+    size_t scanned = m_len - m_begin;
+    fill();
+    searched = m_begin + scanned;
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Line and token helpers
+/////////////////////////////////////////////////////////////////////////////
+
+std::string_view gpfNextLine(const char *&cur, const char *end) {
+  const char *start = cur;
+  const char *nl = (const char *) memchr(cur, '\n', end - cur);
+  cur = nl ? nl + 1 : end;
+  return std::string_view(start, cur - start);
+}
+
+
+static inline bool isGpfSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n' ||
+         c == '\v' || c == '\f';
+}
+
+
+std::string_view gpfNextToken(std::string_view &line) {
+  size_t i = 0, n = line.size();
+  while (i < n && isGpfSpace(line[i]))
+    i++;
+  size_t start = i;
+  while (i < n && !isGpfSpace(line[i]))
+    i++;
+  std::string_view token = line.substr(start, i - start);
+  line.remove_prefix(i);
+  return token;
+}
+
+
+std::string_view gpfNextField(std::string_view &line) {
+  size_t i = 0, n = line.size();
+  while (i < n && (line[i] == ',' || isGpfSpace(line[i])))
+    i++;
+  size_t start = i;
+  while (i < n && line[i] != ',' && !isGpfSpace(line[i]))
+    i++;
+  std::string_view field = line.substr(start, i - start);
+  line.remove_prefix(i);
+  return field;
+}
+
+
+// std::from_chars is locale independent and correctly rounded, so it reads
+// back exactly the value strtod/atof would, without needing the token to
+// be NUL terminated
+double gpfToDouble(std::string_view token) {
+  const char *first = token.data();
+  const char *last = first + token.size();
+  if (first != last && *first == '+')
+    first++;
+  double value = 0.0;
+  if (std::from_chars(first, last, value).ec != std::errc())
+    return 0.0;
+  return value;
+}
+
+
+bool gpfEndsWithBlankLine(std::string_view bytes) {
+  if (bytes.empty() || bytes.back() != '\n')
+    return false;
+  size_t i = bytes.size() - 1;
+  while (i > 0 && (bytes[i-1] == ' ' || bytes[i-1] == '\t' || bytes[i-1] == '\r'))
+    i--;
+  return i > 0 && bytes[i-1] == '\n';
+}
+
+
+bool gpfIsInt(std::string_view s) {
+  size_t i = 0;
+  if (i < s.size() && (s[i] == '-' || s[i] == '+'))
+    i++;
+  if (i == s.size())
+    return false;
+  for (; i < s.size(); i++)
+    if (s[i] < '0' || s[i] > '9')
+      return false;
+  return true;
+}
+
+
+bool gpfParseInt(std::string_view s, int &value) {
+  if (!gpfIsInt(s))
+    return false;
+  const char *first = s.data();
+  const char *last = first + s.size();
+  if (*first == '+')
+    first++;
+  return std::from_chars(first, last, value).ec == std::errc();
+}
+
+
+// Leading sign and digits, anything else stops the conversion, as atoi()
+int gpfToInt(std::string_view s) {
+  const char *first = s.data();
+  const char *last = first + s.size();
+  if (first != last && *first == '+' && (first + 1 == last || first[1] != '-'))
+    first++;
+  int value = 0;
+  if (std::from_chars(first, last, value).ec != std::errc())
+    return 0;
+  return value;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// GpfPointRecord
+/////////////////////////////////////////////////////////////////////////////
+
+int GpfPointRecord::statValue() const {
+  return gpfToInt(stat);
+}
+
+
+int GpfPointRecord::knownValue() const {
+  return gpfToInt(known);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// GpfReader
+/////////////////////////////////////////////////////////////////////////////
+
+GpfReader::GpfReader()
+  : m_cur(NULL), m_end(NULL), m_numpts(0), m_layout(GpfSocetSet), m_first(0),
+    m_read(0) {
+}
+
+
+bool GpfReader::open(const char *path) {
+  close();
+  if (!m_file.open(path)) {
+    m_error = m_file.error();
+    return false;
+  }
+
+  m_cur = m_file.data();
+  m_end = m_cur + m_file.size();
+
+  // title line, number of points, column names
+  gpfNextLine(m_cur, m_end);
+  std::string_view countLine = gpfNextLine(m_cur, m_end);
+  std::string_view columns = gpfNextLine(m_cur, m_end);
+  m_header = std::string_view(m_file.data(), m_cur - m_file.data());
+  m_layout = (columns.find("point_type") != std::string_view::npos) ? GpfGxp : GpfSocetSet;
+  std::string_view count = gpfNextToken(countLine);
+  if (!gpfIsInt(count)) {
+    m_error = "second header line is not the number of points";
+    return false;
+  }
+  if (!gpfParseInt(count, m_numpts) || m_numpts < 0) {
+    m_numpts = 0;
+    m_error = "number of points in the header is out of range: " + std::string(count);
+    return false;
+  }
+  return true;
+}
+
+
+void GpfReader::close() {
+  m_file.close();
+  m_cur = m_end = NULL;
+  m_header = std::string_view();
+  m_numpts = 0;
+  m_layout = GpfSocetSet;
+  m_first = 0;
+  m_read = 0;
+  m_error.clear();
+}
+
+
+void GpfReader::openRange(const GpfRecordRange &range) {
+  close();
+  m_cur = range.begin;
+  m_end = range.end;
+  m_numpts = range.count;
+  m_first = range.first;
+  m_layout = range.layout;
+}
+
+
+std::vector<GpfRecordRange> GpfReader::split(size_t n, GpfThreadPool *pool) const {
+  std::vector<GpfRecordRange> ranges;
+  int remaining = m_numpts - m_read;
+  if (n == 0 || remaining <= 0 || !m_error.empty())
+    return ranges;
+  if (m_layout == GpfGxp)
+    return splitGxp(n, pool);
+
+  // cut the bytes into n parts, each starting at the beginning of a line
+  size_t bytes = m_end - m_cur;
+  std::vector<const char *> cuts(n + 1);
+  cuts[0] = m_cur;
+  cuts[n] = m_end;
+  for (size_t j = 1; j < n; j++) {
+    const char *p = m_cur + bytes / n * j;
+    if (p < cuts[j-1])
+      p = cuts[j-1];
+    gpfNextLine(p, m_end);
+    cuts[j] = p;
+  }
+
+  // count the lines in each part
+  std::vector<size_t> lines(n);
+  if (pool) {
+    std::vector<std::future<size_t> > counts;
+    for (size_t j = 0; j < n; j++) {
+      const char *a = cuts[j], *b = cuts[j+1];
+      counts.push_back(pool->submit([a, b]() {
+        return (size_t) std::count(a, b, '\n');
+      }));
+    }
+    for (size_t j = 0; j < n; j++)
+      lines[j] = counts[j].get();
+  }
+  else {
+    for (size_t j = 0; j < n; j++)
+      lines[j] = std::count(cuts[j], cuts[j+1], '\n');
+  }
+
+  // move each cut forward to the start of the next record, records being
+  // five lines, and make a range of the records between two cuts
+  size_t line = 0;
+  int prevRecord = 0;
+  const char *prevBegin = m_cur;
+  for (size_t j = 1; j <= n && prevRecord < remaining; j++) {
+    line += lines[j-1];
+    int record = (int) std::min<size_t>((line + 4) / 5, remaining);
+    const char *begin = m_end;
+    if (j < n && record < remaining) {
+      begin = cuts[j];
+      for (size_t skip = (size_t) record * 5 - line; skip > 0; skip--)
+        gpfNextLine(begin, m_end);
+    }
+    else
+      record = remaining;
+
+    if (record > prevRecord) {
+      ranges.push_back(GpfRecordRange{prevBegin, begin, m_first + m_read + prevRecord,
+                                      record - prevRecord, m_layout});
+      prevRecord = record;
+      prevBegin = begin;
+    }
+  }
+  return ranges;
+}
+
+
+// Returns the offset just past the first blank line of text that starts
+// after offset from, or npos.  A line of only blanks (and the \r of a CRLF
+// file) is blank, as it is to the record parser.
+static size_t findBlankLine(std::string_view text, size_t from) {
+  size_t newline = text.find('\n', from);
+  while (newline != std::string_view::npos) {
+    size_t i = newline + 1;
+    while (i < text.size() && text[i] != '\n' && isGpfSpace(text[i]))
+      i++;
+    if (i == text.size())
+      return std::string_view::npos;
+    if (text[i] == '\n')
+      return i + 1;
+    newline = text.find('\n', i);
+  }
+  return std::string_view::npos;
+}
+
+
+// GXP records are not all the same length, so each part has to be cut
+// just after a record's blank line, and holds as many records as it has
+// blank lines
+std::vector<GpfRecordRange> GpfReader::splitGxp(size_t n, GpfThreadPool *pool) const {
+  std::vector<GpfRecordRange> ranges;
+  int remaining = m_numpts - m_read;
+  std::string_view rest(m_cur, m_end - m_cur);
+
+  size_t bytes = m_end - m_cur;
+  std::vector<const char *> cuts;
+  cuts.push_back(m_cur);
+  for (size_t j = 1; j < n; j++) {
+    size_t at = std::max<size_t>(bytes / n * j, cuts.back() - m_cur);
+    size_t next = findBlankLine(rest, at > 0 ? at - 1 : 0);
+    if (next == std::string_view::npos)
+      break;
+    const char *p = m_cur + next;
+    if (p > cuts.back() && p < m_end)
+      cuts.push_back(p);
+  }
+  cuts.push_back(m_end);
+
+  size_t nparts = cuts.size() - 1;
+  auto countRecords = [](const char *a, const char *b) {
+    size_t count = 0;
+    std::string_view part(a, b - a);
+    for (size_t at = findBlankLine(part, 0); at != std::string_view::npos;
+         at = findBlankLine(part, at))
+      count++;
+    return count;
+  };
+  std::vector<size_t> records(nparts);
+  if (pool) {
+    std::vector<std::future<size_t> > counts;
+    for (size_t j = 0; j < nparts; j++) {
+      const char *a = cuts[j], *b = cuts[j+1];
+      counts.push_back(pool->submit([a, b, &countRecords]() { return countRecords(a, b); }));
+    }
+    for (size_t j = 0; j < nparts; j++)
+      records[j] = counts[j].get();
+  }
+  else {
+    for (size_t j = 0; j < nparts; j++)
+      records[j] = countRecords(cuts[j], cuts[j+1]);
+  }
+
+  // the last part takes whatever is left, so a short or unterminated file
+  // is reported by the reader of that part
+  int first = 0;
+  for (size_t j = 0; j < nparts && first < remaining; j++) {
+    int count = (j + 1 == nparts) ? remaining - first
+                                  : (int) std::min<size_t>(records[j], remaining - first);
+    const char *end = (first + count == remaining) ? m_end : cuts[j+1];
+    if (count > 0)
+      ranges.push_back(GpfRecordRange{cuts[j], end, m_first + m_read + first, count, m_layout});
+    first += count;
+    if (end == m_end)
+      break;
+  }
+  return ranges;
+}
+
+
+bool GpfReader::fail(const char *what) {
+  long record = (long) m_first + m_read;
+  m_error = "point record " + std::to_string(record + 1);
+  // Socet Set records are five lines after the three line header
+  if (m_layout == GpfSocetSet)
+    m_error += " (line " + std::to_string(4 + 5 * record) + ")";
+  m_error += ": " + std::string(what);
+  m_cur = m_end;
+  return false;
+}
+
+
+//-----------------------------------------------------------------------
+// The record layout of each dialect, for parseRecord().  Socet Set
+// separates fields with blanks and ends a record after its residuals; GXP
+// also takes commas, and may carry extra lines before the blank line.
+//-----------------------------------------------------------------------
+struct GpfSocetSetDialect {
+  static std::string_view field(std::string_view &line) { return gpfNextToken(line); }
+  static const bool ExtraLines = false;
+};
+
+struct GpfGxpDialect {
+  static std::string_view field(std::string_view &line) { return gpfNextField(line); }
+  static const bool ExtraLines = true;
+};
+
+
+template <class Dialect>
+bool GpfReader::parseRecord(GpfPointRecord &rec) {
+  if (m_read >= m_numpts || !m_error.empty())
+    return false;
+  if (m_cur >= m_end)
+    return fail("file ends before the number of points in the header");
+
+  const char *start = m_cur;
+
+  std::string_view line = gpfNextLine(m_cur, m_end);
+  const char *bodyStart = m_cur;
+  rec.pointID = Dialect::field(line);
+  rec.stat = Dialect::field(line);
+  rec.known = Dialect::field(line);
+  if (!gpfIsInt(rec.stat) || !gpfIsInt(rec.known))
+    return fail("expected \"pointID stat known\"");
+  int value;
+  if (!gpfParseInt(rec.stat, value) || !gpfParseInt(rec.known, value))
+    return fail("stat or known value out of range");
+
+  line = gpfNextLine(m_cur, m_end);
+  rec.lat = Dialect::field(line);
+  rec.lon = Dialect::field(line);
+  rec.height = Dialect::field(line);
+  if (rec.height.empty())
+    return fail("expected \"lat lon height\"");
+
+  line = gpfNextLine(m_cur, m_end);
+  for (int j = 0; j < 3; j++)
+    rec.sigma[j] = Dialect::field(line);
+
+  line = gpfNextLine(m_cur, m_end);
+  for (int j = 0; j < 3; j++)
+    rec.residual[j] = Dialect::field(line);
+
+  if constexpr (Dialect::ExtraLines) {
+    // any further lines up to the blank one that ends the record
+    const char *extraStart = m_cur;
+    const char *extraEnd = m_cur;
+    while (m_cur < m_end) {
+      line = gpfNextLine(m_cur, m_end);
+      if (gpfNextToken(line).empty())
+        break;
+      extraEnd = m_cur;
+    }
+    rec.extra = std::string_view(extraStart, extraEnd - extraStart);
+  }
+  else {
+    // trailing blank line
+    gpfNextLine(m_cur, m_end);
+    rec.extra = std::string_view();
+  }
+
+  rec.raw = std::string_view(start, m_cur - start);
+  rec.body = std::string_view(bodyStart, m_cur - bodyStart);
+  m_read++;
+  return true;
+}
+
+
+bool GpfReader::next(GpfPointRecord &rec) {
+  m_file.readAhead(m_cur);
+  if (m_layout == GpfGxp)
+    return parseRecord<GpfGxpDialect>(rec);
+  return parseRecord<GpfSocetSetDialect>(rec);
+}
+
+
+// The dialect is picked once per block, the loop over its records is
+// specialized for it
+template <class Dialect>
+size_t GpfReader::parseBlock(GpfPointRecord *recs, size_t max) {
+  size_t n = 0;
+  while (n < max && parseRecord<Dialect>(recs[n]))
+    n++;
+  return n;
+}
+
+
+size_t GpfReader::nextBlock(GpfPointRecord *recs, size_t max) {
+  m_file.readAhead(m_cur);
+  if (m_layout == GpfGxp)
+    return parseBlock<GpfGxpDialect>(recs, max);
+  return parseBlock<GpfSocetSetDialect>(recs, max);
+}
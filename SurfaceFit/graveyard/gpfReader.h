@@ -0,0 +1,286 @@
+#ifndef gpfReader_h
+#define gpfReader_h
+
+// Shared reader for Socet Set ground point files (*.gpf).
+//
+// A GPF is three header lines (title, number of points, column names)
+// followed by one five line record per point:
+//
+//   pointID stat known
+//   lat lon height
+//   sigma(3)
+//   residual(3)
+//   <blank>
+//
+// Socet GXP writes the same layout with the columns named
+// "point_id,use,point_type,...", latitude and longitude in degrees
+// (longitude in either the -180 to 180 or the 0 to 360 domain), and may
+// add lines after the residuals, a record then running to its blank line.
+// The reader tells the two apart by the column names line.
+//
+// The whole file is memory mapped and every field handed back is a view
+// into the mapped bytes, so nothing is copied while reading.  A gzip or
+// zstd compressed file (gpfCompress.h) is decompressed into memory when
+// it is opened instead, and read from there the same way.  In the
+// pipelined mode (gpfAsyncIO.h) the file is read ahead of the parser in
+// the background.
+
+#include <stddef.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "gpfCompress.h"
+
+class GpfReadAhead;
+
+enum GpfLayout {
+  GpfSocetSet,    // legacy Socet Set, angles in radians
+  GpfGxp          // Socet GXP, angles in degrees
+};
+
+//-----------------------------------------------------------------------
+// Read-only memory map of an entire file.  A compressed file is
+// decompressed into memory instead, data() and size() then being the
+// decompressed bytes.
+//-----------------------------------------------------------------------
+class GpfMappedFile {
+ public:
+  GpfMappedFile();
+  ~GpfMappedFile();
+  GpfMappedFile(const GpfMappedFile &) = delete;
+  GpfMappedFile &operator=(const GpfMappedFile &) = delete;
+
+  bool open(const char *path);
+  void close();
+
+  const char *data() const { return m_data; }
+  size_t size() const { return m_size; }
+
+  // How the file on disk is compressed
+  GpfCompression compression() const { return m_compression; }
+
+  // The open file behind a mapping, for copying from it in the kernel
+  // (data() + i is byte i of the file); -1 for a decompressed or empty file
+  int fd() const { return m_fd; }
+
+  // Set when open() failed on a compressed file, e.g. corrupt data
+  const std::string &error() const { return m_error; }
+
+  // In the pipelined mode, keeps the kernel reading the file ahead of cur,
+  // the first byte of data() not consumed yet.  Cheap enough to call for
+  // every record or line; does nothing for a decompressed file.
+  void readAhead(const char *cur) {
+    if (m_aheadMark && cur >= m_aheadMark)
+      advanceReadAhead(cur);
+  }
+
+ private:
+  void advanceReadAhead(const char *cur);
+
+  const char       *m_data;
+  size_t            m_size;
+  bool              m_mapped;
+  int               m_fd;
+  GpfCompression    m_compression;
+  std::vector<char> m_inflated;
+  std::string       m_error;
+  std::unique_ptr<GpfReadAhead> m_readAhead;
+  const char       *m_aheadMark;    // where readAhead() has work next, NULL if off
+};
+
+//-----------------------------------------------------------------------
+// One point record.  All views point into the mapped file and are only
+// valid while the GpfReader that produced them is open.
+//-----------------------------------------------------------------------
+struct GpfPointRecord {
+  std::string_view pointID;
+  std::string_view stat;
+  std::string_view known;
+
+  std::string_view lat;       // radians (degrees in a GXP file)
+  std::string_view lon;       // radians, -pi to pi (degrees in a GXP file)
+  std::string_view height;
+
+  std::string_view sigma[3];
+  std::string_view residual[3];
+
+  std::string_view raw;       // all five lines, including newlines
+  std::string_view body;      // the four lines after "pointID stat known"
+  std::string_view extra;     // GXP lines after the residuals, empty if none
+
+  int statValue() const;
+  int knownValue() const;
+};
+
+//-----------------------------------------------------------------------
+// A run of whole point records inside a mapped GPF, records
+// [first, first + count) of the file
+//-----------------------------------------------------------------------
+struct GpfRecordRange {
+  const char *begin;
+  const char *end;
+  int         first;
+  int         count;
+  GpfLayout   layout;
+};
+
+class GpfThreadPool;
+
+//-----------------------------------------------------------------------
+// Sequential record reader over a mapped GPF
+//-----------------------------------------------------------------------
+class GpfReader {
+ public:
+  GpfReader();
+
+  // Maps the file and parses the three header lines
+  bool open(const char *path);
+  void close();
+
+  // Reads just the records of range, which must come from split() on a
+  // reader that stays open for as long as this one is used
+  void openRange(const GpfRecordRange &range);
+
+  // Splits the records not yet read into at most n ranges of roughly equal
+  // size, for parsing in parallel.  Record boundaries are found by counting
+  // lines, one part of the file per pool worker when a pool is given.
+  std::vector<GpfRecordRange> split(size_t n, GpfThreadPool *pool = NULL) const;
+
+  // The three header lines, each including its newline
+  std::string_view header() const { return m_header; }
+  int numPoints() const { return m_numpts; }
+  GpfLayout layout() const { return m_layout; }
+
+  // Size of the mapped file (decompressed), 0 for a reader made by
+  // openRange()
+  size_t fileSize() const { return m_file.size(); }
+  GpfCompression compression() const { return m_file.compression(); }
+  const GpfMappedFile &file() const { return m_file; }
+
+  // Fills rec with the next point record.  Returns false once numPoints()
+  // records have been read, or on a malformed or truncated record, in
+  // which case error() says what was wrong and where.
+  bool next(GpfPointRecord &rec);
+
+  // Reads up to max records into recs and returns how many were read, 0 at
+  // the end of the file
+  size_t nextBlock(GpfPointRecord *recs, size_t max);
+
+  // Empty unless open() or next() found a problem with the file
+  const std::string &error() const { return m_error; }
+
+ private:
+  bool fail(const char *what);
+  template <class Dialect> bool parseRecord(GpfPointRecord &rec);
+  template <class Dialect> size_t parseBlock(GpfPointRecord *recs, size_t max);
+  std::vector<GpfRecordRange> splitGxp(size_t n, GpfThreadPool *pool) const;
+
+  GpfMappedFile m_file;
+  const char   *m_cur;
+  const char   *m_end;
+  std::string_view m_header;
+  int           m_numpts;
+  GpfLayout     m_layout;
+  int           m_first;      // file record number of the first record
+  int           m_read;
+  std::string   m_error;
+};
+
+//-----------------------------------------------------------------------
+// Line at a time reader for the text inputs that are not GPFs (e.g. the
+// transformed CSV from pc_align).  Regular files are mapped as above.
+// Pipes, FIFOs and standard input ("-") can not be mapped, so they are
+// read in large blocks instead, which lets a tool consume its input while
+// the upstream step is still writing it.  Compressed inputs, files or
+// pipes, are streamed too, decompressed a block at a time.
+//-----------------------------------------------------------------------
+class GpfLineReader {
+ public:
+  GpfLineReader();
+  ~GpfLineReader();
+  GpfLineReader(const GpfLineReader &) = delete;
+  GpfLineReader &operator=(const GpfLineReader &) = delete;
+
+  bool open(const char *path);
+  void close();
+
+  // Streams from an already open descriptor (e.g. a socket), which is
+  // left open by close()
+  void openStream(int fd);
+
+  // Returns the next line, including its newline if present.  For streamed
+  // inputs the view is only valid until the following call.  Returns false
+  // at end of input.
+  bool next(std::string_view &line);
+
+  // true once a read on a streamed input failed, or a line longer than
+  // MaxLineLength was found
+  bool failed() const { return m_failed; }
+
+  // Bytes taken from the input so far, for the -stats counters.  A
+  // compressed input counts its decompressed bytes.
+  size_t bytesRead() const;
+
+  // Set when open() failed on a compressed input, e.g. one this build can
+  // not decompress
+  const std::string &error() const { return m_error; }
+
+  // A streamed line may be any length up to this, the buffer grows to fit
+  static constexpr size_t MaxLineLength = 64 << 20;
+
+ private:
+  bool fill();
+  bool openStreamed(int fd);
+
+  GpfMappedFile     m_file;
+  const char       *m_cur;
+  const char       *m_end;
+
+  int               m_fd;       // -1 when the input is mapped
+  bool              m_ownsFd;
+  std::vector<char> m_buffer;
+  size_t            m_begin;    // first unconsumed byte in m_buffer
+  size_t            m_len;      // bytes of m_buffer holding data
+  size_t            m_streamed; // bytes read from m_fd, decompressed
+  std::unique_ptr<GpfDecompressStream> m_decoder;
+  bool              m_eof;
+  bool              m_failed;
+  std::string       m_error;
+};
+
+//-----------------------------------------------------------------------
+// Line and token helpers shared by the tools
+//-----------------------------------------------------------------------
+
+// Returns the line starting at cur, including its newline if present, and
+// advances cur past it
+std::string_view gpfNextLine(const char *&cur, const char *end);
+
+// Returns the next whitespace delimited token in line and advances line
+// past it.  Returns an empty view when the line is exhausted.
+std::string_view gpfNextToken(std::string_view &line);
+
+// Same as gpfNextToken, but commas also separate fields, so "a, b,c" and
+// "a b c" both split into three
+std::string_view gpfNextField(std::string_view &line);
+
+// Returns true if bytes end with a blank line, the one that ends a point
+// record.  Only the last record of a file can be missing it.
+bool gpfEndsWithBlankLine(std::string_view bytes);
+
+// Returns true if token is an optionally signed run of digits
+bool gpfIsInt(std::string_view token);
+
+// Returns true if token is an optionally signed run of digits whose value
+// fits an int, and sets value to it
+bool gpfParseInt(std::string_view token, int &value);
+
+// atof() and atoi() on a token view.  Doubles are parsed with
+// std::from_chars, which round trips every value %.14lf or %.17g wrote.
+// An int that does not fit is 0, check it with gpfParseInt first.
+double gpfToDouble(std::string_view token);
+int gpfToInt(std::string_view token);
+
+#endif
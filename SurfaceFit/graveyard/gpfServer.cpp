@@ -0,0 +1,562 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gpfConvert.h"
+#include "gpfMergeWriter.h"
+#include "gpfReader.h"
+#include "gpfStats.h"
+#include "gpfThreadPool.h"
+#include "gpfWriter.h"
+
+// number of records converted and written together, as in the tools
+#define BLOCKSIZE 65536
+
+// about the fewest bytes a point record takes, to bound a reservation by
+// the size of the file
+#define MINRECORDBYTES 16
+
+static void usage(const char *prog)
+{
+     printf ("\nrun %s as follows:\n",prog);
+     printf ("   %s [-threads N] socketPath\n",prog);
+     printf ("   %s -connect socketPath\n",prog);
+     printf ("\nwhere:\n");
+     printf ("  socketPath = unix domain socket to listen on (or connect to)\n\n");
+     printf ("  -threads N = serve up to N connections at once (default 4, 0 = one per core)\n\n");
+     printf ("  -connect = send the requests on standard input to a running server and\n");
+     printf ("             print the responses.  Exits with 1 if any request failed.\n\n");
+     printf ("  The server parses each Socet Set *.gpf once and keeps it resident, so\n");
+     printf ("  the export and merge of every surface fit iteration only cost the\n");
+     printf ("  tie points that change.  A gpf is parsed again if it changes on disk.\n");
+     printf ("  Requests are one per line, paths are relative to the server's directory:\n\n");
+     printf ("    load GPF                   parse GPF and keep it resident\n");
+     printf ("    export GPF [CSV IDS]       write the active tie points as\n");
+     printf ("                               gpfTies2LatLonHeightCSV_360sys does (default\n");
+     printf ("                               names <core>.csv, <core>.tiePointIds.txt)\n");
+     printf ("    merge GPF tfmCSV tfmGPF    write tfmGPF as mergeTransformedGPFties does.\n");
+     printf ("                               With tfmCSV - the transformed csv lines, one\n");
+     printf ("                               per active tie point, follow the request\n");
+     printf ("    unload GPF                 drop GPF from memory\n");
+     printf ("    status                     list the resident gpfs\n");
+     printf ("    shutdown                   stop the server\n\n");
+     printf ("  Each request is answered with one line, \"ok ...\" or \"error message\".\n");
+     exit(1);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// resident gpfs
+/////////////////////////////////////////////////////////////////////////////
+
+//-----------------------------------------------------------------------
+// A parsed gpf.  The records are views into the mapping held by reader.
+// The active tie points are converted to degrees once, when loaded.
+//-----------------------------------------------------------------------
+struct ResidentGpf {
+  std::string                 path;
+  struct timespec             mtime;
+  off_t                       size;
+
+  GpfReader                   reader;
+  std::vector<GpfPointRecord> records;
+  std::vector<uint32_t>       ties;     // record numbers of the active tie points
+  std::vector<double>         ddLat, ddLon360;
+};
+
+static bool sameFile(const ResidentGpf &gpf, const struct stat &st)
+{
+  return gpf.size == st.st_size && gpf.mtime.tv_sec == st.st_mtim.tv_sec &&
+         gpf.mtime.tv_nsec == st.st_mtim.tv_nsec;
+}
+
+static std::shared_ptr<ResidentGpf> loadGpf(const std::string &path, const struct stat &st,
+                                            std::string &error)
+{
+  std::shared_ptr<ResidentGpf> gpf(new ResidentGpf);
+  gpf->path = path;
+  gpf->mtime = st.st_mtim;
+  gpf->size = st.st_size;
+
+  if (!gpf->reader.open(path.c_str())) {
+    error = "unable to open input gpf file: " + path;
+    if (!gpf->reader.error().empty())
+      error += ": " + gpf->reader.error();
+    return NULL;
+  }
+
+  // sized from the records read, not the header, which may claim any
+  // number of points
+  gpf->records.reserve(std::min((size_t) gpf->reader.numPoints(),
+                                gpf->reader.fileSize() / MINRECORDBYTES));
+  GpfPointRecord rec;
+  while (gpf->reader.next(rec))
+    gpf->records.push_back(rec);
+  if (!gpf->reader.error().empty()) {
+    error = "error reading input gpf file: " + path + ": " + gpf->reader.error();
+    return NULL;
+  }
+  size_t nrec = gpf->records.size();
+
+  std::vector<double> radLat, radLon;
+  for (size_t i = 0; i < nrec; i++) {
+    const GpfPointRecord &rec = gpf->records[i];
+    if (rec.statValue() == 1 && rec.knownValue() == 0) {
+      gpf->ties.push_back((uint32_t) i);
+      radLat.push_back(gpfToDouble(rec.lat));
+      radLon.push_back(gpfToDouble(rec.lon));
+    }
+  }
+  size_t nties = gpf->ties.size();
+  gpf->ddLat.resize(nties);
+  gpf->ddLon360.resize(nties);
+  if (gpf->reader.layout() == GpfGxp)
+    gpfDegreesToDegrees360(nties, radLat.data(), radLon.data(),
+                           gpf->ddLat.data(), gpf->ddLon360.data());
+  else
+    gpfRadiansToDegrees360(nties, radLat.data(), radLon.data(),
+                           gpf->ddLat.data(), gpf->ddLon360.data());
+  return gpf;
+}
+
+//-----------------------------------------------------------------------
+// The resident gpfs by real path.  Requests on different connections may
+// share a gpf; a gpf is only ever replaced, never changed, so a request
+// keeps using the one it looked up even if it is reloaded meanwhile.
+//-----------------------------------------------------------------------
+class ResidentTable {
+ public:
+  // Returns the gpf at path, parsing it if it is not resident or has
+  // changed on disk since it was parsed
+  std::shared_ptr<ResidentGpf> get(const std::string &name, std::string &error) {
+    char *real = realpath(name.c_str(), NULL);
+    if (!real) {
+      error = "unable to open input gpf file: " + name;
+      return NULL;
+    }
+    std::string path(real);
+    free(real);
+
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+      error = "unable to open input gpf file: " + name;
+      return NULL;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto it = m_gpfs.find(path);
+      if (it != m_gpfs.end() && sameFile(*it->second, st))
+        return it->second;
+    }
+
+    std::shared_ptr<ResidentGpf> gpf = loadGpf(path, st, error);
+    if (gpf) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_gpfs[path] = gpf;
+    }
+    return gpf;
+  }
+
+  bool drop(const std::string &name) {
+    char *real = realpath(name.c_str(), NULL);
+    std::string path(real ? real : name.c_str());
+    free(real);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_gpfs.erase(path) > 0;
+  }
+
+  std::vector<std::shared_ptr<ResidentGpf> > list() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<std::shared_ptr<ResidentGpf> > gpfs;
+    for (auto &it : m_gpfs)
+      gpfs.push_back(it.second);
+    return gpfs;
+  }
+
+ private:
+  std::mutex                                          m_mutex;
+  std::map<std::string, std::shared_ptr<ResidentGpf> > m_gpfs;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// requests
+/////////////////////////////////////////////////////////////////////////////
+
+// Writes the csv and point id list of the active tie points, the same
+// bytes gpfTies2LatLonHeightCSV_360sys writes
+static std::string exportResident(const ResidentGpf &gpf, const std::string &csvFile,
+                                  const std::string &pointIDsFile)
+{
+  GpfWriter csv, pts;
+  if (!csv.open(csvFile.c_str()))
+    return "unable to open output csv file: " + csvFile;
+  if (!pts.open(pointIDsFile.c_str()))
+    return "unable to open output list file of tie point ids: " + pointIDsFile;
+
+  for (size_t t = 0; t < gpf.ties.size(); t++) {
+    const GpfPointRecord &rec = gpf.records[gpf.ties[t]];
+    csv.putFixed(gpf.ddLat[t], 14);
+    csv.put(',');
+    csv.putFixed(gpf.ddLon360[t], 14);
+    csv.put(',');
+    csv.write(rec.height);
+    csv.put('\n');
+    pts.write(rec.pointID);
+    pts.put('\n');
+  }
+
+  if (!csv.close())
+    return "error writing output csv file: " + csvFile;
+  if (!pts.close())
+    return "error writing output list file of tie point ids: " + pointIDsFile;
+  return std::string();
+}
+
+// Writes the merged records to tfmgpf, the same bytes
+// mergeTransformedGPFties writes
+static std::string writeMerged(const ResidentGpf &gpf, GpfLineReader &tfmcsv,
+                               GpfWriter &tfmgpf)
+{
+  gpfWriteMergedHeader(tfmgpf, gpf.reader);
+
+  GpfStats stats;
+  GpfTieCoords ties;
+  ties.textHeights = true;
+  std::vector<double> ddLat, ddLon360;
+  const GpfPointRecord *records = gpf.records.data();
+  for (size_t first = 0; first < gpf.records.size(); first += BLOCKSIZE) {
+    size_t nrec = std::min((size_t) BLOCKSIZE, gpf.records.size() - first);
+    size_t nties = gpfCountTies(records + first, nrec);
+    ties.clear();
+    ddLat.clear();
+    ddLon360.clear();
+    if (!gpfReadCsvTies(tfmcsv, nties, ddLat, ddLon360, ties))
+      return tfmcsv.failed() ? "error reading input transformed csv"
+                             : "input transformed csv has fewer lines than the active tie points";
+    ties.radLat.resize(nties);
+    ties.radLon180.resize(nties);
+    gpfDegrees360ToRadians(nties, ddLat.data(), ddLon360.data(),
+                           ties.radLat.data(), ties.radLon180.data());
+    gpfWriteMergedBlock(tfmgpf, records + first, nrec, ties, gpf.reader.layout(), stats,
+                        &gpf.reader.file());
+  }
+  return std::string();
+}
+
+// Writes tfmGPF from the resident records and one csv line per active tie
+// point.  A merge that fails removes the partial tfmGPF.
+static std::string mergeResident(const ResidentGpf &gpf, GpfLineReader &tfmcsv,
+                                 const std::string &tfmGPFFile)
+{
+  GpfWriter tfmgpf;
+  if (!tfmgpf.open(tfmGPFFile.c_str()))
+    return "unable to open output transformed ground point file: " + tfmGPFFile;
+
+  std::string error;
+  try {
+    error = writeMerged(gpf, tfmcsv, tfmgpf);
+  }
+  catch (...) {
+    tfmgpf.close();
+    unlink(tfmGPFFile.c_str());
+    throw;
+  }
+  if (error.empty() && !tfmgpf.close())
+    error = "error writing output transformed ground point file: " + tfmGPFFile;
+  if (!error.empty()) {
+    tfmgpf.close();
+    unlink(tfmGPFFile.c_str());
+  }
+  return error;
+}
+
+static bool sendAll(int fd, const char *p, size_t left)
+{
+  while (left > 0) {
+    ssize_t n = send(fd, p, left, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += n;
+    left -= (size_t) n;
+  }
+  return true;
+}
+
+static bool sendLine(int fd, const std::string &line)
+{
+  std::string out = line + "\n";
+  return sendAll(fd, out.data(), out.size());
+}
+
+static std::string plural(size_t n, const char *what)
+{
+  return std::to_string(n) + " " + what;
+}
+
+static ResidentTable     residents;
+static std::atomic<bool> stopping(false);
+static int               listenFd = -1;
+
+// Carries out one request, setting reply or error
+static void handle(const std::vector<std::string> &args, GpfLineReader &conn,
+                   std::string &reply, std::string &error)
+{
+  const std::string &cmd = args[0];
+  std::shared_ptr<ResidentGpf> gpf;
+
+  if ((cmd == "load" && args.size() == 2) ||
+      (cmd == "export" && (args.size() == 2 || args.size() == 4)) ||
+      (cmd == "merge" && args.size() == 4)) {
+    gpf = residents.get(args[1], error);
+    if (gpf && cmd == "load")
+      reply += " " + plural(gpf->records.size(), "records") + ", " +
+               plural(gpf->ties.size(), "active tie points");
+    else if (gpf && cmd == "export") {
+      std::string csvFile, pointIDsFile;
+      if (args.size() == 4) {
+        csvFile = args[2];
+        pointIDsFile = args[3];
+      }
+      else {
+        // drop the .gpf extension, as the exporter does
+        std::string corename = args[1];
+        if (corename.size() > 4)
+          corename.resize(corename.size()-4);
+        csvFile = corename + ".csv";
+        pointIDsFile = corename + ".tiePointIds.txt";
+      }
+      error = exportResident(*gpf, csvFile, pointIDsFile);
+      reply += " " + plural(gpf->ties.size(), "tie points");
+    }
+    else if (gpf && cmd == "merge") {
+      if (args[2] == "-")
+        error = mergeResident(*gpf, conn, args[3]);
+      else {
+        GpfLineReader tfmcsv;
+        if (!tfmcsv.open(args[2].c_str()))
+          error = "unable to open input transformed csv file: " + args[2];
+        else
+          error = mergeResident(*gpf, tfmcsv, args[3]);
+      }
+      reply += " " + plural(gpf->ties.size(), "tie points");
+    }
+  }
+  else if (cmd == "unload" && args.size() == 2) {
+    if (!residents.drop(args[1]))
+      error = "not resident: " + args[1];
+  }
+  else if (cmd == "status" && args.size() == 1) {
+    std::vector<std::shared_ptr<ResidentGpf> > gpfs = residents.list();
+    reply += " " + plural(gpfs.size(), "resident");
+    for (auto &g : gpfs)
+      reply += " " + g->path;
+  }
+  else if (cmd == "shutdown" && args.size() == 1) {
+    stopping = true;
+    shutdown(listenFd, SHUT_RDWR);
+  }
+  else
+    error = "bad request: " + std::string(cmd);
+}
+
+// Answers the requests on one connection until the client closes it
+static void answerRequests(int fd)
+{
+  GpfLineReader conn;
+  conn.openStream(fd);
+
+  std::string_view line;
+  while (conn.next(line)) {
+    std::vector<std::string> args;
+    std::string_view token;
+    while (!(token = gpfNextToken(line)).empty())
+      args.push_back(std::string(token));
+    if (args.empty())
+      continue;
+
+    // a request that throws (e.g. out of memory) is answered like any
+    // failed one, the pool would otherwise swallow the exception and leave
+    // the client waiting
+    std::string error, reply = "ok";
+    try {
+      handle(args, conn, reply, error);
+    }
+    catch (const std::exception &e) {
+      error = args[0] + " failed: " + e.what();
+    }
+    catch (...) {
+      error = args[0] + " failed";
+    }
+
+    if (!sendLine(fd, error.empty() ? reply : "error " + error))
+      break;
+  }
+}
+
+// One connection, on a pool thread.  Nothing may escape to the pool,
+// which would keep the exception and never close fd.
+static void serve(int fd)
+{
+  try {
+    answerRequests(fd);
+  }
+  catch (...) {
+  }
+  close(fd);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// client
+/////////////////////////////////////////////////////////////////////////////
+
+static int connectTo(const char *socketPath)
+{
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(socketPath) >= sizeof(addr.sun_path))
+    return -1;
+  strcpy(addr.sun_path, socketPath);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd >= 0 && connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+    close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+// Copies standard input to the server while printing its responses
+static int runClient(const char *socketPath)
+{
+  int fd = connectTo(socketPath);
+  if (fd < 0) {
+    printf ("unable to connect to gpf server: %s\n",socketPath);
+    return 1;
+  }
+
+  int status = 0;
+  std::thread replies([fd,&status]() {
+    GpfLineReader conn;
+    conn.openStream(fd);
+    std::string_view reply;
+    while (conn.next(reply)) {
+      fwrite(reply.data(), 1, reply.size(), stdout);
+      fflush(stdout);
+      if (reply.compare(0, 6, "error ") == 0)
+        status = 1;
+    }
+  });
+
+  std::vector<char> buffer(1 << 20);
+  while (true) {
+    ssize_t n = read(STDIN_FILENO, buffer.data(), buffer.size());
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0 || !sendAll(fd, buffer.data(), (size_t) n))
+      break;
+  }
+  shutdown(fd, SHUT_WR);
+
+  replies.join();
+  close(fd);
+  return status;
+}
+
+int main(int argc, char *argv[])
+{
+
+  // parse options, then check number of command line args and issue
+  // help if needed
+  //-----------------------------------------------------------
+  int nthreads = 4;
+  bool client = false;
+  int argi = 1;
+  while (argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0') {
+    if (strcmp(argv[argi],"-threads") == 0 && argi+1 < argc)
+      nthreads = atoi(argv[++argi]);
+    else if (strcmp(argv[argi],"-connect") == 0)
+      client = true;
+    else
+      usage(argv[0]);
+    argi++;
+  }
+
+  if (argc - argi != 1 || nthreads < 0)
+    usage(argv[0]);
+  const char *socketPath = argv[argi];
+
+  if (client)
+    return runClient(socketPath);
+
+  //------------------------------------------------
+  // listen, replacing a stale socket left behind
+  // by a server that did not shut down cleanly
+  //------------------------------------------------
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+    printf ("socket path is too long: %s\n",socketPath);
+    exit (1);
+  }
+  strcpy(addr.sun_path, socketPath);
+
+  int probe = connectTo(socketPath);
+  if (probe >= 0) {
+    close(probe);
+    printf ("a gpf server is already listening on %s\n",socketPath);
+    exit (1);
+  }
+  struct stat st;
+  if (lstat(socketPath, &st) == 0 && S_ISSOCK(st.st_mode))
+    unlink(socketPath);
+
+  listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listenFd < 0 || bind(listenFd, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+      listen(listenFd, 16) != 0) {
+    printf ("unable to listen on %s: %s\n",socketPath,strerror(errno));
+    exit (1);
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  {
+    GpfThreadPool pool((unsigned) nthreads);
+    while (!stopping) {
+      int fd = accept(listenFd, NULL, NULL);
+      if (fd < 0) {
+        if (errno == EINTR || errno == ECONNABORTED)
+          continue;
+        break;
+      }
+      pool.submit([fd]() { serve(fd); });
+    }
+    // the pool finishes the connections already accepted
+  }
+
+  close(listenFd);
+  unlink(socketPath);
+  return 0;
+
+} // end of program
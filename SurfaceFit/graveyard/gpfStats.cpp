@@ -0,0 +1,96 @@
+#include "gpfStats.h"
+
+#include <stdio.h>
+
+#include <chrono>
+
+static const char *phaseNames[GpfStats::NumPhases] = {
+  "parse", "convert", "format", "write"
+};
+
+
+GpfStats::GpfStats()
+  : wallSeconds(0.0), bytesRead(0), bytesWritten(0), records(0), control(0),
+    inactive(0), ties(0), filtered(false), selected(0), deduplicated(false),
+    duplicates(0) {
+  for (int p = 0; p < NumPhases; p++)
+    seconds[p] = 0.0;
+}
+
+
+void GpfStats::add(const GpfStats &other) {
+  for (int p = 0; p < NumPhases; p++)
+    seconds[p] += other.seconds[p];
+  wallSeconds += other.wallSeconds;
+  bytesRead += other.bytesRead;
+  bytesWritten += other.bytesWritten;
+  records += other.records;
+  control += other.control;
+  inactive += other.inactive;
+  ties += other.ties;
+  filtered = filtered || other.filtered;
+  selected += other.selected;
+  deduplicated = deduplicated || other.deduplicated;
+  duplicates += other.duplicates;
+}
+
+
+double GpfStats::now() {
+  return std::chrono::duration<double>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// s as a JSON string literal
+static std::string quote(const std::string &s) {
+  std::string q = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      q += '\\';
+      q += c;
+    }
+    else if ((unsigned char) c < 0x20) {
+      char esc[8];
+      snprintf(esc, sizeof(esc), "\\u%04x", (unsigned) c);
+      q += esc;
+    }
+    else
+      q += c;
+  }
+  return q + "\"";
+}
+
+
+std::string GpfStats::json(const char *tool, const std::string &input,
+                           const char *tiesName) const {
+  char buf[256];
+  std::string j = "{\"tool\":" + quote(tool) + ",\"input\":" + quote(input);
+  if (!output.empty())
+    j += ",\"output\":" + quote(output);
+
+  snprintf(buf, sizeof(buf), ",\"wall_seconds\":%.6f,\"phase_seconds\":{", wallSeconds);
+  j += buf;
+  for (int p = 0; p < NumPhases; p++) {
+    snprintf(buf, sizeof(buf), "%s\"%s\":%.6f", p ? "," : "", phaseNames[p], seconds[p]);
+    j += buf;
+  }
+
+  snprintf(buf, sizeof(buf), "},\"bytes_read\":%llu,\"bytes_written\":%llu,\"records\":%llu",
+           (unsigned long long) bytesRead, (unsigned long long) bytesWritten,
+           (unsigned long long) records);
+  j += buf;
+  snprintf(buf, sizeof(buf), ",\"categories\":{\"control\":%llu,\"inactive_ties\":%llu,\"%s\":%llu}}",
+           (unsigned long long) control, (unsigned long long) inactive, tiesName,
+           (unsigned long long) ties);
+  j += buf;
+  if (filtered) {
+    j.pop_back();
+    snprintf(buf, sizeof(buf), ",\"selected\":%llu}", (unsigned long long) selected);
+    j += buf;
+  }
+  if (deduplicated) {
+    j.pop_back();
+    snprintf(buf, sizeof(buf), ",\"duplicates\":%llu}", (unsigned long long) duplicates);
+    j += buf;
+  }
+  return j;
+}
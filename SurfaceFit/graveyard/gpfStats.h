@@ -0,0 +1,78 @@
+#ifndef gpfStats_h
+#define gpfStats_h
+
+// Counters and phase timers behind the -stats output of the GPF tools.
+//
+// Each run keeps the wall time it spent parsing its inputs (which, for a
+// mapped file, includes faulting the file in from disk), converting
+// coordinates, formatting output records and writing them (the time
+// spent in write(2)), the bytes it read and wrote, and how many point
+// records fell into each of the stat/known categories the tools treat
+// differently.  -stats prints them as one JSON object per run, on its own
+// line, so a scheduler can collect them from standard output.
+
+#include <stdint.h>
+#include <string>
+
+struct GpfStats {
+  enum Phase { Parse, Convert, Format, Write, NumPhases };
+
+  double   seconds[NumPhases];
+  double   wallSeconds;
+  uint64_t bytesRead;
+  uint64_t bytesWritten;
+
+  uint64_t records;
+  uint64_t control;     // known > 0
+  uint64_t inactive;    // stat == 0 && known == 0
+  uint64_t ties;        // stat == 1 && known == 0
+
+  // Points written by an exporter run with a point filter (gpfFilter.h),
+  // which is the only time they are reported
+  bool     filtered;
+  uint64_t selected;
+
+  // Records gpfMerge dropped for repeating a point ID already written,
+  // only reported by it
+  bool     deduplicated;
+  uint64_t duplicates;
+
+  // The file written, reported after the input when set, by the tools
+  // whose input is not one file (gpfMerge)
+  std::string output;
+
+  GpfStats();
+
+  // Counts one record into its category
+  void count(int stat, int known) {
+    records++;
+    if (known > 0)
+      control++;
+    else if (stat == 0)
+      inactive++;
+    else if (stat == 1)
+      ties++;
+  }
+
+  // Adds the counters and phase times of other, e.g. a part done on
+  // another thread (phase times then add up across threads)
+  void add(const GpfStats &other);
+
+  // The counters as a single line JSON object.  tiesName names the
+  // category of the ties the tool works on ("exported_ties" or
+  // "transformed_ties").
+  std::string json(const char *tool, const std::string &input,
+                   const char *tiesName) const;
+
+  // Seconds on a monotonic clock, for timing phases
+  static double now();
+
+  // Adds the time since mark to phase and moves mark on to now
+  void lap(Phase phase, double &mark) {
+    double t = now();
+    seconds[phase] += t - mark;
+    mark = t;
+  }
+};
+
+#endif
@@ -0,0 +1,44 @@
+#include "gpfThreadPool.h"
+
+
+unsigned GpfThreadPool::threadCount(unsigned n) {
+  if (n > 0)
+    return n;
+  unsigned hw = std::thread::hardware_concurrency();
+  return hw > 0 ? hw : 1;
+}
+
+
+GpfThreadPool::GpfThreadPool(unsigned nthreads) : m_stopping(false) {
+  nthreads = threadCount(nthreads);
+  m_workers.reserve(nthreads);
+  for (unsigned i = 0; i < nthreads; i++)
+    m_workers.emplace_back(&GpfThreadPool::work, this);
+}
+
+
+GpfThreadPool::~GpfThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_ready.notify_all();
+  for (std::thread &t : m_workers)
+    t.join();
+}
+
+
+void GpfThreadPool::work() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_ready.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+      if (m_queue.empty())
+        return;
+      task = std::move(m_queue.front());
+      m_queue.pop_front();
+    }
+    task();
+  }
+}
@@ -0,0 +1,58 @@
+#ifndef gpfThreadPool_h
+#define gpfThreadPool_h
+
+// Fixed size worker pool for the GPF tools.  Tasks run in submission
+// order on whichever worker is free; submit() hands back a future for the
+// task's result so callers can collect results in their original order.
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class GpfThreadPool {
+ public:
+  // nthreads == 0 uses one worker per hardware thread
+  explicit GpfThreadPool(unsigned nthreads = 0);
+
+  // Runs whatever is still queued, then joins the workers
+  ~GpfThreadPool();
+
+  GpfThreadPool(const GpfThreadPool &) = delete;
+  GpfThreadPool &operator=(const GpfThreadPool &) = delete;
+
+  unsigned size() const { return (unsigned) m_workers.size(); }
+
+  template <class F>
+  std::future<typename std::invoke_result<F>::type> submit(F task) {
+    typedef typename std::invoke_result<F>::type R;
+    std::shared_ptr<std::packaged_task<R()> > job =
+      std::make_shared<std::packaged_task<R()> >(std::move(task));
+    std::future<R> result = job->get_future();
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_queue.push_back([job]() { (*job)(); });
+    }
+    m_ready.notify_one();
+    return result;
+  }
+
+  // Number of workers to use when the user asks for n (0 = all)
+  static unsigned threadCount(unsigned n);
+
+ private:
+  void work();
+
+  std::vector<std::thread>          m_workers;
+  std::deque<std::function<void()> > m_queue;
+  std::mutex                        m_mutex;
+  std::condition_variable           m_ready;
+  bool                              m_stopping;
+};
+
+#endif
@@ -6,32 +6,116 @@
 #include <ctype.h>
 #include <stdlib.h>
 
-#define LINELENGTH 200
-#define FILELEN 512
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gpfAsyncIO.h"
+#include "gpfBatch.h"
+#include "gpfBinary.h"
+#include "gpfCompress.h"
+#include "gpfConvert.h"
+#include "gpfCsvFormat.h"
+#include "gpfErrorStats.h"
+#include "gpfFilter.h"
+#include "gpfIndexFile.h"
+#include "gpfPointCloud.h"
+#include "gpfReader.h"
+#include "gpfStats.h"
+#include "gpfThreadPool.h"
+#include "gpfTiles.h"
+#include "gpfWriter.h"
+
 #define MAXFILES 50
 #define MAXPOINTS 2000
 
-main(int argc, char *argv[])
-{
-
-  char     gpfFile[FILELEN];
-  char     csvFile[FILELEN];
-  char     pointIDsFile[FILELEN];
+// number of records parsed and converted together
+#define BLOCKSIZE 65536
 
-  FILE     *gpfFp;     // file pointer to input csv file
-  FILE     *csvFp;     // file pointer to output csv file
-  FILE     *ptsFp;     // file pointer to output point ids list file
+// with -threads, the gpf is cut into this many parts per worker
+#define CHUNKSPERTHREAD 8
 
-  char     gpfLine[LINELENGTH];
+// typical csv and point id list line lengths, for preallocating them
+#define CSVLINEBYTES 60
+#define IDLINEBYTES 16
 
-  // check number of command line args and issue help if needed
-  //-----------------------------------------------------------
-  if (argc != 2) {
-     printf ("\nrun %s as follows:\n",argv[0]);
-     printf ("   %s SSgpfFile\n",
-             argv[0]);
+static void usage(const char *prog)
+{
+     printf ("\nrun %s as follows:\n",prog);
+     printf ("   %s [-threads N] [-stats] [-binary | -ecef] [-datum name | -radii a b]\n",
+             prog);
+     printf ("      [-compress gz|zst] [-zthreads N] [-direct] [-fadvise] [-pipeline]\n");
+     printf ("      [-stat list] [-known list] [-allpoints] [-bbox minLat maxLat minLon maxLon]\n");
+     printf ("      [-ids file] [-index] [-errors] [-columns order] [-lon180] SSgpfFile\n");
+     printf ("   %s [-threads N] [-stats] -tiles latDeg lonDeg [-overlap deg] SSgpfFile\n",
+             prog);
+     printf ("   %s [-jobs N] [options] -batch manifest\n",
+             prog);
      printf ("\nwhere:\n");
-     printf ("  SSgpfFile = Socet Set *.gpf file, from a geographic project\n\n");
+     printf ("  SSgpfFile = Socet Set *.gpf file, from a geographic project.  It may be\n");
+     printf ("              gzip or zstd compressed (e.g. *.gpf.gz, *.gpf.zst)\n\n");
+     printf ("  -threads N = parse and convert the gpf on N threads (0 = one per core).\n");
+     printf ("               The output is identical to a single threaded run.\n\n");
+     printf ("  -binary = write the tie points as a binary columnar *.tiePoints.bin file\n");
+     printf ("            (lat, lon360, height arrays and the point IDs) instead of the CSV\n");
+     printf ("            and point ID list.  mergeTransformedGPFties reads it in place of a\n");
+     printf ("            tfmCSV.  The datum (D_MARS unless -datum or -radii is given) is\n");
+     printf ("            recorded in the file header.\n\n");
+     printf ("  -ecef = write the tie points as ECEF x,y,z on the datum to a *.tiePoints.tif\n");
+     printf ("          point cloud (three float64 bands, like a stereo *-PC.tif) that\n");
+     printf ("          pc_align reads directly, with the point ID list, instead of the\n");
+     printf ("          CSV.  Merge the result back with mergeTransformedGPFties -matrix.\n\n");
+     printf ("  -tiles latDeg lonDeg = split the tie points into latDeg x lonDeg tiles\n");
+     printf ("          (rows from latitude -90, columns from longitude 0 to 360) and\n");
+     printf ("          write a *.tile_<row>_<col>.csv and .tiePointIds.txt for each tile\n");
+     printf ("          that has points, listed in *.tiles.txt, so each can go to its own\n");
+     printf ("          pc_align run.  With -overlap deg a tile also gets the points of\n");
+     printf ("          its neighbours within deg of it, marked \"overlap\" in its ID list.\n");
+     printf ("          Concatenate the transformed CSVs and the ID lists in the same\n");
+     printf ("          order and merge them with mergeTransformedGPFties -join, which\n");
+     printf ("          takes each point from the tile that owns it.\n\n");
+     printf ("  -stat list, -known list = export the points whose stat (known) is one of\n");
+     printf ("          list, e.g. 0,1, or any, instead of the active tie points (stat 1,\n");
+     printf ("          known 0)\n\n");
+     printf ("  -allpoints = export every point, control included (-stat any -known any)\n\n");
+     printf ("  -bbox minLat maxLat minLon maxLon = export only the points inside the\n");
+     printf ("          box, in degrees, longitudes in either domain (minLon > maxLon\n");
+     printf ("          wraps through 0)\n\n");
+     printf ("  -ids file = export only the points named in file, one ID per line\n");
+     printf ("          (e.g. a .tiePointIds.txt).  The selection options combine; merge\n");
+     printf ("          -join expects every active tie point, so a subset is merged back\n");
+     printf ("          with the rest of the points, or into an earlier merge with -update\n\n");
+     printf ("  -index = also write the <corename>.gpfidx point index of SSgpfFile (the\n");
+     printf ("          byte offset and ordinal of every record, by point ID), which\n");
+     printf ("          mergeTransformedGPFties -update uses to go straight to the points\n");
+     printf ("          it patches.  SSgpfFile must not be compressed\n\n");
+     printf ("  -errors = also write <corename>.errors.csv, the count, mean, RMS, min,\n");
+     printf ("          max and 50/90/95/99th percentiles of the sigmas and residuals of\n");
+     printf ("          every record, by known value, gathered as the gpf is read\n\n");
+     printf ("  -columns order = write the CSV columns in order, e.g. lon,lat,height\n");
+     printf ("          (default lat,lon,height); give pc_align the same --csv-format\n\n");
+     printf ("  -lon180 = write CSV longitudes in -180 to 180 instead of 0 to 360\n\n");
+     printf ("  -compress gz|zst = write the CSV and point ID list (or the binary\n");
+     printf ("          file) compressed, as *.csv.gz, *.tiePointIds.txt.gz and so on\n\n");
+     printf ("  -zthreads N = compress zst output on N threads (default 0 = one per core)\n\n");
+     printf ("  -direct = write the outputs with O_DIRECT, around the page cache\n\n");
+     printf ("  -fadvise = write back each output block as it is written and drop it\n");
+     printf ("             from the page cache, so a large export does not fill it\n\n");
+     printf ("  -pipeline = read SSgpfFile ahead and write the outputs behind in the\n");
+     printf ("              background (io_uring where the kernel has it), overlapping\n");
+     printf ("              reading, converting and writing.  The output is the same\n\n");
+     printf ("  -stats = print the wall time of each phase (parse, convert, format,\n");
+     printf ("           write), the bytes read and written and the number of records\n");
+     printf ("           of each stat/known category as one line of JSON per gpf (and,\n");
+     printf ("           with the selection options, the number of points selected)\n\n");
+     printf ("  -batch manifest = export every gpf named in manifest (- for standard\n");
+     printf ("            input), one per line, each line holding the arguments of one\n");
+     printf ("            run (options then SSgpfFile; the command line options are the\n");
+     printf ("            defaults).  Up to N gpfs (-jobs, 0 = one per core, at most %d)\n",MAXFILES);
+     printf ("            are exported at once, failures are reported by manifest line.\n\n");
      printf ("  This program will convert a Socet Set ground point file into a CSV\n");
      printf ("  of lat,lon,height.  The output file will have the same core name\n");
      printf ("  of the input *.gpf file, but with a .csv extension\n\n");
@@ -40,102 +124,621 @@ main(int argc, char *argv[])
      printf ("  file will have the same core name as the input file, but with a .pointids\n");
      printf ("  .tiePointIds.txt extension.\n");
      exit(1);
+}
+
+//-----------------------------------------------------------------------
+// Parse gpf a block of records at a time, collecting the coordinates of
+// the tie points that are on (or the points filter accepts), convert them
+// in one batch and output csv
+//-----------------------------------------------------------------------
+static double writeSeconds(const GpfWriter &csv, const GpfWriter &pts)
+{
+  return csv.writeSeconds() + pts.writeSeconds();
+}
+
+static void exportTies(GpfReader &gpf, GpfWriter &csv, GpfWriter &pts,
+                       GpfBinaryWriter *bin, GpfPointCloudWriter *cloud,
+                       GpfTieTiles *tiles, const GpfPointFilter *filter,
+                       GpfIndexBuilder *index, GpfErrorStats *errors,
+                       const GpfCsvFormat &format, GpfStats &stats)
+{
+  double mark = GpfStats::now();
+  std::vector<GpfPointRecord> block(BLOCKSIZE);
+  std::vector<const GpfPointRecord *> ties;
+  std::vector<double> radLat, radLon, ddLat(BLOCKSIZE), ddLon360(BLOCKSIZE);
+  std::vector<double> height(BLOCKSIZE);
+  std::vector<unsigned char> inside(BLOCKSIZE);
+  ties.reserve(BLOCKSIZE);
+  radLat.reserve(BLOCKSIZE);
+  radLon.reserve(BLOCKSIZE);
+
+  size_t nrec;
+  while ((nrec = gpf.nextBlock(block.data(),BLOCKSIZE)) > 0) {
+    ties.clear();
+    radLat.clear();
+    radLon.clear();
+
+    //only output tie points that are on
+    for (size_t i=0; i<nrec; i++) {
+      const GpfPointRecord &rec = block[i];
+      int stat = rec.statValue();
+      int known = rec.knownValue();
+      stats.count(stat,known);
+      if (index)
+        index->add(rec.pointID,rec.raw);
+      if (filter ? filter->accepts(rec.pointID,stat,known) : (stat == 1 && known == 0)) {
+        ties.push_back(&rec);
+        radLat.push_back(gpfToDouble(rec.lat));
+        radLon.push_back(gpfToDouble(rec.lon));
+      }
+    }
+    if (errors)
+      errors->add(block.data(),nrec);
+    stats.lap(GpfStats::Parse,mark);
+
+    size_t nties = ties.size();
+    if (gpf.layout() == GpfGxp)
+      gpfDegreesToDegrees360(nties,radLat.data(),radLon.data(),ddLat.data(),ddLon360.data());
+    else
+      gpfRadiansToDegrees360(nties,radLat.data(),radLon.data(),ddLat.data(),ddLon360.data());
+
+    // drop the points outside the -bbox, keeping the rest in order
+    if (filter && filter->hasBox()) {
+      gpfInsideBox(filter->box(),nties,ddLat.data(),ddLon360.data(),inside.data());
+      size_t kept = 0;
+      for (size_t t=0; t<nties; t++) {
+        if (!inside[t])
+          continue;
+        ties[kept] = ties[t];
+        radLat[kept] = radLat[t];
+        radLon[kept] = radLon[t];
+        ddLat[kept] = ddLat[t];
+        ddLon360[kept] = ddLon360[t];
+        kept++;
+      }
+      nties = kept;
+      ties.resize(nties);
+      radLat.resize(nties);
+      radLon.resize(nties);
+    }
+    if (filter)
+      stats.selected += nties;
+    stats.lap(GpfStats::Convert,mark);
+
+    if (bin) {
+      for (size_t t=0; t<nties; t++)
+        bin->add(ties[t]->pointID,ddLat[t],ddLon360[t],gpfToDouble(ties[t]->height));
+      stats.lap(GpfStats::Format,mark);
+      continue;
+    }
+
+    // the tiles are written once all the points are in
+    if (tiles) {
+      for (size_t t=0; t<nties; t++)
+        tiles->add(ties[t]->pointID,ddLat[t],ddLon360[t],ties[t]->height);
+      stats.lap(GpfStats::Format,mark);
+      continue;
+    }
+
+    // the ID list is still written, pixel i of the cloud is line i
+    if (cloud) {
+      if (gpf.layout() == GpfGxp)
+        gpfDegrees360ToRadians(nties,ddLat.data(),ddLon360.data(),radLat.data(),radLon.data());
+      for (size_t t=0; t<nties; t++)
+        height[t] = gpfToDouble(ties[t]->height);
+      cloud->addGeodetic(nties,radLat.data(),radLon.data(),height.data());
+      stats.lap(GpfStats::Convert,mark);
+
+      double written = pts.writeSeconds();
+      for (size_t t=0; t<nties; t++) {
+        pts.write(ties[t]->pointID);
+        pts.put('\n');
+      }
+      stats.lap(GpfStats::Format,mark);
+      written = pts.writeSeconds() - written;
+      stats.seconds[GpfStats::Format] -= written;
+      stats.seconds[GpfStats::Write] += written;
+      continue;
+    }
+
+    // the buffers are flushed as they fill, count that time as writing;
+    // the loop is compiled for each column layout (gpfCsvFormat.h)
+    double written = writeSeconds(csv,pts);
+    gpfWithCsvLayout(format,[&](auto layout) {
+      typedef decltype(layout) Layout;
+      for (size_t t=0; t<nties; t++) {
+        Layout::put(csv,ddLat[t],ddLon360[t],ties[t]->height);
+        pts.write(ties[t]->pointID);
+        pts.put('\n');
+      }
+    });
+    stats.lap(GpfStats::Format,mark);
+    written = writeSeconds(csv,pts) - written;
+    stats.seconds[GpfStats::Format] -= written;
+    stats.seconds[GpfStats::Write] += written;
   }
+  stats.lap(GpfStats::Parse,mark);
+}
 
-  //------------------------------------------------
-  // get input arguments entered at the command line
-  //------------------------------------------------
+//-----------------------------------------------------------------------
+// -threads mode.  The gpf is split at record boundaries into parts that
+// are exported concurrently into memory, and the parts are written out in
+// file order as they complete.  Only a couple of parts per worker are in
+// flight at once, which bounds the memory held by formatted output.
+// Returns the first parse error, if any.
+//-----------------------------------------------------------------------
+struct ExportedPart {
+  GpfWriter           csv;
+  GpfWriter           pts;
+  GpfBinaryWriter     bin;
+  GpfPointCloudWriter cloud;
+  GpfTieTiles         tiles;
+  GpfIndexBuilder     index;
+  GpfErrorStats       errors;
+  GpfStats            stats;
+  std::string         error;
+
+  ExportedPart(const GpfDatum &datum, const char *base)
+    : csv(1 << 20), pts(1 << 18), cloud(datum), index(base) { csv.openMemory(); pts.openMemory(); }
+};
+
+static std::string exportTiesParallel(GpfReader &gpf, unsigned nthreads,
+                                      GpfWriter &csv, GpfWriter &pts,
+                                      GpfBinaryWriter *bin, GpfPointCloudWriter *cloud,
+                                      GpfTieTiles *tiles, const GpfDatum &datum,
+                                      const GpfPointFilter *filter, GpfIndexBuilder *index,
+                                      GpfErrorStats *errors, const GpfCsvFormat &format,
+                                      GpfStats &stats)
+{
+  GpfThreadPool pool(nthreads);
+  double mark = GpfStats::now();
+  std::vector<GpfRecordRange> parts = gpf.split(pool.size()*CHUNKSPERTHREAD,&pool);
+  stats.lap(GpfStats::Parse,mark);
+
+  std::deque<std::future<std::unique_ptr<ExportedPart> > > inflight;
+  size_t submitted = 0;
+  while (submitted < parts.size() || !inflight.empty()) {
+    while (submitted < parts.size() && inflight.size() < 2*pool.size()) {
+      GpfRecordRange range = parts[submitted++];
+      bool binary = (bin != NULL);
+      bool ecef = (cloud != NULL);
+      bool tiled = (tiles != NULL);
+      bool indexed = (index != NULL);
+      bool summed = (errors != NULL);
+      const char *base = gpf.file().data();
+      inflight.push_back(pool.submit([range,binary,ecef,tiled,indexed,summed,base,datum,filter,
+                                      format]() {
+        std::unique_ptr<ExportedPart> part(new ExportedPart(datum,base));
+        GpfReader reader;
+        reader.openRange(range);
+        exportTies(reader,part->csv,part->pts,binary ? &part->bin : NULL,
+                   ecef ? &part->cloud : NULL,tiled ? &part->tiles : NULL,filter,
+                   indexed ? &part->index : NULL,summed ? &part->errors : NULL,format,
+                   part->stats);
+        part->error = reader.error();
+        return part;
+      }));
+    }
+
+    std::unique_ptr<ExportedPart> part = inflight.front().get();
+    inflight.pop_front();
+    stats.add(part->stats);
+    mark = GpfStats::now();
+    if (index)
+      index->append(part->index);
+    if (errors)
+      errors->merge(part->errors);
+    if (bin) {
+      bin->append(part->bin);
+      stats.lap(GpfStats::Format,mark);
+    }
+    else {
+      if (cloud)
+        cloud->append(part->cloud);
+      if (tiles)
+        tiles->append(part->tiles);
+      csv.write(part->csv.buffer());
+      pts.write(part->pts.buffer());
+      stats.lap(GpfStats::Write,mark);
+    }
+    if (!part->error.empty()) {
+      // let the parts already running finish before the pool goes away
+      for (auto &f : inflight)
+        f.wait();
+      return part->error;
+    }
+  }
+  return std::string();
+}
+
+//-----------------------------------------------------------------------
+// One export run.  The options come from the command line, or from a
+// line of a -batch manifest on top of the command line ones.
+//-----------------------------------------------------------------------
+struct ExportJob {
+  std::string gpfFile;
+  int         nthreads;
+  bool        binary;
+  bool        ecef;
+  bool        stats;
+  GpfDatum    datum;
+  double      tileLat;      // -tiles, 0 if not given
+  double      tileLon;
+  double      overlap;      // -overlap, degrees
+  std::string compress;     // -compress, the output suffix (".gz", ".zst") or empty
+  GpfFilterSpec filter;     // -stat, -known, -allpoints, -bbox and -ids
+  bool        index;        // -index, write the .gpfidx sidecar
+  bool        errors;       // -errors, write the sigma/residual summary
+  GpfCsvFormat csvFormat;   // -columns and -lon180
+
+  ExportJob() : nthreads(1), binary(false), ecef(false), stats(false),
+                datum(GpfDatum::mars()), tileLat(0.0), tileLon(0.0), overlap(0.0),
+                index(false), errors(false) {}
+};
+
+// Parses "[options] SSgpfFile" from args[argi...] into job.  -batch,
+// -jobs, -zthreads, -direct, -fadvise and -pipeline are only accepted when
+// manifest, njobs, zthreads, output and pipelined are given (the command
+// line rather than a manifest line), and with -batch there is no
+// SSgpfFile.  Returns false with error set on a bad argument.
+static bool parseExportArgs(const std::vector<std::string> &args, size_t argi,
+                            ExportJob &job, std::string &error,
+                            const char **manifest = NULL, int *njobs = NULL,
+                            int *zthreads = NULL, GpfOutputOptions *output = NULL,
+                            bool *pipelined = NULL)
+{
+  while (argi < args.size() && args[argi].size() > 1 && args[argi][0] == '-') {
+    const std::string &opt = args[argi];
+    if (opt == "-threads" && argi+1 < args.size())
+      job.nthreads = atoi(args[++argi].c_str());
+    else if (opt == "-binary")
+      job.binary = true;
+    else if (opt == "-ecef")
+      job.ecef = true;
+    else if (opt == "-tiles" && argi+2 < args.size()) {
+      job.tileLat = atof(args[++argi].c_str());
+      job.tileLon = atof(args[++argi].c_str());
+    }
+    else if (opt == "-overlap" && argi+1 < args.size())
+      job.overlap = atof(args[++argi].c_str());
+    else if (opt == "-compress" && argi+1 < args.size()) {
+      const std::string &format = args[++argi];
+      if (format != "gz" && format != "zst") {
+        error = "unknown -compress format: " + format + " (use gz or zst)";
+        return false;
+      }
+      job.compress = "." + format;
+      if (!gpfCompressionSupported(format == "gz" ? GpfGzip : GpfZstd,error))
+        return false;
+    }
+    else if (opt == "-stat" && argi+1 < args.size()) {
+      if (!GpfFilterSpec::parseValues(args[++argi],job.filter.statMask,error))
+        return false;
+    }
+    else if (opt == "-known" && argi+1 < args.size()) {
+      if (!GpfFilterSpec::parseValues(args[++argi],job.filter.knownMask,error))
+        return false;
+    }
+    else if (opt == "-allpoints" || opt == "--all-points") {
+      job.filter.statMask = GpfFilterSpec::AnyValue;
+      job.filter.knownMask = GpfFilterSpec::AnyValue;
+    }
+    else if (opt == "-bbox" && argi+4 < args.size()) {
+      double minLat = atof(args[++argi].c_str());
+      double maxLat = atof(args[++argi].c_str());
+      double minLon = atof(args[++argi].c_str());
+      double maxLon = atof(args[++argi].c_str());
+      if (!job.filter.setBox(minLat,maxLat,minLon,maxLon,error))
+        return false;
+    }
+    else if (opt == "-ids" && argi+1 < args.size())
+      job.filter.idsFile = args[++argi];
+    else if (opt == "-index")
+      job.index = true;
+    else if (opt == "-errors")
+      job.errors = true;
+    else if (opt == "-columns" && argi+1 < args.size()) {
+      if (!GpfCsvFormat::parseColumns(args[++argi],job.csvFormat,error))
+        return false;
+    }
+    else if (opt == "-lon180")
+      job.csvFormat.domain = GpfLon180;
+    else if (opt == "-stats" || opt == "--stats")
+      job.stats = true;
+    else if (opt == "-datum" && argi+1 < args.size()) {
+      if (!GpfDatum::fromName(args[++argi].c_str(),job.datum)) {
+        error = "unknown datum: " + args[argi] + " (use D_MARS, MOLA, D_MOON or WGS84)";
+        return false;
+      }
+    }
+    else if (opt == "-radii" && argi+2 < args.size()) {
+      argi += 2;
+      if (!GpfDatum::fromRadii(args[argi-1].c_str(),args[argi].c_str(),job.datum)) {
+        error = "-radii expects two positive radii in meters, the semi-major one first: " +
+                args[argi-1] + " " + args[argi];
+        return false;
+      }
+    }
+    else if (manifest && opt == "-batch" && argi+1 < args.size())
+      *manifest = args[++argi].c_str();
+    else if (njobs && opt == "-jobs" && argi+1 < args.size())
+      *njobs = atoi(args[++argi].c_str());
+    else if (zthreads && opt == "-zthreads" && argi+1 < args.size())
+      *zthreads = atoi(args[++argi].c_str());
+    else if (output && opt == "-direct")
+      output->directIO = true;
+    else if (output && opt == "-fadvise")
+      output->dropCache = true;
+    else if (pipelined && opt == "-pipeline")
+      *pipelined = true;
+    else {
+      error = "unknown or incomplete option: " + opt;
+      return false;
+    }
+    argi++;
+  }
 
-  strcpy (gpfFile,argv[1]);
+  if (job.nthreads < 0) {
+    error = "-threads must be 0 or more";
+    return false;
+  }
+  if (njobs && *njobs < 0) {
+    error = "-jobs must be 0 or more";
+    return false;
+  }
+  if (zthreads && *zthreads < 0) {
+    error = "-zthreads must be 0 or more";
+    return false;
+  }
+  if (!job.compress.empty() && (job.ecef || job.tileLat > 0.0)) {
+    error = "-compress is for the csv, point id list and binary outputs, not -ecef or -tiles";
+    return false;
+  }
+  if (!job.csvFormat.isDefault() && (job.binary || job.ecef || job.tileLat > 0.0)) {
+    error = "-columns and -lon180 are for the csv output, not -binary, -ecef or -tiles";
+    return false;
+  }
+  if (job.binary + job.ecef + (job.tileLat > 0.0) > 1) {
+    error = "-binary, -ecef and -tiles are different outputs, give one of them";
+    return false;
+  }
+  if (job.tileLat > 0.0 &&
+      !GpfTieTiles::checkSizes(job.tileLat,job.tileLon,job.overlap,error))
+    return false;
+  if (manifest && *manifest) {
+    if (argi != args.size()) {
+      error = "no SSgpfFile is given with -batch";
+      return false;
+    }
+    return true;
+  }
+  if (args.size() - argi != 1) {
+    error = "expected a single SSgpfFile";
+    return false;
+  }
+  job.gpfFile = args[argi];
+  return true;
+}
+
+// Exports job.gpfFile to its csv and point id list (or binary file).
+// Returns an empty string on success, else what went wrong.  With
+// job.stats, statsJson is set to the -stats line of a successful run.
+static std::string exportGpf(const ExportJob &job, std::string &statsJson)
+{
+  GpfStats stats;
+  double start = GpfStats::now();
+
+  GpfReader gpf;       // mapped input gpf file
+  GpfWriter csv;       // output csv file
+  GpfWriter pts;       // output point ids list file
 
   //-----------------------------
   // generate ouput file names
   //-----------------------------
 
-  char corename[FILELEN];
-  strcpy (corename,gpfFile);
-  int len = strlen(corename);
-  corename[len-4] = '\0';
-
-  strcpy (csvFile,corename);
-  strcat (csvFile,".csv");
+  // drop the .gpf extension, and the .gz or .zst of a compressed gpf
+  std::string corename = job.gpfFile;
+  GpfCompression inputCompression = gpfCompressionOf(corename.c_str());
+  if (inputCompression != GpfUncompressed)
+    corename.resize(corename.size() - (inputCompression == GpfGzip ? 3 : 4));
+  if (corename.size() > 4)
+    corename.resize(corename.size()-4);
 
-  strcpy (pointIDsFile,corename);
-  strcat (pointIDsFile,".tiePointIds.txt");
+  std::string csvFile = corename + ".csv" + job.compress;
+  std::string pointIDsFile = corename + ".tiePointIds.txt" + job.compress;
+  std::string binaryFile = corename + ".tiePoints.bin" + job.compress;
+  std::string cloudFile = corename + ".tiePoints.tif";
+  std::string indexFile = gpfIndexPath(job.gpfFile);
+  std::string errorsFile = corename + ".errors.csv";
 
   /////////////////////////////////////////////////////////////////////////////
   // open files 
   /////////////////////////////////////////////////////////////////////////////
 
-  gpfFp = fopen (gpfFile,"r");
-  if (gpfFp == NULL) {
-    printf ("unable to open input gpf file: %s\n",gpfFile);
-    exit (1);
+  if (!gpf.open(job.gpfFile.c_str())) {
+    std::string message = "unable to open input gpf file: " + job.gpfFile;
+    if (!gpf.error().empty())
+      message += "\n  " + gpf.error();
+    return message;
   }
 
-  csvFp = fopen (csvFile,"w");
-  if (csvFp == NULL) {
-    printf ("unable to open output csv file: %s\n",csvFile);
-    fclose(gpfFp);
-    exit (1);
-  }
+  if (job.index && gpf.compression() != GpfUncompressed)
+    return "-index needs an uncompressed gpf, the index holds offsets into the file: " +
+           job.gpfFile;
 
-  ptsFp = fopen (pointIDsFile,"w");
-  if (csvFp == NULL) {
-    printf ("unable to open output list file of tie point ids: %s\n",pointIDsFile);
-    fclose(gpfFp);
-    fclose(csvFp);
-    exit (1);
-  }
+  bool tiled = (job.tileLat > 0.0);
+  if (!job.binary && !job.ecef && !tiled && !csv.open(csvFile.c_str()))
+    return "unable to open output csv file: " + csvFile +
+           (csv.error().empty() ? "" : "\n  " + csv.error());
+
+  if (!job.binary && !tiled && !pts.open(pointIDsFile.c_str()))
+    return "unable to open output list file of tie point ids: " + pointIDsFile;
+
+  // at most one csv line ("%.14lf,%.14lf,height") and point id per record,
+  // and no more than the gpf itself, whatever its header claims
+  csv.preallocate(std::min((size_t) gpf.numPoints() * CSVLINEBYTES,gpf.fileSize()));
+  pts.preallocate(std::min((size_t) gpf.numPoints() * IDLINEBYTES,gpf.fileSize()));
 
   //------------------------------------------------
   //------------------------------------------------
 
-  // skip the header
-  fgets(gpfLine,LINELENGTH,gpfFp);
+  // the points to export, if not the active tie points
+  GpfPointFilter filter;
+  const GpfPointFilter *filterOut = NULL;
+  if (!job.filter.isDefault()) {
+    std::string filterError;
+    if (!filter.open(job.filter,filterError))
+      return filterError;
+    filterOut = &filter;
+    stats.filtered = true;
+  }
 
-  // read in number of points in *.gpf file
-  char value[50]; 
-  fgets(gpfLine,LINELENGTH,gpfFp);
-  sscanf (gpfLine,"%s",value);
-  int numpts = atoi(value);
+  // Parse gpf, output csv (or collect the binary columns or ECEF points)
+  GpfBinaryWriter bin(job.datum);
+  GpfBinaryWriter *binOut = job.binary ? &bin : NULL;
+  GpfPointCloudWriter cloud(job.datum);
+  GpfPointCloudWriter *cloudOut = job.ecef ? &cloud : NULL;
+  GpfTieTiles tiles = tiled ? GpfTieTiles(job.tileLat,job.tileLon,job.overlap) : GpfTieTiles();
+  GpfTieTiles *tilesOut = tiled ? &tiles : NULL;
+  GpfIndexBuilder index(gpf.file().data());
+  GpfIndexBuilder *indexOut = job.index ? &index : NULL;
+  GpfErrorStats errors;
+  GpfErrorStats *errorsOut = job.errors ? &errors : NULL;
+  std::string parseError;
+  if (job.nthreads == 1) {
+    exportTies(gpf,csv,pts,binOut,cloudOut,tilesOut,filterOut,indexOut,errorsOut,job.csvFormat,
+               stats);
+    parseError = gpf.error();
+  }
+  else
+    parseError = exportTiesParallel(gpf,(unsigned) job.nthreads,csv,pts,binOut,cloudOut,
+                                    tilesOut,job.datum,filterOut,indexOut,errorsOut,
+                                    job.csvFormat,stats);
 
-  // skip next header
-  fgets(gpfLine,LINELENGTH,gpfFp);
+  if (!parseError.empty())
+    return "error reading input gpf file: " + job.gpfFile + "\n  " + parseError;
+  stats.bytesRead = gpf.fileSize();
 
-  // Parse gpf, output csv
-  char pointID[50], valStat[2], valKnown[2]; 
-  char valLon[50], valLat[50], Height[50];
-  double rad2dd = 57.295779513082320876798154814105;
+  if (job.index) {
+    double mark = GpfStats::now();
+    if (!index.save(indexFile.c_str(),job.gpfFile.c_str(),gpf.layout(),parseError))
+      return parseError;
+    stats.lap(GpfStats::Write,mark);
+  }
+  if (job.errors) {
+    double mark = GpfStats::now();
+    if (!errors.write(errorsFile.c_str()))
+      return "error writing output error summary file: " + errorsFile;
+    stats.lap(GpfStats::Write,mark);
+  }
 
-  for (int i=0; i<numpts; i++) {
-    fgets(gpfLine,LINELENGTH,gpfFp);
-    sscanf (gpfLine,"%s %s %s",pointID,valStat,valKnown);
-    int stat = atoi(valStat);
-    int known = atoi(valKnown);
+  // the tiles hold views of the mapped gpf, write them before it goes
+  size_t tileBytes = 0;
+  if (tiled) {
+    double mark = GpfStats::now();
+    double tileSeconds = 0.0;
+    if (!tiles.write(corename,tileBytes,tileSeconds,parseError))
+      return parseError;
+    stats.lap(GpfStats::Format,mark);
+    stats.seconds[GpfStats::Format] -= tileSeconds;
+    stats.seconds[GpfStats::Write] += tileSeconds;
+  }
+  gpf.close();
 
-    // get coordinate
-    fgets(gpfLine,LINELENGTH,gpfFp);
+  GpfWriter binWriter;
+  if (job.binary) {
+    if (!binWriter.open(binaryFile.c_str()))
+      return "error writing output binary tie point file: " + binaryFile;
+    bin.save(binWriter);
+  }
+  else if (job.ecef) {
+    if (!binWriter.open(cloudFile.c_str()))
+      return "error writing output point cloud file: " + cloudFile;
+    cloud.save(binWriter);
+  }
 
-    //only output tie points that are on
-    if (stat == 1 && known == 0) {
-      sscanf (gpfLine,"%s %s %s",valLat,valLon,Height);
-      double radLat = atof(valLat);
-      double radLon = atof(valLon);
-      if(radLon < 0.0)
-        fprintf(csvFp,"%.14lf,%.14lf,%s\n",rad2dd*radLat,rad2dd*radLon+360.0,Height);
-      else
-        fprintf(csvFp,"%.14lf,%.14lf,%s\n",rad2dd*radLat,rad2dd*radLon,Height);
-      fprintf(ptsFp,"%s\n",pointID);
+  // what is left in the buffers goes out on close
+  double written = writeSeconds(csv,pts) + binWriter.writeSeconds();
+  if (!binWriter.close())
+    return job.ecef ? "error writing output point cloud file: " + cloudFile
+                    : "error writing output binary tie point file: " + binaryFile;
+  if (!csv.close())
+    return "error writing output csv file: " + csvFile;
+  if (!pts.close())
+    return "error writing output list file of tie point ids: " + pointIDsFile;
+  stats.seconds[GpfStats::Write] += writeSeconds(csv,pts) + binWriter.writeSeconds() - written;
+
+  if (job.stats) {
+    stats.bytesWritten = csv.bytesWritten() + pts.bytesWritten() + binWriter.bytesWritten() +
+                         tileBytes;
+    stats.wallSeconds = GpfStats::now() - start;
+    statsJson = stats.json("gpfTies2LatLonHeightCSV_360sys",job.gpfFile,"exported_ties");
+  }
+  return std::string();
+}
+
+int main(int argc, char *argv[])
+{
+
+  // parse options, then check number of command line args and issue
+  // help if needed
+  //-----------------------------------------------------------
+  std::vector<std::string> args(argv, argv+argc);
+  const char *manifestFile = NULL;
+  int njobs = 0;
+  int zthreads = 0;
+  GpfOutputOptions output;
+  bool pipelined = false;
+  ExportJob defaults;
+  std::string error;
+  if (!parseExportArgs(args,1,defaults,error,&manifestFile,&njobs,&zthreads,&output,
+                       &pipelined)) {
+    printf ("%s\n",error.c_str());
+    usage(argv[0]);
+  }
+  gpfSetCompressionThreads((unsigned) zthreads);
+  gpfSetOutputOptions(output);
+  gpfSetPipelined(pipelined);
+
+  if (!manifestFile) {
+    std::string statsJson;
+    error = exportGpf(defaults,statsJson);
+    if (!error.empty()) {
+      printf ("%s\n",error.c_str());
+      exit (1);
     }
+    if (!statsJson.empty())
+      printf ("%s\n",statsJson.c_str());
+    return 0;
+  }
+
+  //------------------------------------------------
+  // -batch: one export per manifest line, run
+  // concurrently with at most MAXFILES in flight
+  //------------------------------------------------
 
-    // skip next three lines in input *.gpf file
-    for (int j=0; j<3; j++)
-      fgets(gpfLine,LINELENGTH,gpfFp);
+  std::vector<GpfBatchJob> jobs;
+  if (!gpfReadManifest(manifestFile,jobs,error)) {
+    printf ("%s\n",error.c_str());
+    exit (1);
   }
 
-  fclose(gpfFp);
-  fclose(csvFp);
+  unsigned nworkers = GpfThreadPool::threadCount((unsigned) njobs);
+  if (nworkers > MAXFILES)
+    nworkers = MAXFILES;
 
-} // end of program
+  size_t failed = gpfRunBatch(manifestFile,jobs,nworkers,[&defaults](const GpfBatchJob &b, std::string &statsJson) {
+    ExportJob job = defaults;
+    std::string message;
+    if (!parseExportArgs(b.args,0,job,message))
+      return message;
+    return exportGpf(job,statsJson);
+  });
+
+  if (failed > 0) {
+    printf ("%zu of %zu gpf files in %s failed\n",failed,jobs.size(),manifestFile);
+    exit (1);
+  }
+  return 0;
 
+} // end of program
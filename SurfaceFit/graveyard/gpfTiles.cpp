@@ -0,0 +1,201 @@
+#include "gpfTiles.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "gpfWriter.h"
+
+
+GpfTieTiles::GpfTieTiles(double tileLat, double tileLon, double overlap)
+  : m_tileLat(tileLat), m_tileLon(tileLon), m_overlap(overlap),
+    m_rows((int) ceil(180.0 / tileLat)), m_cols((int) ceil(360.0 / tileLon)) {
+}
+
+
+GpfTieTiles::GpfTieTiles()
+  : m_tileLat(0.0), m_tileLon(0.0), m_overlap(0.0), m_rows(0), m_cols(0) {
+}
+
+
+bool GpfTieTiles::checkSizes(double tileLat, double tileLon, double overlap,
+                             std::string &error) {
+  if (!(tileLat > 0.0 && tileLat <= 180.0 && tileLon > 0.0 && tileLon <= 360.0)) {
+    error = "tile sizes must be more than 0 and at most 180 x 360 degrees";
+    return false;
+  }
+  if (ceil(180.0 / tileLat) * ceil(360.0 / tileLon) > 2147483647.0) {
+    error = "tiles are too small, the grid would have more than 2^31 of them";
+    return false;
+  }
+  if (!(overlap >= 0.0 && overlap < 90.0)) {
+    error = "tile overlap must be at least 0 and less than 90 degrees";
+    return false;
+  }
+  return true;
+}
+
+
+void GpfTieTiles::add(std::string_view pointID, double lat, double lon360,
+                      std::string_view height) {
+  m_points.push_back(Point{pointID, height, lat, lon360});
+}
+
+
+void GpfTieTiles::append(const GpfTieTiles &other) {
+  m_points.insert(m_points.end(), other.m_points.begin(), other.m_points.end());
+}
+
+
+int GpfTieTiles::row(double lat) const {
+  int r = (int) floor((lat + 90.0) / m_tileLat);
+  return r < 0 ? 0 : r >= m_rows ? m_rows - 1 : r;
+}
+
+
+int GpfTieTiles::col(double lon360) const {
+  int c = (int) floor(lon360 / m_tileLon);
+  return c < 0 ? 0 : c >= m_cols ? m_cols - 1 : c;
+}
+
+
+// Every (tile, point) pair, ordered by tile and then export order
+void GpfTieTiles::collectMembers(std::vector<Member> &members) const {
+  members.clear();
+  members.reserve(m_points.size());
+  std::vector<int> cols;
+
+  for (size_t i = 0; i < m_points.size(); i++) {
+    const Point &p = m_points[i];
+    int ownRow = row(p.lat);
+    int ownCol = col(p.lon360);
+    if (m_overlap == 0.0) {
+      members.push_back(Member{(uint32_t) (ownRow * m_cols + ownCol), (uint32_t) i, false});
+      continue;
+    }
+
+    // the columns within the overlap, split where it wraps past 0 or 360
+    cols.clear();
+    double lo = p.lon360 - m_overlap;
+    double hi = p.lon360 + m_overlap;
+    if (hi - lo >= 360.0) {
+      for (int c = 0; c < m_cols; c++)
+        cols.push_back(c);
+    }
+    else {
+      double pieces[2][2] = {{lo, hi}, {1.0, 0.0}};
+      if (lo < 0.0) {
+        pieces[0][0] = lo + 360.0; pieces[0][1] = 360.0;
+        pieces[1][0] = 0.0;        pieces[1][1] = hi;
+      }
+      else if (hi >= 360.0) {
+        pieces[0][1] = 360.0;
+        pieces[1][0] = 0.0;        pieces[1][1] = hi - 360.0;
+      }
+      for (int k = 0; k < 2; k++) {
+        if (pieces[k][0] > pieces[k][1])
+          continue;
+        for (int c = col(pieces[k][0]); c <= col(pieces[k][1]); c++)
+          cols.push_back(c);
+      }
+      std::sort(cols.begin(), cols.end());
+      cols.erase(std::unique(cols.begin(), cols.end()), cols.end());
+    }
+
+    for (int r = row(p.lat - m_overlap); r <= row(p.lat + m_overlap); r++) {
+      for (int c : cols) {
+        bool overlap = (r != ownRow || c != ownCol);
+        members.push_back(Member{(uint32_t) (r * m_cols + c), (uint32_t) i, overlap});
+      }
+    }
+  }
+
+  std::sort(members.begin(), members.end(), [](const Member &a, const Member &b) {
+    return a.tile != b.tile ? a.tile < b.tile : a.point < b.point;
+  });
+}
+
+
+bool GpfTieTiles::write(const std::string &corename, size_t &bytesWritten,
+                        double &writeSeconds, std::string &error) const {
+  std::vector<Member> members;
+  collectMembers(members);
+
+  std::string listFile = corename + ".tiles.txt";
+  GpfWriter list(1 << 16);
+  if (!list.open(listFile.c_str())) {
+    error = "unable to open output tile list file: " + listFile;
+    return false;
+  }
+  list.write("# csvFile idsFile minLat maxLat minLon maxLon ownedPoints overlapPoints\n");
+
+  GpfWriter csv;
+  GpfWriter pts(1 << 20);
+  size_t m = 0;
+  while (m < members.size()) {
+    uint32_t tile = members[m].tile;
+    int r = (int) (tile / m_cols);
+    int c = (int) (tile % m_cols);
+    std::string name = corename + ".tile_" + std::to_string(r) + "_" + std::to_string(c);
+    std::string csvFile = name + ".csv";
+    std::string pointIDsFile = name + ".tiePointIds.txt";
+    if (!csv.open(csvFile.c_str())) {
+      error = "unable to open output csv file: " + csvFile;
+      return false;
+    }
+    if (!pts.open(pointIDsFile.c_str())) {
+      error = "unable to open output list file of tie point ids: " + pointIDsFile;
+      return false;
+    }
+
+    size_t owned = 0, borrowed = 0;
+    for (; m < members.size() && members[m].tile == tile; m++) {
+      const Point &p = m_points[members[m].point];
+      csv.putFixed(p.lat, 14);
+      csv.put(',');
+      csv.putFixed(p.lon360, 14);
+      csv.put(',');
+      csv.write(p.height);
+      csv.put('\n');
+      pts.write(p.pointID);
+      if (members[m].overlap) {
+        pts.write(" overlap");
+        borrowed++;
+      }
+      else
+        owned++;
+      pts.put('\n');
+    }
+
+    if (!csv.close()) {
+      error = "error writing output csv file: " + csvFile;
+      return false;
+    }
+    if (!pts.close()) {
+      error = "error writing output list file of tie point ids: " + pointIDsFile;
+      return false;
+    }
+    bytesWritten += csv.bytesWritten() + pts.bytesWritten();
+    writeSeconds += csv.writeSeconds() + pts.writeSeconds();
+
+    double minLat = -90.0 + r * m_tileLat;
+    double minLon = c * m_tileLon;
+    char bounds[160];
+    snprintf(bounds, sizeof(bounds), " %.10g %.10g %.10g %.10g %zu %zu\n",
+             minLat, std::min(minLat + m_tileLat, 90.0),
+             minLon, std::min(minLon + m_tileLon, 360.0), owned, borrowed);
+    list.write(csvFile);
+    list.put(' ');
+    list.write(pointIDsFile);
+    list.write(bounds);
+  }
+
+  if (!list.close()) {
+    error = "error writing output tile list file: " + listFile;
+    return false;
+  }
+  bytesWritten += list.bytesWritten();
+  writeSeconds += list.writeSeconds();
+  return true;
+}
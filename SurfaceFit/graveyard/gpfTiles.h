@@ -0,0 +1,86 @@
+#ifndef gpfTiles_h
+#define gpfTiles_h
+
+// Spatial tiling of the exported tie points, so a large network can be
+// aligned as many independent pc_align runs.
+//
+// The globe is cut into a grid of tileLat by tileLon degree tiles, rows
+// from latitude -90 and columns from longitude 0 in the 0 to 360 domain
+// of the CSVs.  Each tie point is owned by the tile it falls in, and is
+// also handed to every other tile within overlap degrees of it (wrapping
+// around in longitude), which gives pc_align some context past the tile
+// edges.  Every tile that has points gets
+//
+//   <corename>.tile_<row>_<col>.csv              lat,lon360,height
+//   <corename>.tile_<row>_<col>.tiePointIds.txt  one point per csv line
+//
+// with the points in export order.  The ID list names a point the tile
+// only borrows as "pointID overlap", and mergeTransformedGPFties -join
+// skips those rows, so the transformed tiles can simply be concatenated
+// (CSVs and ID lists in the same order) and joined back to the GPF, each
+// point taking its coordinate from the tile that owns it.
+//
+// <corename>.tiles.txt lists the tiles, one per line:
+//
+//   csvFile idsFile minLat maxLat minLon maxLon ownedPoints overlapPoints
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class GpfTieTiles {
+ public:
+  GpfTieTiles(double tileLat, double tileLon, double overlap);
+
+  // No grid, only for collecting points to append() to one that has
+  GpfTieTiles();
+
+  // false, with error set, if the tile sizes or overlap are unusable
+  static bool checkSizes(double tileLat, double tileLon, double overlap,
+                         std::string &error);
+
+  // The views must stay valid until write(), i.e. point into the mapped
+  // gpf.  lon360 is in the 0 to 360 domain.
+  void add(std::string_view pointID, double lat, double lon360,
+           std::string_view height);
+
+  // Appends all the points of other, e.g. a part exported on another thread
+  void append(const GpfTieTiles &other);
+
+  size_t size() const { return m_points.size(); }
+
+  // Writes the tile files and the tile list.  bytesWritten and
+  // writeSeconds add up the output for the -stats counters.  Returns
+  // false with error set if a file could not be written.
+  bool write(const std::string &corename, size_t &bytesWritten,
+             double &writeSeconds, std::string &error) const;
+
+ private:
+  struct Point {
+    std::string_view pointID;
+    std::string_view height;
+    double           lat;
+    double           lon360;
+  };
+
+  struct Member {
+    uint32_t tile;       // row * m_cols + col
+    uint32_t point;      // into m_points
+    bool     overlap;    // borrowed from a neighbouring tile
+  };
+
+  int row(double lat) const;
+  int col(double lon360) const;
+  void collectMembers(std::vector<Member> &members) const;
+
+  double             m_tileLat;
+  double             m_tileLon;
+  double             m_overlap;
+  int                m_rows;
+  int                m_cols;
+  std::vector<Point> m_points;
+};
+
+#endif
@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gpfAsyncIO.h"
+#include "gpfCompress.h"
+#include "gpfReader.h"
+#include "gpfStats.h"
+#include "gpfWriter.h"
+
+// number of records parsed together
+#define BLOCKSIZE 65536
+
+static void usage(const char *prog)
+{
+     printf ("\nrun %s as follows:\n",prog);
+     printf ("   %s gpf2csv [-stats] [-noconvert] [-zthreads N] [-pipeline] inGPF outCSV\n",prog);
+     printf ("   %s sample -n N|-frac F [-seed S] [-allpoints] [-stats] [-zthreads N]\n",prog);
+     printf ("      [-pipeline] inGPF outGPF\n");
+     printf ("\nwhere:\n");
+     printf ("  gpf2csv = writes every record of inGPF to outCSV with all its columns,\n");
+     printf ("            point_id,stat,known,lat_Y_North,long_X_East,ht,sig0,sig1,sig2,\n");
+     printf ("            res0,res1,res2, as Network_Utilities/gpf2csv.py does.  The\n");
+     printf ("            latitudes and longitudes are converted from radians to degrees\n");
+     printf ("            (longitudes -180 to 180) unless -noconvert is given; those of a\n");
+     printf ("            GXP gpf are in degrees already and copied as they are.  Numbers\n");
+     printf ("            are printed with the fewest digits that read back the same\n\n");
+     printf ("  sample = writes a random sample of the stat 1 points of inGPF to outGPF,\n");
+     printf ("           as Network_Utilities/random_sample_gpf.py does: -n N points,\n");
+     printf ("           or -frac F (0 < F <= 1) of them, rounded to the nearest.  The\n");
+     printf ("           gpf is read once, and with -n only the N sampled records are\n");
+     printf ("           held.  With -frac the reservoir is sized from the header, up to\n");
+     printf ("           F times the number of records of inGPF (all of them, not only\n");
+     printf ("           the stat 1 points), and cut down to the sample at the end.  The\n");
+     printf ("           records are copied as they are, in the order of inGPF\n\n");
+     printf ("  -seed S = seed of the sample, the same S giving the same sample of the\n");
+     printf ("            same gpf (default: a random seed)\n\n");
+     printf ("  -allpoints = sample from every record, not only the stat 1 points\n\n");
+     printf ("  -stats = print the wall time of each phase (parse, convert, format,\n");
+     printf ("           write), the bytes read and written and the number of records\n");
+     printf ("           in each stat/known category as one line of JSON\n\n");
+     printf ("  -zthreads N, -pipeline = as for gpfTies2LatLonHeightCSV_360sys; outCSV and\n");
+     printf ("           outGPF are written compressed when named *.gz or *.zst\n\n");
+     printf ("  inGPF may be a Socet Set or GXP gpf, gzip or zstd compressed\n");
+     exit(1);
+}
+
+// Says what was wrong with the command line, then how to use it
+static void badArgs(const char *prog, const std::string &error)
+{
+  printf ("%s\n",error.c_str());
+  usage(prog);
+}
+
+// Command line options of the two subcommands
+struct UtilOptions {
+  bool     printStats;
+  bool     noConvert;
+  bool     allPoints;
+  uint64_t sampleSize;     // -n, 0 if not given
+  double   sampleFrac;     // -frac, 0 if not given
+  bool     seeded;
+  uint64_t seed;
+
+  UtilOptions() : printStats(false), noConvert(false), allPoints(false), sampleSize(0),
+                  sampleFrac(0), seeded(false), seed(0) {}
+};
+
+// Opens inGPF, printing why not if it can not
+static void openInput(GpfReader &gpf, const char *path)
+{
+  if (!gpf.open(path)) {
+    printf ("unable to open input gpf file: %s\n",path);
+    if (!gpf.error().empty())
+      printf ("  %s\n",gpf.error().c_str());
+    exit (1);
+  }
+}
+
+static void openOutput(GpfWriter &out, const char *path)
+{
+  if (!out.open(path)) {
+    printf ("unable to open output file: %s\n",path);
+    if (!out.error().empty())
+      printf ("  %s\n",out.error().c_str());
+    exit (1);
+  }
+}
+
+static void closeOutput(GpfWriter &out, const char *path, GpfStats &stats)
+{
+  double mark = GpfStats::now();
+  if (!out.close()) {
+    printf ("error writing output file: %s\n",path);
+    exit (1);
+  }
+  stats.lap(GpfStats::Write,mark);
+  stats.bytesWritten = out.bytesWritten();
+}
+
+//-----------------------------------------------------------------------
+// gpf2csv: every record, every column
+//-----------------------------------------------------------------------
+static void gpf2csv(const char *inFile, const char *outFile, const UtilOptions &options,
+                    GpfStats &stats)
+{
+  GpfReader gpf;
+  openInput(gpf,inFile);
+  GpfWriter csv;
+  openOutput(csv,outFile);
+  // about the size of the gpf
+  if (gpfCompressionOf(outFile) == GpfUncompressed)
+    csv.preallocate(gpf.fileSize());
+
+  csv.write("point_id,stat,known,lat_Y_North,long_X_East,ht,sig0,sig1,sig2,res0,res1,res2\n");
+
+  // np.degrees() multiplies by this constant
+  const double toDegrees = 180.0 / M_PI;
+  bool convert = !options.noConvert && gpf.layout() == GpfSocetSet;
+
+  std::vector<GpfPointRecord> block(BLOCKSIZE);
+  std::vector<double> lat(BLOCKSIZE), lon(BLOCKSIZE);
+  size_t nrec;
+  double mark = GpfStats::now();
+  while ((nrec = gpf.nextBlock(block.data(),BLOCKSIZE)) > 0) {
+    stats.lap(GpfStats::Parse,mark);
+    for (size_t i=0; i<nrec; i++) {
+      lat[i] = gpfToDouble(block[i].lat);
+      lon[i] = gpfToDouble(block[i].lon);
+      if (convert) {
+        lat[i] *= toDegrees;
+        lon[i] *= toDegrees;
+      }
+    }
+    stats.lap(GpfStats::Convert,mark);
+
+    double written = csv.writeSeconds();
+    for (size_t i=0; i<nrec; i++) {
+      const GpfPointRecord &rec = block[i];
+      stats.count(rec.statValue(),rec.knownValue());
+      csv.write(rec.pointID);
+      csv.put(',');
+      csv.putInt(rec.statValue());
+      csv.put(',');
+      csv.putInt(rec.knownValue());
+      csv.put(',');
+      csv.putShortest(lat[i]);
+      csv.put(',');
+      csv.putShortest(lon[i]);
+      csv.put(',');
+      csv.putShortest(gpfToDouble(rec.height));
+      for (int k=0; k<3; k++) {
+        csv.put(',');
+        csv.putShortest(gpfToDouble(rec.sigma[k]));
+      }
+      for (int k=0; k<3; k++) {
+        csv.put(',');
+        csv.putShortest(gpfToDouble(rec.residual[k]));
+      }
+      csv.put('\n');
+    }
+    stats.lap(GpfStats::Format,mark);
+    written = csv.writeSeconds() - written;
+    stats.seconds[GpfStats::Format] -= written;
+    stats.seconds[GpfStats::Write] += written;
+  }
+  stats.lap(GpfStats::Parse,mark);
+  if (!gpf.error().empty()) {
+    printf ("%s: %s\n",inFile,gpf.error().c_str());
+    exit (1);
+  }
+  stats.bytesRead = gpf.fileSize();
+  closeOutput(csv,outFile,stats);
+}
+
+//-----------------------------------------------------------------------
+// sample: reservoir sample of the stat 1 records in one pass
+//-----------------------------------------------------------------------
+
+// A sampled record, by its ordinal in the gpf, for writing them in order
+struct SampledRecord {
+  uint64_t         ordinal;
+  std::string_view raw;
+};
+
+static void sample(const char *inFile, const char *outFile, const UtilOptions &options,
+                   GpfStats &stats)
+{
+  GpfReader gpf;
+  openInput(gpf,inFile);
+
+  std::mt19937_64 rng(options.seeded ? options.seed : std::random_device()());
+
+  // with -frac the number of candidates is only known at the end, so the
+  // reservoir is sized for that fraction of every record in the header
+  // and cut down to the fraction of the candidates afterwards, a random
+  // subset of a random sample being a random sample too
+  uint64_t capacity = options.sampleSize;
+  if (options.sampleFrac > 0)
+    capacity = (uint64_t) ceil(options.sampleFrac * (double) std::max(gpf.numPoints(),0));
+  std::vector<SampledRecord> reservoir;
+  reservoir.reserve((size_t) std::min<uint64_t>(capacity,1 << 20));
+
+  std::vector<GpfPointRecord> block(BLOCKSIZE);
+  size_t nrec;
+  uint64_t ordinal = 0;
+  uint64_t candidates = 0;
+  double mark = GpfStats::now();
+  while ((nrec = gpf.nextBlock(block.data(),BLOCKSIZE)) > 0) {
+    for (size_t i=0; i<nrec; i++, ordinal++) {
+      const GpfPointRecord &rec = block[i];
+      int stat = rec.statValue();
+      stats.count(stat,rec.knownValue());
+      if (!options.allPoints && stat != 1)
+        continue;
+      if (reservoir.size() < capacity)
+        reservoir.push_back(SampledRecord{ordinal,rec.raw});
+      else {
+        uint64_t j = std::uniform_int_distribution<uint64_t>(0,candidates)(rng);
+        if (j < capacity)
+          reservoir[j] = SampledRecord{ordinal,rec.raw};
+      }
+      candidates++;
+    }
+  }
+  stats.lap(GpfStats::Parse,mark);
+  if (!gpf.error().empty()) {
+    printf ("%s: %s\n",inFile,gpf.error().c_str());
+    exit (1);
+  }
+
+  // pandas rounds frac * n half to even
+  if (options.sampleFrac > 0) {
+    uint64_t n = (uint64_t) nearbyint(options.sampleFrac * (double) candidates);
+    if (n < reservoir.size()) {
+      std::shuffle(reservoir.begin(),reservoir.end(),rng);
+      reservoir.resize(n);
+    }
+  }
+  std::sort(reservoir.begin(),reservoir.end(),
+            [](const SampledRecord &a, const SampledRecord &b) { return a.ordinal < b.ordinal; });
+  stats.filtered = true;
+  stats.selected = reservoir.size();
+  stats.lap(GpfStats::Convert,mark);
+
+  // the header of inGPF with the number of points sampled
+  GpfWriter out;
+  openOutput(out,outFile);
+  std::string_view header = gpf.header();
+  const char *cur = header.data();
+  const char *end = cur + header.size();
+  out.write(gpfNextLine(cur,end));
+  gpfNextLine(cur,end);
+  out.putInt((int) reservoir.size());
+  out.put('\n');
+  out.write(gpfNextLine(cur,end));
+
+  double written = out.writeSeconds();
+  for (const SampledRecord &s : reservoir) {
+    out.write(s.raw);
+    // the last record of a file may end without its blank line
+    if (!gpfEndsWithBlankLine(s.raw)) {
+      if (s.raw.back() != '\n')
+        out.put('\n');
+      out.put('\n');
+    }
+  }
+  stats.lap(GpfStats::Format,mark);
+  written = out.writeSeconds() - written;
+  stats.seconds[GpfStats::Format] -= written;
+  stats.seconds[GpfStats::Write] += written;
+
+  stats.bytesRead = gpf.fileSize();
+  closeOutput(out,outFile,stats);
+}
+
+int main(int argc, char *argv[])
+{
+
+  //-----------------------------------------------------------
+  // parse options, then check number of command line args and issue
+  // help if needed
+  //-----------------------------------------------------------
+  if (argc < 2)
+    badArgs(argv[0],"expected a subcommand, gpf2csv or sample");
+  const char *command = argv[1];
+  bool isCsv = strcmp(command,"gpf2csv") == 0;
+  bool isSample = strcmp(command,"sample") == 0;
+  if (!isCsv && !isSample)
+    badArgs(argv[0],std::string("unknown subcommand: ") + command + " (use gpf2csv or sample)");
+
+  UtilOptions options;
+  int zthreads = 0;
+  bool pipelined = false;
+  std::vector<const char *> files;
+  for (int argi = 2; argi < argc; argi++) {
+    if (strcmp(argv[argi],"-stats") == 0 || strcmp(argv[argi],"--stats") == 0)
+      options.printStats = true;
+    else if (strcmp(argv[argi],"-zthreads") == 0 && argi+1 < argc)
+      zthreads = atoi(argv[++argi]);
+    else if (strcmp(argv[argi],"-pipeline") == 0)
+      pipelined = true;
+    else if (isCsv && (strcmp(argv[argi],"-noconvert") == 0 ||
+                       strcmp(argv[argi],"--no-convert") == 0))
+      options.noConvert = true;
+    else if (isSample && strcmp(argv[argi],"-n") == 0 && argi+1 < argc) {
+      const char *value = argv[++argi];
+      char *end;
+      options.sampleSize = strtoull(value,&end,10);
+      if (*value == '\0' || *value == '-' || *end != '\0' || options.sampleSize == 0)
+        badArgs(argv[0],std::string("-n must be a positive number of points: ") + value);
+    }
+    else if (isSample && (strcmp(argv[argi],"-frac") == 0 ||
+                          strcmp(argv[argi],"--frac") == 0) && argi+1 < argc) {
+      // the fraction in (0,1] as pandas takes it
+      const char *value = argv[++argi];
+      char *end;
+      options.sampleFrac = strtod(value,&end);
+      if (*value == '\0' || *end != '\0' || !(options.sampleFrac > 0 && options.sampleFrac <= 1))
+        badArgs(argv[0],std::string("-frac must be more than 0 and at most 1: ") + value);
+    }
+    else if (isSample && strcmp(argv[argi],"-seed") == 0 && argi+1 < argc) {
+      options.seeded = true;
+      options.seed = strtoull(argv[++argi],NULL,10);
+    }
+    else if (isSample && (strcmp(argv[argi],"-allpoints") == 0 ||
+                          strcmp(argv[argi],"--all-points") == 0))
+      options.allPoints = true;
+    else if (argv[argi][0] == '-' && argv[argi][1] != '\0')
+      badArgs(argv[0],std::string("unknown or incomplete option: ") + argv[argi]);
+    else
+      files.push_back(argv[argi]);
+  }
+  if (files.size() != 2)
+    badArgs(argv[0],isCsv ? "expected inGPF outCSV" : "expected inGPF outGPF");
+  if (zthreads < 0)
+    badArgs(argv[0],"-zthreads must be 0 or more");
+  // exactly one of -n and -frac
+  if (isSample && options.sampleSize > 0 && options.sampleFrac > 0)
+    badArgs(argv[0],"-n and -frac can not be used together");
+  if (isSample && options.sampleSize == 0 && options.sampleFrac == 0)
+    badArgs(argv[0],"sample needs -n N or -frac F");
+  gpfSetCompressionThreads((unsigned) zthreads);
+  gpfSetPipelined(pipelined);
+
+  GpfStats stats;
+  double start = GpfStats::now();
+  if (isCsv)
+    gpf2csv(files[0],files[1],options,stats);
+  else
+    sample(files[0],files[1],options,stats);
+  stats.wallSeconds = GpfStats::now() - start;
+
+  if (options.printStats) {
+    std::string tool = std::string("gpfUtil ") + command;
+    printf ("%s\n",stats.json(tool.c_str(),files[0],"ties").c_str());
+  }
+  return 0;
+
+} // end of program
@@ -0,0 +1,461 @@
+#include "gpfWriter.h"
+#include "gpfAsyncIO.h"
+#include "gpfCompress.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <new>
+#include <utility>
+
+// Longest "%.Nlf" of a finite double: 309 integer digits, sign, point and
+// the requested decimals
+static const size_t MaxFixedLength = 320;
+
+// Alignment of the buffer, and of every write but the last one
+static const size_t BlockAlign = 4096;
+
+// Shortest run worth the copy_file_range(2) of writeCopy()
+static const size_t KernelCopyMin = 1 << 20;
+
+static GpfOutputOptions outputOptions;
+
+
+void gpfSetOutputOptions(const GpfOutputOptions &options) {
+  outputOptions = options;
+}
+
+
+const GpfOutputOptions &gpfOutputOptions() {
+  return outputOptions;
+}
+
+
+// A page aligned buffer of at least size bytes, a whole number of pages
+// and never less than two of them
+static char *allocateBlocks(size_t &size) {
+  size = (size + BlockAlign - 1) / BlockAlign * BlockAlign;
+  if (size < 2 * BlockAlign)
+    size = 2 * BlockAlign;
+  void *p = NULL;
+  if (posix_memalign(&p, BlockAlign, size) != 0)
+    throw std::bad_alloc();
+  return (char *) p;
+}
+
+
+static bool writeAll(int fd, const char *p, size_t left) {
+  while (left > 0) {
+    ssize_t n = ::write(fd, p, left);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += n;
+    left -= (size_t) n;
+  }
+  return true;
+}
+
+
+GpfWriter::GpfWriter(size_t bufferSize)
+  : m_capacity(bufferSize), m_len(0), m_fd(-1), m_good(true), m_memory(false),
+    m_written(0), m_writeSeconds(0.0), m_offset(0), m_synced(0), m_direct(false),
+    m_preallocated(false), m_spare(NULL), m_spareCapacity(0), m_pendingOffset(0),
+    m_pending(0) {
+  m_buffer = allocateBlocks(m_capacity);
+}
+
+
+GpfWriter::~GpfWriter() {
+  close();
+  free(m_buffer);
+  free(m_spare);
+}
+
+
+bool GpfWriter::open(const char *path) {
+  close();
+  m_written = 0;
+  m_writeSeconds = 0.0;
+  m_error.clear();
+  m_compressor.reset();
+
+  GpfCompression compression = gpfCompressionOf(path);
+  if (compression != GpfUncompressed) {
+    m_compressor.reset(new GpfCompressor);
+    if (!m_compressor->init(compression, m_error)) {
+      m_compressor.reset();
+      m_good = false;
+      return false;
+    }
+  }
+
+  m_offset = 0;
+  m_synced = 0;
+  m_direct = false;
+  m_preallocated = false;
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+  // a file system that can not do direct I/O gets the page cache
+  if (outputOptions.directIO && !m_compressor) {
+    m_fd = ::open(path, flags | O_DIRECT, 0666);
+    m_direct = (m_fd >= 0);
+    if (m_fd < 0 && errno != EINVAL)
+      return m_good = false;
+  }
+#endif
+  if (m_fd < 0)
+    m_fd = ::open(path, flags, 0666);
+  m_good = (m_fd >= 0);
+
+  if (m_good && gpfPipelined() && !m_compressor) {
+    if (m_spareCapacity != m_capacity) {
+      free(m_spare);
+      m_spareCapacity = m_capacity;
+      m_spare = allocateBlocks(m_spareCapacity);
+    }
+    m_async.reset(new GpfAsyncIO);
+    m_async->start(1);
+  }
+  return m_good;
+}
+
+
+void GpfWriter::preallocate(size_t bytes) {
+  if (m_fd < 0 || m_compressor || m_preallocated || bytes == 0)
+    return;
+#ifdef FALLOC_FL_KEEP_SIZE
+  // a failed fallocate() can still leave blocks reserved past the end of
+  // the file, so close() trims either way
+  m_preallocated = true;
+  (void) fallocate(m_fd, FALLOC_FL_KEEP_SIZE, (off_t) m_offset, (off_t) bytes);
+#endif
+}
+
+
+// writeAll() to the file, keeping the page cache hints
+bool GpfWriter::writeFile(const char *p, size_t n) {
+  if (!writeAll(m_fd, p, n))
+    return false;
+  size_t start = m_offset;
+  m_offset += n;
+  dropWritten(start, n);
+  return true;
+}
+
+
+// The -fadvise hints for the n bytes just written at start
+void GpfWriter::dropWritten(size_t start, size_t n) {
+  if (!outputOptions.dropCache || m_direct)
+    return;
+
+#ifdef SYNC_FILE_RANGE_WRITE
+  // start writing this block back, and wait for the ones before it, which
+  // have had a block's time to get there, to drop them from the cache
+  sync_file_range(m_fd, (off_t) start, (off_t) n, SYNC_FILE_RANGE_WRITE);
+  if (start > m_synced) {
+    sync_file_range(m_fd, (off_t) m_synced, (off_t) (start - m_synced),
+                    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                    SYNC_FILE_RANGE_WAIT_AFTER);
+    posix_fadvise(m_fd, (off_t) m_synced, (off_t) (start - m_synced), POSIX_FADV_DONTNEED);
+    m_synced = start;
+  }
+#else
+  // only pages that are already clean are dropped
+  posix_fadvise(m_fd, (off_t) start, (off_t) n, POSIX_FADV_DONTNEED);
+#endif
+}
+
+
+// Pipelined mode: starts writing the first n bytes of the buffer in the
+// background and swaps in the spare buffer, the bytes after them moving
+// to its front.  The spare's own write is waited for first.
+void GpfWriter::writeBehind(size_t n) {
+  if (!finishWrite())
+    m_good = false;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  if (m_good && n > 0) {
+    m_async->write(m_fd, m_buffer, n, m_offset, 0);
+    m_pendingOffset = m_offset;
+    m_pending = n;
+    m_offset += n;
+  }
+  memcpy(m_spare, m_buffer + n, m_len - n);
+  std::swap(m_buffer, m_spare);
+  m_len -= n;
+  m_written += n;
+  m_writeSeconds += std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+}
+
+
+// Waits for the background write, if there is one.  Returns false if it
+// failed.  The time spent waiting counts as writing.
+bool GpfWriter::finishWrite() {
+  if (m_pending == 0)
+    return true;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  bool ok = m_async->wait().ok;
+  if (ok)
+    dropWritten(m_pendingOffset, m_pending);
+  m_pending = 0;
+  m_writeSeconds += std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+  return ok;
+}
+
+
+// The short final write of an O_DIRECT file goes through the page cache
+void GpfWriter::endDirectIO() {
+#ifdef O_DIRECT
+  if (m_direct) {
+    int flags = fcntl(m_fd, F_GETFL);
+    if (flags == -1 || fcntl(m_fd, F_SETFL, flags & ~O_DIRECT) != 0)
+      m_good = false;
+  }
+#endif
+  m_direct = false;
+}
+
+
+// writeAll() on the open file, through the compressor if there is one,
+// keeping the -stats counters.  finish ends the compressed stream.
+bool GpfWriter::writeOut(const char *p, size_t n, bool finish) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  bool ok = m_compressor ? m_compressor->write(p, n, finish, [this](const char *q, size_t m) {
+                             return writeFile(q, m);
+                           })
+                         : writeFile(p, n);
+  m_writeSeconds += std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+  m_written += n;
+  return ok;
+}
+
+
+void GpfWriter::openMemory() {
+  close();
+  m_memory = true;
+  m_good = true;
+}
+
+
+void GpfWriter::grow(size_t n) {
+  size_t capacity = m_capacity * 2;
+  while (capacity - m_len < n)
+    capacity *= 2;
+  char *buffer = allocateBlocks(capacity);
+  memcpy(buffer, m_buffer, m_len);
+  free(m_buffer);
+  m_buffer = buffer;
+  m_capacity = capacity;
+}
+
+
+bool GpfWriter::close() {
+  if (m_memory) {
+    m_memory = false;
+    m_len = 0;
+    return m_good;
+  }
+  if (m_fd < 0)
+    return m_good;
+  flush();
+  if (m_compressor && m_good)
+    m_good = writeOut(NULL, 0, true);
+  m_compressor.reset();
+  // give back the preallocated space that was not used
+  if (m_preallocated && ftruncate(m_fd, (off_t) m_offset) != 0)
+    m_good = false;
+  if (::close(m_fd) != 0)
+    m_good = false;
+  m_fd = -1;
+  m_async.reset();
+  return m_good;
+}
+
+
+bool GpfWriter::flush() {
+  if (m_memory)
+    return m_good;
+  if (m_async) {
+    // the short write goes after the last whole blocks are on disk
+    if (m_len % BlockAlign != 0) {
+      if (!finishWrite())
+        m_good = false;
+      endDirectIO();
+    }
+    writeBehind(m_len);
+    if (!finishWrite())
+      m_good = false;
+    return m_good;
+  }
+  if (m_len % BlockAlign != 0)
+    endDirectIO();
+  if (m_good && m_len > 0)
+    m_good = writeOut(m_buffer, m_len);
+  m_len = 0;
+  return m_good;
+}
+
+
+// Writes the whole blocks in the buffer, and moves the rest to its front
+void GpfWriter::drain() {
+  size_t n = m_len / BlockAlign * BlockAlign;
+  if (m_async) {
+    writeBehind(n);
+    return;
+  }
+  if (m_good && n > 0)
+    m_good = writeOut(m_buffer, n);
+  memmove(m_buffer, m_buffer + n, m_len - n);
+  m_len -= n;
+}
+
+
+void GpfWriter::write(std::string_view s) {
+  if (m_memory)
+    reserve(s.size());
+  else {
+    // a long run, e.g. verbatim records, fills the buffer block by block
+    while (s.size() > m_capacity - m_len) {
+      size_t n = m_capacity - m_len;
+      memcpy(m_buffer + m_len, s.data(), n);
+      m_len = m_capacity;
+      s.remove_prefix(n);
+      drain();
+    }
+  }
+  memcpy(m_buffer + m_len, s.data(), s.size());
+  m_len += s.size();
+}
+
+
+void GpfWriter::writeCopy(std::string_view bytes, int fd, size_t offset) {
+  if (bytes.size() < KernelCopyMin || fd < 0 || m_fd < 0 || m_memory || m_compressor ||
+      m_direct || !m_good) {
+    write(bytes);
+    return;
+  }
+
+  // what is buffered goes first, then the run straight from file to file
+  flush();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  size_t copied = 0;
+#ifdef __linux__
+  // the background writes leave the file position alone, so the pipelined
+  // mode gives the output offset too
+  loff_t in = (loff_t) offset;
+  loff_t out = (loff_t) m_offset;
+  while (m_good && copied < bytes.size()) {
+    ssize_t n = copy_file_range(fd, &in, m_fd, m_async ? &out : NULL, bytes.size() - copied, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    // e.g. EXDEV or EOPNOTSUPP: the file systems can not, write it instead
+    if (n <= 0)
+      break;
+    copied += (size_t) n;
+  }
+#else
+  (void) offset;
+#endif
+  m_offset += copied;
+  m_written += copied;
+  m_writeSeconds += std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+  if (copied < bytes.size())
+    write(bytes.substr(copied));
+}
+
+
+void GpfWriter::putFixed(double value, int precision) {
+  reserve(MaxFixedLength + precision);
+  char *first = m_buffer + m_len;
+  std::to_chars_result r = std::to_chars(first, m_buffer + m_capacity, value,
+                                         std::chars_format::fixed, precision);
+  m_len = r.ptr - m_buffer;
+}
+
+
+void GpfWriter::putInt(int value) {
+  reserve(16);
+  char *first = m_buffer + m_len;
+  std::to_chars_result r = std::to_chars(first, m_buffer + m_capacity, value);
+  m_len = r.ptr - m_buffer;
+}
+
+
+void GpfWriter::putShortest(double value) {
+  char digits[32];
+  std::to_chars_result r = std::to_chars(digits, digits + sizeof(digits), value,
+                                         std::chars_format::scientific);
+  const char *e = std::find(digits, r.ptr, 'e');
+  if (e == r.ptr) {
+    // inf or nan
+    write(std::string_view(digits, r.ptr - digits));
+    return;
+  }
+  int exponent = 0;
+  const char *x = e + 1;
+  if (*x == '+')
+    x++;
+  std::from_chars(x, r.ptr, exponent);
+
+  // the significant digits without sign and point
+  const char *p = digits;
+  bool negative = (*p == '-');
+  if (negative)
+    p++;
+  char mantissa[24];
+  int n = 0;
+  for (; p < e; p++) {
+    if (*p != '.')
+      mantissa[n++] = *p;
+  }
+
+  // repr switches to exponent notation outside 1e-4 <= |value| < 1e16
+  reserve(32);
+  if (negative)
+    m_buffer[m_len++] = '-';
+  if (exponent < -4 || exponent >= 16) {
+    m_buffer[m_len++] = mantissa[0];
+    if (n > 1) {
+      m_buffer[m_len++] = '.';
+      for (int i = 1; i < n; i++)
+        m_buffer[m_len++] = mantissa[i];
+    }
+    m_buffer[m_len++] = 'e';
+    m_buffer[m_len++] = exponent < 0 ? '-' : '+';
+    int a = exponent < 0 ? -exponent : exponent;
+    if (a >= 100)
+      m_buffer[m_len++] = (char) ('0' + a / 100);
+    m_buffer[m_len++] = (char) ('0' + a / 10 % 10);
+    m_buffer[m_len++] = (char) ('0' + a % 10);
+  }
+  else if (exponent < 0) {
+    m_buffer[m_len++] = '0';
+    m_buffer[m_len++] = '.';
+    for (int i = -1; i > exponent; i--)
+      m_buffer[m_len++] = '0';
+    for (int i = 0; i < n; i++)
+      m_buffer[m_len++] = mantissa[i];
+  }
+  else {
+    for (int i = 0; i <= exponent; i++)
+      m_buffer[m_len++] = i < n ? mantissa[i] : '0';
+    m_buffer[m_len++] = '.';
+    if (n <= exponent + 1)
+      m_buffer[m_len++] = '0';
+    for (int i = exponent + 1; i < n; i++)
+      m_buffer[m_len++] = mantissa[i];
+  }
+}
@@ -0,0 +1,167 @@
+#ifndef gpfWriter_h
+#define gpfWriter_h
+
+// Block buffered output for the GPF tools.
+//
+// Records are formatted straight into one large reusable buffer, doubles
+// through std::to_chars, and the buffer is handed to write(2) whenever it
+// fills.  The bytes produced are identical to the equivalent fprintf calls
+// ("%.14lf", "%d", "%s").
+//
+// A path ending in ".gz" or ".zst" is written compressed (gpfCompress.h),
+// each buffer going through the compressor on its way to write(2).
+//
+// The buffer is page aligned and a multiple of the page size, so a file
+// goes out in whole aligned blocks, and only the final write is short.
+// That is what O_DIRECT needs, and what keeps a parallel file system from
+// splitting small writes.  gpfSetOutputOptions() turns on O_DIRECT or
+// cache dropping hints for every writer opened after it.
+//
+// In the pipelined mode (gpfAsyncIO.h) a full buffer is written in the
+// background while the next one is formatted into a second buffer.  A
+// compressed file is written as before, by the compressor.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <string_view>
+
+class GpfAsyncIO;
+class GpfCompressor;
+
+//-----------------------------------------------------------------------
+// How GpfWriter::open() treats the files it writes.  Set once by a tool,
+// from its command line, before any writer is opened.
+//-----------------------------------------------------------------------
+struct GpfOutputOptions {
+  bool directIO;    // O_DIRECT, bypassing the page cache (not for
+                    // compressed outputs, or where the file system
+                    // refuses it)
+  bool dropCache;   // start writeback of each block as it is written, and
+                    // drop it from the page cache once it is on disk
+
+  GpfOutputOptions() : directIO(false), dropCache(false) {}
+};
+
+void gpfSetOutputOptions(const GpfOutputOptions &options);
+const GpfOutputOptions &gpfOutputOptions();
+
+class GpfWriter {
+ public:
+  static constexpr size_t DefaultBufferSize = 4 << 20;
+
+  explicit GpfWriter(size_t bufferSize = DefaultBufferSize);
+  ~GpfWriter();
+  GpfWriter(const GpfWriter &) = delete;
+  GpfWriter &operator=(const GpfWriter &) = delete;
+
+  // Creates/truncates path for writing.  Returns false with error() set
+  // if it can not.
+  bool open(const char *path);
+
+  // Why open() failed, when it was not the file itself
+  const std::string &error() const { return m_error; }
+
+  // Reserves disk space for about bytes of output, e.g. estimated from the
+  // number of points in the gpf, so the file is laid out in one piece
+  // rather than grown a block at a time.  The file size is not changed,
+  // and whatever is not used is released on close(), also when only part
+  // of it could be reserved.  Only a hint: it does nothing for compressed
+  // outputs or where the file system can not.  Estimates from a gpf header
+  // should be capped by the size of the gpf, which the header can not
+  // overstate.
+  void preallocate(size_t bytes);
+
+  // Formats into memory instead of a file: the buffer grows as needed and
+  // nothing is written until the contents are taken with buffer() and
+  // written to another writer.  Used to format parts of a file in
+  // parallel and write them out in order.
+  void openMemory();
+  std::string_view buffer() const { return std::string_view(m_buffer, m_len); }
+  void clearBuffer() { m_len = 0; }
+
+  // Flushes and closes.  Returns false if any write failed.
+  bool close();
+
+  // Writes out everything buffered, which may end the file's O_DIRECT
+  // writes with a short one.  close() does this already.
+  bool flush();
+  bool good() const { return m_good; }
+
+  // Bytes handed to write(2) so far, and the wall time spent in it, for
+  // the -stats counters.  Both stay 0 in memory mode.  For a compressed
+  // file the bytes are counted before compression, and the time includes
+  // compressing them.
+  size_t bytesWritten() const { return m_written; }
+  double writeSeconds() const { return m_writeSeconds; }
+
+  // Bytes output so far, the buffered ones included, i.e. the offset the
+  // next byte goes to (before compression, for a compressed output)
+  uint64_t position() const { return m_written + m_len; }
+
+  void put(char c) {
+    if (m_len == m_capacity)
+      reserve(1);
+    m_buffer[m_len++] = c;
+  }
+  void write(std::string_view s);
+
+  // write() of bytes that are also at offset in the file open on fd, e.g.
+  // a run of verbatim records of a mapped gpf.  A long run is copied file
+  // to file with copy_file_range(2), in the kernel, when the output is a
+  // plain file written without O_DIRECT; anything else is written from
+  // memory.
+  void writeCopy(std::string_view bytes, int fd, size_t offset);
+
+  // printf("%.<precision>lf") equivalent
+  void putFixed(double value, int precision);
+
+  // printf("%d") equivalent
+  void putInt(int value);
+
+  // Python repr() equivalent, as pandas writes a float column: the fewest
+  // digits that read back as value, e.g. 0.0, 14076.51624382342, 1e-05
+  void putShortest(double value);
+
+ private:
+  // makes sure at least n bytes are free in the buffer
+  void reserve(size_t n) {
+    if (m_capacity - m_len < n) {
+      if (m_memory)
+        grow(n);
+      else
+        drain();
+    }
+  }
+  void grow(size_t n);
+  void drain();
+  bool writeOut(const char *p, size_t n, bool finish = false);
+  bool writeFile(const char *p, size_t n);
+  void dropWritten(size_t start, size_t n);
+  void writeBehind(size_t n);
+  bool finishWrite();
+  void endDirectIO();
+
+  char  *m_buffer;
+  size_t m_capacity;
+  size_t m_len;
+  int    m_fd;
+  bool   m_good;
+  bool   m_memory;
+  size_t m_written;
+  double m_writeSeconds;
+  std::unique_ptr<GpfCompressor> m_compressor;
+  std::string m_error;
+  size_t m_offset;          // bytes in the file so far
+  size_t m_synced;          // with dropCache, the bytes already dropped
+  bool   m_direct;          // opened O_DIRECT
+  bool   m_preallocated;    // fallocate() tried, whether or not it succeeded
+  std::unique_ptr<GpfAsyncIO> m_async;    // pipelined mode only
+  char  *m_spare;           // the buffer being written in the background
+  size_t m_spareCapacity;
+  size_t m_pendingOffset;   // and what of the file it holds
+  size_t m_pending;
+};
+
+#endif
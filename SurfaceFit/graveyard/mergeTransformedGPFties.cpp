@@ -6,167 +6,953 @@
 #include <ctype.h>
 #include <stdlib.h>
 
-#define LINELENGTH 200
-#define FILELEN 512
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gpfAsyncIO.h"
+#include "gpfBatch.h"
+#include "gpfBinary.h"
+#include "gpfCompress.h"
+#include "gpfConvert.h"
+#include "gpfCsvFormat.h"
+#include "gpfErrorStats.h"
+#include "gpfIndexFile.h"
+#include "gpfMergeWriter.h"
+#include "gpfPatch.h"
+#include "gpfPointIndex.h"
+#include "gpfReader.h"
+#include "gpfStats.h"
+#include "gpfThreadPool.h"
+#include "gpfWriter.h"
+
 #define MAXFILES 50
 #define MAXPOINTS 2000
 
-main(int argc, char *argv[])
-{
-
-  char     origGPFFile[FILELEN];
-  char     tfmGPFFile[FILELEN];
-  char     tfmCSVFile[FILELEN];
-
-  FILE     *origgpfFp;  // file pointer to input gpf prior to transformation
-  FILE     *tfmcsvFp;  // file pointer to input csv file of transformed ground coordiantes
-  FILE     *tfmgpfFp;  // file pointer to output gpf with tranformed coordiantes
+// number of records parsed and converted together
+#define BLOCKSIZE 65536
 
-  char     csvLine[LINELENGTH];
-  char     gpfLine[LINELENGTH];
-
-  // check number of command line args and issue help if needed
-  //-----------------------------------------------------------
-  if (argc != 4) {
-     printf ("\nrun %s as follows:\n",argv[0]);
+static void usage(const char *prog)
+{
+     printf ("\nrun %s as follows:\n",prog);
      printf ("   %s origGPF tfmCSV tfmGPF\n",
-             argv[0]);
+             prog);
+     printf ("   %s -join tiePointIds origGPF tfmCSV tfmGPF\n",
+             prog);
+     printf ("   %s -matrix tfmMatrix [-datum name | -radii a b] origGPF tfmGPF\n",
+             prog);
+     printf ("   %s -update -join tiePointIds tfmGPF tfmCSV\n",
+             prog);
+     printf ("   %s [-jobs N] [options] -batch manifest\n",
+             prog);
      printf ("\nwhere:\n");
+     printf ("  Any input file may be gzip or zstd compressed, and a tfmGPF named *.gz or\n");
+     printf ("  *.zst is written compressed (on N threads for zst with -zthreads N, default\n");
+     printf ("  0 = one per core).  -update can not be used on a compressed tfmGPF\n\n");
      printf ("  origGPF = Socet Set *.gpf file for a geographic project, prior to running pc_align\n\n");
-     printf ("  tfmCSV = tranformed *.csv file of original tie ground point coordinates generaged by pc_align\n\n");
+     printf ("  tfmCSV = tranformed *.csv file of original tie ground point coordinates generaged by pc_align\n");
+     printf ("           Use - to read it from standard input (or give a named pipe), so the\n");
+     printf ("           merge can run while the coordinates are still being written\n\n");
+     printf ("           tfmCSV may also be a binary *.tiePoints.bin file (see\n");
+     printf ("           gpfTies2LatLonHeightCSV_360sys -binary), which carries its own point\n");
+     printf ("           IDs and is always matched to the origGPF by ID\n\n");
+     printf ("  tiePointIds = point ID list, one per line, naming the point on the same line\n");
+     printf ("           of tfmCSV.  With -join the csv rows are matched to the origGPF by point\n");
+     printf ("           ID rather than by order, so they may come in any order (e.g. shards of\n");
+     printf ("           the .tiePointIds.txt and pc_align output concatenated together).\n");
+     printf ("           Rows listed as \"pointID overlap\" (the borrowed points of the\n");
+     printf ("           gpfTies2LatLonHeightCSV_360sys -tiles tiles) are skipped\n\n");
+     printf ("  tfmMatrix = 4x4 pc_align transform (*-transform.txt) to apply directly to the\n");
+     printf ("           tie points instead of reading a tfmCSV.  The tie points are converted to\n");
+     printf ("           ECEF on the datum (D_MARS unless -datum or -radii is given), transformed\n");
+     printf ("           and converted back.  To reproduce pc_align's\n");
+     printf ("           --save-inv-transformed-reference-points give the *-inverse-transform.txt\n\n");
      printf ("  tfmGPF = Socet Set *.gpf containing transformed ground control\n\n");
+     printf ("  -update = tfmGPF is the output of an earlier merge, and tfmCSV (with the\n");
+     printf ("           -join ID list, or a binary file) holds new coordinates for some of\n");
+     printf ("           its transformed tie points.  Only the coordinate lines of those\n");
+     printf ("           records are rewritten, in place when the new line fits (padded with\n");
+     printf ("           blanks), else through a patched copy that replaces tfmGPF.  With\n");
+     printf ("           -stats the transformed_ties are the points updated.  If tfmGPF has\n");
+     printf ("           a current .gpfidx index (written by the merge with -index), only\n");
+     printf ("           the records to update are read\n\n");
+     printf ("  -direct = write tfmGPF with O_DIRECT, around the page cache\n\n");
+     printf ("  -fadvise = write back each block of tfmGPF as it is written and drop it\n");
+     printf ("           from the page cache, so a large merge does not fill it\n\n");
+     printf ("  -pipeline = read the inputs ahead and write tfmGPF behind in the\n");
+     printf ("           background (io_uring where the kernel has it), overlapping\n");
+     printf ("           reading, merging and writing.  The output is the same\n\n");
+     printf ("  -columns order = the column order of tfmCSV, e.g. lon,lat,height (default\n");
+     printf ("           lat,lon,height, as written by gpfTies2LatLonHeightCSV_360sys\n");
+     printf ("           -columns).  Longitudes may be in 0 to 360 or -180 to 180\n\n");
+     printf ("  -errors = also write <corename of tfmGPF>.errors.csv, the count, mean,\n");
+     printf ("           RMS, min, max and 50/90/95/99th percentiles of the sigmas and\n");
+     printf ("           residuals of every record, by its known value in origGPF,\n");
+     printf ("           gathered in the merge pass\n\n");
+     printf ("  -index = also write <corename of tfmGPF>.gpfidx, the point index of\n");
+     printf ("           tfmGPF, from the merge pass, so a later -update only reads the\n");
+     printf ("           records it patches.  tfmGPF must be uncompressed\n\n");
+     printf ("  -stats = print the wall time of each phase (parse, convert, format,\n");
+     printf ("           write), the bytes read and written and the number of records\n");
+     printf ("           of each stat/known category (passed through control, inactive\n");
+     printf ("           ties, transformed ties) as one line of JSON per merge.  May be\n");
+     printf ("           given with any of the forms above\n\n");
+     printf ("  manifest = list of merges to run (- for standard input), one per line,\n");
+     printf ("           each line holding the arguments of one run, e.g.\n");
+     printf ("           \"origGPF tfmCSV tfmGPF\" or \"-matrix tfmMatrix origGPF tfmGPF\"\n");
+     printf ("           (the command line options are the defaults).  Up to N merges\n");
+     printf ("           (-jobs, 0 = one per core, at most %d) run at once, failures are\n",MAXFILES);
+     printf ("           reported by manifest line.\n\n");
      printf ("  transformed points will be set to XYZ control with default sigmas of 1.0 1.0 1.0\n");
      printf ("  Preexisting ground control in the origGPF will be set to tie points\n");
      exit(1);
+}
+
+//-----------------------------------------------------------------------
+// Default mode.  For each block of records, one csv line is read per
+// active tie point, the 360 lon domain degrees are converted to 180 lon
+// domain radians in one batch, and the block is written out in order.
+// Returns false if the csv runs out before the active tie points do.
+//-----------------------------------------------------------------------
+static bool mergeWithCSV(GpfReader &origgpf, GpfLineReader &tfmcsv, GpfWriter &tfmgpf,
+                         const GpfCsvFormat &format, GpfErrorStats *errors,
+                         GpfIndexBuilder *index, GpfStats &stats)
+{
+  double mark = GpfStats::now();
+  std::vector<GpfPointRecord> block(BLOCKSIZE);
+  std::vector<double> ddLat, ddLon360;
+  GpfTieCoords ties;
+  ties.textHeights = true;
+
+  size_t nrec;
+  while ((nrec = origgpf.nextBlock(block.data(),BLOCKSIZE)) > 0) {
+    size_t nties = gpfCountTies(block.data(),nrec);
+    ties.clear();
+    ddLat.clear();
+    ddLon360.clear();
+    if (!gpfReadCsvTies(tfmcsv,nties,ddLat,ddLon360,ties,format))
+      return false;
+    ties.radLat.resize(nties);
+    ties.radLon180.resize(nties);
+    stats.lap(GpfStats::Parse,mark);
+
+    // convert transformed coordinates, 360 lon domain to 180 lon domain
+    gpfDegrees360ToRadians(nties,ddLat.data(),ddLon360.data(),
+                           ties.radLat.data(),ties.radLon180.data());
+    stats.lap(GpfStats::Convert,mark);
+
+    if (errors)
+      errors->add(block.data(),nrec);
+    gpfWriteMergedBlock(tfmgpf,block.data(),nrec,ties,origgpf.layout(),stats,&origgpf.file(),
+                        index);
+    mark = GpfStats::now();
+  }
+  stats.lap(GpfStats::Parse,mark);
+  return true;
+}
+
+//-----------------------------------------------------------------------
+// -join mode.  The whole csv is read first, row i being the transformed
+// coordinate of the point named on line i of the ID list, and the rows
+// are indexed by point ID and converted in one batch.  Rows whose ID is
+// followed by "overlap" (see gpfTiles.h) are skipped.  pointIDs, if
+// given, gets the ID of each row.
+//-----------------------------------------------------------------------
+static bool readJoinRows(const GpfMappedFile &ids, GpfLineReader &tfmcsv,
+                         const GpfCsvFormat &format, GpfPointIndex &index,
+                         GpfTieCoords &rows, GpfStats &stats, std::string &error,
+                         std::vector<std::string_view> *pointIDs = NULL)
+{
+  double mark = GpfStats::now();
+  std::vector<double> ddLat, ddLon360;
+  rows.clear();
+  rows.textHeights = true;
+
+  const char *idCur = ids.data();
+  const char *idEnd = idCur + ids.size();
+  bool ok = true;
+  gpfWithCsvLayout(format,[&](auto layout) {
+    typedef decltype(layout) Layout;
+    std::string_view csvLine;
+    while (tfmcsv.next(csvLine)) {
+      std::string_view idLine = gpfNextLine(idCur,idEnd);
+      std::string_view pointID = gpfNextToken(idLine);
+      if (pointID.empty()) {
+        error = "the ID list has fewer lines than the transformed csv";
+        ok = false;
+        return;
+      }
+      // a point another -tiles tile owns, only there for pc_align's sake
+      if (gpfNextToken(idLine) == "overlap")
+        continue;
+      if (!index.insert(pointID,(uint32_t) ddLat.size())) {
+        error = "point " + std::string(pointID) + " is in the ID list more than once";
+        ok = false;
+        return;
+      }
+      if (pointIDs)
+        pointIDs->push_back(pointID);
+
+      std::string_view valLat, valLon360, Height;
+      Layout::split(csvLine,valLat,valLon360,Height);
+      ddLat.push_back(gpfToDouble(valLat));
+      ddLon360.push_back(gpfToDouble(valLon360));
+      rows.heightText.append(Height.data(),Height.size());
+      rows.heightEnd.push_back(rows.heightText.size());
+    }
+  });
+  if (!ok || tfmcsv.failed())
+    return false;
+
+  stats.lap(GpfStats::Parse,mark);
+
+  // convert every row, 360 lon domain to 180 lon domain
+  size_t nrows = ddLat.size();
+  rows.radLat.resize(nrows);
+  rows.radLon180.resize(nrows);
+  gpfDegrees360ToRadians(nrows,ddLat.data(),ddLon360.data(),
+                         rows.radLat.data(),rows.radLon180.data());
+  stats.lap(GpfStats::Convert,mark);
+  return true;
+}
+
+//-----------------------------------------------------------------------
+// Binary tie point input.  Like -join, but the IDs come from the file
+// itself and the columns are converted straight from the mapping.
+//-----------------------------------------------------------------------
+static bool readBinaryRows(const GpfBinaryFile &bin, GpfPointIndex &index,
+                           GpfTieCoords &rows, GpfStats &stats, std::string &error)
+{
+  double mark = GpfStats::now();
+  size_t nrows = bin.count();
+  index.reserve(nrows);
+  for (size_t i=0; i<nrows; i++) {
+    if (!index.insert(bin.pointID(i),(uint32_t) i)) {
+      error = "point " + std::string(bin.pointID(i)) + " is in the binary file more than once";
+      return false;
+    }
+  }
+
+  stats.lap(GpfStats::Parse,mark);
+
+  // convert every row, 360 lon domain to 180 lon domain
+  rows.clear();
+  rows.textHeights = false;
+  rows.radLat.resize(nrows);
+  rows.radLon180.resize(nrows);
+  gpfDegrees360ToRadians(nrows,bin.lat(),bin.lon(),rows.radLat.data(),rows.radLon180.data());
+  rows.height.assign(bin.height(),bin.height()+nrows);
+  stats.lap(GpfStats::Convert,mark);
+  return true;
+}
+
+// Appends row of rows to the tie coordinates of a block
+static void appendRow(GpfTieCoords &ties, const GpfTieCoords &rows, uint32_t row)
+{
+  ties.radLat.push_back(rows.radLat[row]);
+  ties.radLon180.push_back(rows.radLon180[row]);
+  if (rows.textHeights) {
+    size_t begin = row ? rows.heightEnd[row-1] : 0;
+    ties.heightText.append(rows.heightText,begin,rows.heightEnd[row]-begin);
+    ties.heightEnd.push_back(ties.heightText.size());
+  }
+  else
+    ties.height.push_back(rows.height[row]);
+}
+
+//-----------------------------------------------------------------------
+// -join and binary input.  The original gpf is written in its own order,
+// looking up each active tie point in the indexed rows by ID.  source
+// names the rows in errors.  sidecar, if given, collects the .gpfidx of
+// tfmGPF.
+//-----------------------------------------------------------------------
+static bool mergeWithJoin(GpfReader &origgpf, const GpfPointIndex &index,
+                          const GpfTieCoords &rows, const char *source,
+                          GpfWriter &tfmgpf, GpfErrorStats *errors,
+                          GpfIndexBuilder *sidecar, GpfStats &stats, std::string &error)
+{
+  double mark = GpfStats::now();
+  std::vector<GpfPointRecord> block(BLOCKSIZE);
+  GpfTieCoords ties;
+  ties.textHeights = rows.textHeights;
+
+  size_t nrec;
+  while ((nrec = origgpf.nextBlock(block.data(),BLOCKSIZE)) > 0) {
+    ties.clear();
+    for (size_t i=0; i<nrec; i++) {
+      const GpfPointRecord &rec = block[i];
+      if (rec.statValue() != 1 || rec.knownValue() != 0)
+        continue;
+
+      uint32_t row = index.find(rec.pointID);
+      if (row == GpfPointIndex::NotFound) {
+        error = "active tie point " + std::string(rec.pointID) + " is not in the " + source;
+        return false;
+      }
+      appendRow(ties,rows,row);
+    }
+    stats.lap(GpfStats::Parse,mark);
+
+    if (errors)
+      errors->add(block.data(),nrec);
+    gpfWriteMergedBlock(tfmgpf,block.data(),nrec,ties,origgpf.layout(),stats,&origgpf.file(),
+                        sidecar);
+    mark = GpfStats::now();
+  }
+  stats.lap(GpfStats::Parse,mark);
+  return true;
+}
+
+//-----------------------------------------------------------------------
+// -matrix mode.  The active tie points of each block are converted
+// geodetic -> ECEF -> transformed -> geodetic in one batch instead.
+//-----------------------------------------------------------------------
+static void mergeWithMatrix(GpfReader &origgpf, const GpfTransform &tfm,
+                            const GpfDatum &datum, GpfWriter &tfmgpf,
+                            GpfErrorStats *errors, GpfIndexBuilder *index,
+                            GpfStats &stats)
+{
+  double mark = GpfStats::now();
+  std::vector<GpfPointRecord> block(BLOCKSIZE);
+  std::vector<double> lat, lon, x(BLOCKSIZE), y(BLOCKSIZE), z(BLOCKSIZE);
+  GpfTieCoords ties;
+  ties.textHeights = false;
+
+  size_t nrec;
+  while ((nrec = origgpf.nextBlock(block.data(),BLOCKSIZE)) > 0) {
+    ties.clear();
+    lat.clear();
+    lon.clear();
+    for (size_t i=0; i<nrec; i++) {
+      const GpfPointRecord &rec = block[i];
+      if (rec.statValue() == 1 && rec.knownValue() == 0) {
+        lat.push_back(gpfToDouble(rec.lat));
+        lon.push_back(gpfToDouble(rec.lon));
+        ties.height.push_back(gpfToDouble(rec.height));
+      }
+    }
+
+    stats.lap(GpfStats::Parse,mark);
+
+    size_t nties = lat.size();
+    ties.radLat.resize(nties);
+    ties.radLon180.resize(nties);
+    if (origgpf.layout() == GpfGxp) {
+      // GXP degrees to radians first
+      gpfDegrees360ToRadians(nties,lat.data(),lon.data(),ties.radLat.data(),ties.radLon180.data());
+      lat.assign(ties.radLat.begin(),ties.radLat.end());
+      lon.assign(ties.radLon180.begin(),ties.radLon180.end());
+    }
+    gpfGeodeticToEcef(datum,nties,lat.data(),lon.data(),ties.height.data(),
+                      x.data(),y.data(),z.data());
+    gpfApplyTransform(tfm,nties,x.data(),y.data(),z.data());
+    gpfEcefToGeodetic(datum,nties,x.data(),y.data(),z.data(),
+                      ties.radLat.data(),ties.radLon180.data(),ties.height.data());
+    stats.lap(GpfStats::Convert,mark);
+
+    if (errors)
+      errors->add(block.data(),nrec);
+    gpfWriteMergedBlock(tfmgpf,block.data(),nrec,ties,origgpf.layout(),stats,&origgpf.file(),
+                        index);
+    mark = GpfStats::now();
+  }
+  stats.lap(GpfStats::Parse,mark);
+}
+
+//-----------------------------------------------------------------------
+// -update mode.  tfmgpf is the output of an earlier merge and rows hold
+// new coordinates for some of its transformed tie points (stat 1, known
+// 3).  Only the coordinate lines of those records are patched, see
+// gpfPatch.h: "lat    lon    height" at the same precision a full merge
+// writes, between the first and last character of the old coordinates.
+//-----------------------------------------------------------------------
+static bool patchTie(const GpfPointRecord &rec, uint32_t row, const GpfTieCoords &rows,
+                     const char *base, GpfWriter &line, GpfPatchSet &patches,
+                     std::string &error)
+{
+  if (rec.statValue() != 1 || rec.knownValue() != 3) {
+    error = "point " + std::string(rec.pointID) + " is not a transformed tie point";
+    return false;
+  }
+
+  line.clearBuffer();
+  line.putFixed(rows.radLat[row],14);
+  line.write("    ");
+  line.putFixed(rows.radLon180[row],14);
+  line.write("    ");
+  if (rows.textHeights) {
+    size_t begin = row ? rows.heightEnd[row-1] : 0;
+    line.write(std::string_view(rows.heightText).substr(begin,rows.heightEnd[row]-begin));
+  }
+  else
+    line.putFixed(rows.height[row],14);
+
+  const char *first = rec.lat.data();
+  const char *last = rec.height.data() + rec.height.size();
+  patches.add(first - base,last - first,line.buffer());
+  return true;
+}
+
+static bool updateTies(GpfReader &tfmgpf, const GpfPointIndex &index,
+                       const GpfTieCoords &rows, GpfPatchSet &patches,
+                       GpfStats &stats, std::string &error)
+{
+  double mark = GpfStats::now();
+  const char *base = tfmgpf.header().data();
+  std::vector<GpfPointRecord> block(BLOCKSIZE);
+  std::vector<bool> patched(rows.radLat.size(),false);
+  GpfWriter line(256);
+  line.openMemory();
+
+  size_t nrec;
+  while ((nrec = tfmgpf.nextBlock(block.data(),BLOCKSIZE)) > 0) {
+    for (size_t i=0; i<nrec; i++) {
+      const GpfPointRecord &rec = block[i];
+      stats.records++;
+      uint32_t row = index.find(rec.pointID);
+      if (row == GpfPointIndex::NotFound)
+        continue;
+      if (patched[row]) {
+        error = "point " + std::string(rec.pointID) + " is in the gpf more than once";
+        return false;
+      }
+      patched[row] = true;
+      if (!patchTie(rec,row,rows,base,line,patches,error))
+        return false;
+      stats.ties++;
+    }
+  }
+  stats.lap(GpfStats::Parse,mark);
+
+  if (stats.ties < patched.size()) {
+    error = std::to_string(patched.size() - stats.ties) + " of the " +
+            std::to_string(patched.size()) + " points to update are not in the gpf";
+    return false;
+  }
+  return true;
+}
+
+// Same, but the records are looked up in the .gpfidx sidecar of tfmgpf
+// (gpfIndexFile.h) and only they are parsed, rather than the whole file.
+// pointIDs holds the ID of each row.
+static bool updateTiesIndexed(GpfReader &tfmgpf, const GpfIndexFile &sidecar,
+                              const std::vector<std::string_view> &pointIDs,
+                              const GpfTieCoords &rows, GpfPatchSet &patches,
+                              GpfStats &stats, std::string &error)
+{
+  double mark = GpfStats::now();
+  const char *base = tfmgpf.header().data();
+  GpfWriter line(256);
+  line.openMemory();
+
+  // the records of the rows, in file order since that is how patches go
+  std::vector<std::pair<uint64_t,uint32_t> > records;
+  records.reserve(pointIDs.size());
+  size_t missing = 0;
+  for (size_t row=0; row<pointIDs.size(); row++) {
+    bool repeated = false;
+    uint64_t ordinal = sidecar.find(pointIDs[row],base,&repeated);
+    if (ordinal == GpfIndexFile::NotFound) {
+      missing++;
+      continue;
+    }
+    if (repeated) {
+      error = "point " + std::string(pointIDs[row]) + " is in the gpf more than once";
+      return false;
+    }
+    records.push_back(std::make_pair(ordinal,(uint32_t) row));
+  }
+  if (missing > 0) {
+    error = std::to_string(missing) + " of the " + std::to_string(pointIDs.size()) +
+            " points to update are not in the gpf";
+    return false;
+  }
+  std::sort(records.begin(),records.end());
+
+  for (size_t i=0; i<records.size(); i++) {
+    GpfReader reader;
+    reader.openRange(sidecar.record(base,records[i].first));
+    GpfPointRecord rec;
+    if (!reader.next(rec)) {
+      error = reader.error();
+      return false;
+    }
+    stats.records++;
+    if (!patchTie(rec,records[i].second,rows,base,line,patches,error))
+      return false;
+    stats.ties++;
+  }
+  stats.lap(GpfStats::Parse,mark);
+  return true;
+}
+
+//-----------------------------------------------------------------------
+// One merge run.  The options come from the command line, or from a line
+// of a -batch manifest on top of the command line ones.
+//-----------------------------------------------------------------------
+struct MergeJob {
+  std::string origGPFFile;
+  std::string tfmGPFFile;
+  std::string tfmCSVFile;
+  std::string matrixFile;   // -matrix, empty if not given
+  std::string idsFile;      // -join, empty if not given
+  bool        update;       // -update, tfmGPF is patched with tfmCSV
+  bool        stats;        // -stats
+  bool        errors;       // -errors, write the sigma/residual summary
+  bool        index;        // -index, write the .gpfidx sidecar of tfmGPF
+  GpfCsvFormat csvFormat;   // -columns of tfmCSV
+  GpfDatum    datum;
+
+  MergeJob() : update(false), stats(false), errors(false), index(false),
+               datum(GpfDatum::mars()) {}
+};
+
+// Parses "[options] origGPF tfmCSV tfmGPF" (or "origGPF tfmGPF" with
+// -matrix, "tfmGPF tfmCSV" with -update) from args[argi...] into job.
+// -batch, -jobs, -zthreads, -direct, -fadvise and -pipeline are only
+// accepted when manifest, njobs, zthreads, output and pipelined are given
+// (the command line rather than a manifest line), and with -batch there
+// are no file arguments.  Returns false with error set on a bad argument.
+static bool parseMergeArgs(const std::vector<std::string> &args, size_t argi,
+                           MergeJob &job, std::string &error,
+                           const char **manifest = NULL, int *njobs = NULL,
+                           int *zthreads = NULL, GpfOutputOptions *output = NULL,
+                           bool *pipelined = NULL)
+{
+  while (argi < args.size() && args[argi].size() > 1 && args[argi][0] == '-') {
+    const std::string &opt = args[argi];
+    if (opt == "-matrix" && argi+1 < args.size())
+      job.matrixFile = args[++argi];
+    else if (opt == "-join" && argi+1 < args.size())
+      job.idsFile = args[++argi];
+    else if (opt == "-update")
+      job.update = true;
+    else if (opt == "-stats" || opt == "--stats")
+      job.stats = true;
+    else if (opt == "-errors")
+      job.errors = true;
+    else if (opt == "-index")
+      job.index = true;
+    else if (opt == "-columns" && argi+1 < args.size()) {
+      if (!GpfCsvFormat::parseColumns(args[++argi],job.csvFormat,error))
+        return false;
+    }
+    else if (opt == "-datum" && argi+1 < args.size()) {
+      if (!GpfDatum::fromName(args[++argi].c_str(),job.datum)) {
+        error = "unknown datum: " + args[argi] + " (use D_MARS, MOLA, D_MOON or WGS84)";
+        return false;
+      }
+    }
+    else if (opt == "-radii" && argi+2 < args.size()) {
+      argi += 2;
+      if (!GpfDatum::fromRadii(args[argi-1].c_str(),args[argi].c_str(),job.datum)) {
+        error = "-radii expects two positive radii in meters, the semi-major one first: " +
+                args[argi-1] + " " + args[argi];
+        return false;
+      }
+    }
+    else if (manifest && opt == "-batch" && argi+1 < args.size())
+      *manifest = args[++argi].c_str();
+    else if (njobs && opt == "-jobs" && argi+1 < args.size())
+      *njobs = atoi(args[++argi].c_str());
+    else if (zthreads && opt == "-zthreads" && argi+1 < args.size())
+      *zthreads = atoi(args[++argi].c_str());
+    else if (output && opt == "-direct")
+      output->directIO = true;
+    else if (output && opt == "-fadvise")
+      output->dropCache = true;
+    else if (pipelined && opt == "-pipeline")
+      *pipelined = true;
+    else {
+      error = "unknown or incomplete option: " + opt;
+      return false;
+    }
+    argi++;
+  }
+
+  bool matrix = !job.matrixFile.empty();
+  if (matrix && !job.idsFile.empty()) {
+    error = "-matrix and -join can not be used together";
+    return false;
+  }
+  if (matrix && job.update) {
+    error = "-matrix and -update can not be used together";
+    return false;
+  }
+  if (matrix && !job.csvFormat.isDefault()) {
+    error = "-columns is for a tfmCSV, there is none with -matrix";
+    return false;
+  }
+  if (job.errors && job.update) {
+    error = "-errors summarizes a full merge, it can not be used with -update";
+    return false;
+  }
+  if (job.index && job.update) {
+    error = "-index indexes a full merge, -update keeps the index it finds up to date";
+    return false;
+  }
+  if (njobs && *njobs < 0) {
+    error = "-jobs must be 0 or more";
+    return false;
+  }
+  if (zthreads && *zthreads < 0) {
+    error = "-zthreads must be 0 or more";
+    return false;
+  }
+  if (manifest && *manifest) {
+    if (argi != args.size()) {
+      error = "no file arguments are given with -batch";
+      return false;
+    }
+    return true;
+  }
+
+  size_t nargs = args.size() - argi;
+  if (job.update) {
+    if (nargs != 2) {
+      error = "expected tfmGPF tfmCSV";
+      return false;
+    }
+    job.tfmGPFFile = args[argi];
+    job.tfmCSVFile = args[argi+1];
+    return true;
+  }
+  if (nargs != (matrix ? 2u : 3u)) {
+    error = matrix ? "expected origGPF tfmGPF" : "expected origGPF tfmCSV tfmGPF";
+    return false;
   }
 
   //------------------------------------------------
   // get input arguments entered at the command line
   //------------------------------------------------
 
-  strcpy (origGPFFile,argv[1]);
-  strcpy (tfmCSVFile,argv[2]);
-  strcpy (tfmGPFFile,argv[3]);
+  job.origGPFFile = args[argi];
+  if (matrix)
+    job.tfmGPFFile = args[argi+1];
+  else {
+    job.tfmCSVFile = args[argi+1];
+    job.tfmGPFFile = args[argi+2];
+  }
+  return true;
+}
+
+// -update: patches the tie points of job.tfmCSVFile (with its ID list,
+// or a binary file) into the job.tfmGPFFile from an earlier merge.
+// Returns an empty string on success, else what went wrong.
+static std::string updateGpf(const MergeJob &job, std::string &statsJson)
+{
+  GpfStats stats;
+  double start = GpfStats::now();
+
+  GpfReader tfmgpf;     // mapped merged gpf to update
+  GpfLineReader tfmcsv; // transformed coordinates of the points to update
+  GpfMappedFile ids;    // their point ids
+  GpfBinaryFile tfmbin; // or binary tie points given in place of both
+
+  if (!tfmgpf.open(job.tfmGPFFile.c_str())) {
+    std::string message = "unable to open transformed ground point file: " + job.tfmGPFFile;
+    if (!tfmgpf.error().empty())
+      message += "\n  " + tfmgpf.error();
+    return message;
+  }
+  if (tfmgpf.layout() != GpfSocetSet)
+    return "-update expects a gpf written by an earlier merge: " + job.tfmGPFFile;
+  if (tfmgpf.compression() != GpfUncompressed)
+    return "-update can not patch a compressed gpf in place: " + job.tfmGPFFile;
+
+  // with a current .gpfidx sidecar only the records to patch are parsed
+  GpfIndexFile sidecar;
+  std::string indexFile = gpfIndexPath(job.tfmGPFFile);
+  std::string indexError;
+  bool indexed = sidecar.open(indexFile.c_str(),job.tfmGPFFile.c_str(),indexError) &&
+                 sidecar.count() == (size_t) tfmgpf.numPoints();
+
+  GpfPointIndex index;
+  GpfTieCoords rows;
+  std::vector<std::string_view> pointIDs;
+  std::string joinError;
+  if (GpfBinaryFile::isBinary(job.tfmCSVFile.c_str())) {
+    if (!job.idsFile.empty())
+      return "-join can not be used with a binary tie point file, it carries its own point ids";
+    if (!job.csvFormat.isDefault())
+      return "-columns is for a tfmCSV, a binary tie point file has its own layout";
+    if (!tfmbin.open(job.tfmCSVFile.c_str())) {
+      std::string message = "unable to open input binary tie point file: " + job.tfmCSVFile;
+      if (!tfmbin.error().empty())
+        message += "\n  " + tfmbin.error();
+      return message;
+    }
+    if (!readBinaryRows(tfmbin,index,rows,stats,joinError))
+      return "unable to index " + job.tfmCSVFile + " by point id: " + joinError;
+    for (size_t i=0; i<tfmbin.count(); i++)
+      pointIDs.push_back(tfmbin.pointID(i));
+  }
+  else {
+    if (job.idsFile.empty())
+      return "-update needs -join tiePointIds to match the rows of " + job.tfmCSVFile;
+    if (!tfmcsv.open(job.tfmCSVFile.c_str()))
+      return "unable to open input transformed csv file: " + job.tfmCSVFile +
+             (tfmcsv.error().empty() ? "" : "\n  " + tfmcsv.error());
+    if (!ids.open(job.idsFile.c_str()))
+      return "unable to open input list file of tie point ids: " + job.idsFile +
+             (ids.error().empty() ? "" : "\n  " + ids.error());
+    if (!readJoinRows(ids,tfmcsv,job.csvFormat,index,rows,stats,joinError,&pointIDs)) {
+      if (tfmcsv.failed())
+        return "error reading input transformed csv file: " + job.tfmCSVFile;
+      return "unable to join " + job.tfmCSVFile + " to " + job.idsFile + " by point id: " + joinError;
+    }
+  }
+
+  GpfPatchSet patches;
+  bool updated = indexed ? updateTiesIndexed(tfmgpf,sidecar,pointIDs,rows,patches,stats,joinError)
+                         : updateTies(tfmgpf,index,rows,patches,stats,joinError);
+  if (!updated)
+    return "unable to update " + job.tfmGPFFile + ": " + joinError;
+  if (!tfmgpf.error().empty())
+    return "error reading transformed ground point file: " + job.tfmGPFFile + "\n  " + tfmgpf.error();
+
+  // the patched copy, if it comes to that, is written from the mapping
+  double mark = GpfStats::now();
+  size_t written = 0;
+  if (!patches.apply(job.tfmGPFFile.c_str(),tfmgpf.header().data(),tfmgpf.fileSize(),
+                     written,joinError))
+    return "error updating transformed ground point file: " + job.tfmGPFFile + ": " + joinError;
+
+  // patched in place, the records have not moved and the sidecar still
+  // holds; a patched copy leaves it out of date until the next -index
+  if (indexed && patches.fitsInPlace() &&
+      !GpfIndexFile::restamp(indexFile.c_str(),job.tfmGPFFile.c_str(),indexError))
+    return indexError;
+  stats.lap(GpfStats::Write,mark);
+
+  stats.bytesRead = tfmgpf.fileSize() + tfmcsv.bytesRead() + tfmbin.fileSize() + ids.size();
+  tfmgpf.close();
+
+  if (job.stats) {
+    stats.bytesWritten = written;
+    stats.wallSeconds = GpfStats::now() - start;
+    statsJson = stats.json("mergeTransformedGPFties",job.tfmGPFFile,"transformed_ties");
+  }
+  return std::string();
+}
+
+// Merges the transformed tie points of job into its tfmGPF.  Returns an
+// empty string on success, else what went wrong.  With job.stats,
+// statsJson is set to the -stats line of a successful run.
+static std::string mergeGpf(const MergeJob &job, std::string &statsJson)
+{
+  if (job.update)
+    return updateGpf(job,statsJson);
+
+  GpfStats stats;
+  double start = GpfStats::now();
+
+  GpfReader origgpf;    // mapped input gpf prior to transformation
+  GpfLineReader tfmcsv; // input csv file of transformed ground coordiantes
+  GpfMappedFile ids;    // point ids of the tfmCSV rows, for -join
+  GpfBinaryFile tfmbin; // binary tie points given in place of tfmCSV
+  bool binaryInput = false;
+  GpfWriter tfmgpf;     // output gpf with tranformed coordiantes
+
+  bool matrix = !job.matrixFile.empty();
+  bool join = !job.idsFile.empty();
 
   /////////////////////////////////////////////////////////////////////////////
   // open files 
   /////////////////////////////////////////////////////////////////////////////
 
-  origgpfFp = fopen (origGPFFile,"r");
-  if (origgpfFp == NULL) {
-    printf ("unable to open original input gpf file: %s\n",origGPFFile);
-    exit (1);
+  if (!origgpf.open(job.origGPFFile.c_str())) {
+    std::string message = "unable to open original input gpf file: " + job.origGPFFile;
+    if (!origgpf.error().empty())
+      message += "\n  " + origgpf.error();
+    return message;
   }
 
-  tfmcsvFp = fopen (tfmCSVFile,"r");
-  if (tfmcsvFp == NULL) {
-    printf ("unable to open input transformed csv file: %s\n",tfmCSVFile);
-    fclose(origgpfFp);
-    exit (1);
+  GpfTransform tfm;
+  if (matrix) {
+    if (!tfm.read(job.matrixFile.c_str()))
+      return "unable to read 4x4 transform matrix file: " + job.matrixFile;
   }
-
-  tfmgpfFp = fopen (tfmGPFFile,"w");
-  if (tfmgpfFp == NULL) {
-    printf ("unable to open output transformed ground point file: %s\n",tfmGPFFile);
-    fclose(origgpfFp);
-    fclose(tfmcsvFp);
-    exit (1);
+  else if (GpfBinaryFile::isBinary(job.tfmCSVFile.c_str())) {
+    binaryInput = true;
+    if (join)
+      return "-join can not be used with a binary tie point file, it carries its own point ids";
+    if (!job.csvFormat.isDefault())
+      return "-columns is for a tfmCSV, a binary tie point file has its own layout";
+    if (!tfmbin.open(job.tfmCSVFile.c_str())) {
+      std::string message = "unable to open input binary tie point file: " + job.tfmCSVFile;
+      if (!tfmbin.error().empty())
+        message += "\n  " + tfmbin.error();
+      return message;
+    }
   }
+  else if (!tfmcsv.open(job.tfmCSVFile.c_str()))
+    return "unable to open input transformed csv file: " + job.tfmCSVFile +
+           (tfmcsv.error().empty() ? "" : "\n  " + tfmcsv.error());
+
+  if (join && !ids.open(job.idsFile.c_str()))
+    return "unable to open input list file of tie point ids: " + job.idsFile +
+           (ids.error().empty() ? "" : "\n  " + ids.error());
+
+  if (job.index && gpfCompressionOf(job.tfmGPFFile.c_str()) != GpfUncompressed)
+    return "-index needs an uncompressed tfmGPF, the index holds offsets into the file: " +
+           job.tfmGPFFile;
+
+  if (!tfmgpf.open(job.tfmGPFFile.c_str()))
+    return "unable to open output transformed ground point file: " + job.tfmGPFFile +
+           (tfmgpf.error().empty() ? "" : "\n  " + tfmgpf.error());
+
+  // the merged gpf comes out about the size of the original
+  tfmgpf.preallocate(origgpf.fileSize());
 
   //------------------------------------------------
   // Copy the header of the original gpf to the
   // tranformed gpf, and record the number of points
   //------------------------------------------------
 
-  // output first header line to transformed gpf
-  fgets(gpfLine,LINELENGTH,origgpfFp);
-  fputs(gpfLine,tfmgpfFp);
-
-  // read in number of points in the orginal *.gpf file
-  // and output to transformed gpf
-  char value[50]; 
-  fgets(gpfLine,LINELENGTH,origgpfFp);
-  sscanf (gpfLine,"%s",value);
-  int numpts = atoi(value);
-  fputs(gpfLine,tfmgpfFp);
-
-  // ouput third head line to transformed gpf
-  fgets(gpfLine,LINELENGTH,origgpfFp);
-  fputs(gpfLine,tfmgpfFp);
-
-  // Parse original gpf & tfm csv, and output tfm gpf
-  char pointID[50], valStat[2], valKnown[2]; 
-  char valLon360[50], valLat[50], Height[50];
-  double rad2dd = 57.295779513082320876798154814105;
-
-  for (int i=0; i<numpts; i++) {
-    fgets(gpfLine,LINELENGTH,origgpfFp);
-    sscanf (gpfLine,"%s %s %s",pointID,valStat,valKnown);
-    int stat = atoi(valStat);
-    int known = atoi(valKnown);
-
-    if (known > 0) {
-      // Change a non-tie point to tie point in the tfm GPF
-      // regardless if it was used or not
-      fprintf(tfmgpfFp,"%s %d 0\n",pointID,stat);
-      for (int j=0; j<4; j++) {
-        fgets(gpfLine,LINELENGTH,origgpfFp);
-        fputs(gpfLine,tfmgpfFp);
-      }
-    }
-
-    if (stat == 0 & known == 0) {
-      // This is a tie point that was off in the original GPF
-      // so just copy it into the trm GPF
-      fputs(gpfLine,tfmgpfFp);
-      for (int j=0; j<4; j++) {
-        fgets(gpfLine,LINELENGTH,origgpfFp);
-        fputs(gpfLine,tfmgpfFp);
-      }
-    }
-
-    if (stat == 1 && known == 0) {
-      // This point was transformed.  Make it an XYZ control point
-      // in the GPF file, and get the coordinate from the tfm CSV
-      // file
+  // output the three header lines to transformed gpf
+  gpfWriteMergedHeader(tfmgpf,origgpf);
+
+  // Parse original gpf & tfm csv (or apply the matrix), and output tfm gpf
+  GpfPointIndex index;
+  GpfTieCoords rows;
+  GpfErrorStats errors;
+  GpfErrorStats *errorsOut = job.errors ? &errors : NULL;
+  GpfIndexBuilder sidecar;
+  GpfIndexBuilder *indexOut = job.index ? &sidecar : NULL;
+  std::string joinError;
+  if (matrix)
+    mergeWithMatrix(origgpf,tfm,job.datum,tfmgpf,errorsOut,indexOut,stats);
+  else if (binaryInput) {
+    if (!readBinaryRows(tfmbin,index,rows,stats,joinError) ||
+        !mergeWithJoin(origgpf,index,rows,"binary file",tfmgpf,errorsOut,indexOut,stats,
+                       joinError))
+      return "unable to join " + job.tfmCSVFile + " by point id: " + joinError;
+  }
+  else if (join) {
+    if ((!readJoinRows(ids,tfmcsv,job.csvFormat,index,rows,stats,joinError) ||
+         !mergeWithJoin(origgpf,index,rows,"ID list",tfmgpf,errorsOut,indexOut,stats,
+                       joinError)) &&
+        !joinError.empty())
+      return "unable to join " + job.tfmCSVFile + " to " + job.idsFile + " by point id: " + joinError;
+  }
+  else if (!mergeWithCSV(origgpf,tfmcsv,tfmgpf,job.csvFormat,errorsOut,indexOut,stats) &&
+           !tfmcsv.failed())
+    return "input transformed csv file has fewer lines than the active tie points in " +
+           job.origGPFFile + ": " + job.tfmCSVFile;
+
+  if (tfmcsv.failed())
+    return "error reading input transformed csv file: " + job.tfmCSVFile;
+
+  if (!origgpf.error().empty())
+    return "error reading original input gpf file: " + job.origGPFFile + "\n  " + origgpf.error();
+
+  stats.bytesRead = origgpf.fileSize() + tfmcsv.bytesRead() + tfmbin.fileSize() + ids.size();
+  origgpf.close();
+  tfmcsv.close();
+
+  // what is left in the buffer goes out on close
+  double written = tfmgpf.writeSeconds();
+  if (!tfmgpf.close())
+    return "error writing output transformed ground point file: " + job.tfmGPFFile;
+  stats.seconds[GpfStats::Write] += tfmgpf.writeSeconds() - written;
+
+  // the sidecar records the size and time of the closed tfmGPF, the
+  // merge always writing the Socet Set layout
+  if (job.index) {
+    std::string indexFile = gpfIndexPath(job.tfmGPFFile);
+    std::string indexError;
+    double mark = GpfStats::now();
+    if (!sidecar.save(indexFile.c_str(),job.tfmGPFFile.c_str(),GpfSocetSet,indexError))
+      return indexError;
+    stats.lap(GpfStats::Write,mark);
+  }
 
-      fprintf(tfmgpfFp,"%s %d 3\n",pointID,stat);
+  // the summary goes next to tfmGPF, as <corename>.errors.csv
+  if (job.errors) {
+    std::string errorsFile = job.tfmGPFFile;
+    GpfCompression compression = gpfCompressionOf(errorsFile.c_str());
+    if (compression != GpfUncompressed)
+      errorsFile.resize(errorsFile.size() - (compression == GpfGzip ? 3 : 4));
+    if (errorsFile.size() > 4)
+      errorsFile.resize(errorsFile.size()-4);
+    errorsFile += ".errors.csv";
+    double mark = GpfStats::now();
+    if (!errors.write(errorsFile.c_str()))
+      return "error writing output error summary file: " + errorsFile;
+    stats.lap(GpfStats::Write,mark);
+  }
 
-      // get transformed coordinate string and replace commas with spaces in csvLine
-      fgets(csvLine,LINELENGTH,tfmcsvFp);
-      int len = strlen(csvLine);
-      for (int j=0; j<len; j++)
-        if(csvLine[j] == ',') csvLine[j] = ' ';
+  if (job.stats) {
+    stats.bytesWritten = tfmgpf.bytesWritten();
+    stats.wallSeconds = GpfStats::now() - start;
+    statsJson = stats.json("mergeTransformedGPFties",job.origGPFFile,"transformed_ties");
+  }
+  return std::string();
+}
 
-      // parse transformed coordinate, convert 360 lon domain to 180 lon domain
-      char valLon360[50], valLat[50], Height[50];
-      double rad2dd = 57.295779513082320876798154814105;
+int main(int argc, char *argv[])
+{
 
-      sscanf (csvLine,"%s %s %s",valLat,valLon360,Height);
-      double radLat = atof(valLat) / rad2dd;
-      double ddLon360 = atof(valLon360);
-      double radLon180;
-      if (ddLon360 > 180)
-        radLon180 = (ddLon360-360) / rad2dd;
-      else
-        radLon180 = ddLon360 / rad2dd;
+  // parse options, then check number of command line args and issue
+  // help if needed
+  //-----------------------------------------------------------
+  std::vector<std::string> args(argv, argv+argc);
+  const char *manifestFile = NULL;
+  int njobs = 0;
+  int zthreads = 0;
+  GpfOutputOptions output;
+  bool pipelined = false;
+  MergeJob defaults;
+  std::string error;
+  if (!parseMergeArgs(args,1,defaults,error,&manifestFile,&njobs,&zthreads,&output,
+                      &pipelined)) {
+    printf ("%s\n",error.c_str());
+    usage(argv[0]);
+  }
+  gpfSetCompressionThreads((unsigned) zthreads);
+  gpfSetOutputOptions(output);
+  gpfSetPipelined(pipelined);
+
+  if (!manifestFile) {
+    std::string statsJson;
+    error = mergeGpf(defaults,statsJson);
+    if (!error.empty()) {
+      printf ("%s\n",error.c_str());
+      exit (1);
+    }
+    if (!statsJson.empty())
+      printf ("%s\n",statsJson.c_str());
+    return 0;
+  }
 
-      // output coordinate, weights and residuals to tfm GPF
-      fprintf(tfmgpfFp,"%.14lf    %.14lf    %s\n",radLat,radLon180,Height);
-      fprintf(tfmgpfFp,"1.0 1.0 1.0\n");
-      fprintf(tfmgpfFp,"0.0 0.0 0.0\n\n");
+  //------------------------------------------------
+  // -batch: one merge per manifest line, run
+  // concurrently with at most MAXFILES in flight
+  //------------------------------------------------
 
-      // skip the next four lines in the original gpf
-      for (int j=0; j<4; j++) 
-        fgets(gpfLine,LINELENGTH,origgpfFp);
+  std::vector<GpfBatchJob> jobs;
+  if (!gpfReadManifest(manifestFile,jobs,error)) {
+    printf ("%s\n",error.c_str());
+    exit (1);
+  }
 
-    } //end if (stat == 1 && known == 0)
+  unsigned nworkers = GpfThreadPool::threadCount((unsigned) njobs);
+  if (nworkers > MAXFILES)
+    nworkers = MAXFILES;
 
-  } // end for (int i=0; i<numpts; i++)
+  size_t failed = gpfRunBatch(manifestFile,jobs,nworkers,[&defaults](const GpfBatchJob &b, std::string &statsJson) {
+    MergeJob job = defaults;
+    std::string message;
+    if (!parseMergeArgs(b.args,0,job,message))
+      return message;
+    return mergeGpf(job,statsJson);
+  });
 
-  fclose(origgpfFp);
-  fclose(tfmcsvFp);
-  fclose(tfmgpfFp);
+  if (failed > 0) {
+    printf ("%zu of %zu merges in %s failed\n",failed,jobs.size(),manifestFile);
+    exit (1);
+  }
+  return 0;
 
 } // end of program
-
@@ -360,16 +360,13 @@ NOTICE:
   $lineCount = `wc $ssGpfTiesCsv | awk '{print \$1}'`;
   chomp ($lineCount);
 
-  # Extract the transformed coordinates from the transformed CSV
+  # Extract the transformed coordinates from the transformed CSV and
+  # stream them straight into mergeTransformedGPFties, rather than
+  # writing them to an intermediate file first
   $tfmPcAlignedCsv = $pcAlignedCoreName ."-trans_reference.csv";
-  $tfmCoordinates = "tfm_tiePoint_coordinates.csv";
-
-  if (-e $tfmCoordinates) {unlink $tfmCoordinates;}
-  $cmd = "tail \-$lineCount $tfmPcAlignedCsv > $tfmCoordinates";
-  system($cmd) == 0 || ReportErrAndDie ("Failed on command:\n$cmd");
 
   # Generate transformed gpf file
-  $cmd = "$SS_utilities_path/mergeTransformedGPFties $ssGpf $tfmCoordinates $tfmSsGpf";
+  $cmd = "tail \-$lineCount $tfmPcAlignedCsv | $SS_utilities_path/mergeTransformedGPFties $ssGpf - $tfmSsGpf";
   system($cmd) == 0 || ReportErrAndDie ("Failed on command:\n$cmd");
 
   print("\nDone\n");